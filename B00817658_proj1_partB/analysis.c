@@ -0,0 +1,467 @@
+/*
+ *  analysis.c
+ *  Contains basic block discovery and the load-use aware instruction
+ *  scheduler
+ *
+ *  State University of New York, Binghamton
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "analysis.h"
+#include "isa.h"
+
+/* Code address of instruction 0, see get_code_index */
+#define CODE_BASE 4000
+
+static int
+is_control(int op)
+{
+  int op_class = APEX_op_info[op].op_class;
+  return op_class == APEX_CLASS_BRANCH || op_class == APEX_CLASS_JUMP ||
+         op_class == APEX_CLASS_HALT || op == APEX_OP_UNKNOWN;
+}
+
+/*
+ * Index of the instruction a BZ/BNZ at 'index' goes to when taken,
+ * computed the way execute2() does, or -1 if it leaves the program.
+ * For JUMP the register part is unknown, the literal alone is used
+ * (the usual "JUMP,R0,label" form).
+ */
+int
+APEX_branch_target(const APEX_Program* program, int index)
+{
+  const APEX_Instruction* ins = &program->code[index];
+  int target;
+
+  if (APEX_op_info[ins->op].op_class == APEX_CLASS_BRANCH) {
+    target = abs(CODE_BASE + 4 * index + ins->imm);
+  } else if (ins->op == APEX_OP_JUMP) {
+    target = ins->imm;
+  } else {
+    return -1;
+  }
+  target -= target % 4;
+  target = (target - CODE_BASE) / 4;
+  return (target >= 0 && target < program->code_size) ? target : -1;
+}
+
+/*
+ * Marks the first instruction of every basic block in 'leader'
+ * (one byte per instruction). Blocks end after BZ/BNZ/JUMP/HALT and
+ * start at branch targets. Returns the number of blocks.
+ */
+int
+APEX_find_leaders(const APEX_Program* program, unsigned char* leader)
+{
+  memset(leader, 0, program->code_size);
+  leader[0] = 1;
+  for (int i = 0; i < program->code_size; ++i) {
+    if (!is_control(program->code[i].op)) {
+      continue;
+    }
+    if (i + 1 < program->code_size) {
+      leader[i + 1] = 1;
+    }
+    int target = APEX_branch_target(program, i);
+    if (target >= 0) {
+      leader[target] = 1;
+    }
+  }
+
+  int blocks = 0;
+  for (int i = 0; i < program->code_size; ++i) {
+    blocks += leader[i];
+  }
+  return blocks;
+}
+
+/* Static decode stalls of 'count' instructions issued in order */
+static long long
+window_stalls(const APEX_TimingConfig* config, const APEX_Instruction* code,
+              int count)
+{
+  APEX_IssueState state;
+  long long stalls = 0;
+  APEX_issue_init(&state);
+  for (int i = 0; i < count; ++i) {
+    stalls += APEX_issue(config, &state, &code[i], i, NULL);
+  }
+  return stalls;
+}
+
+/* Dependence edges of one scheduling window */
+typedef struct Window
+{
+  int count;
+  int latency[APEX_SCHED_WINDOW][APEX_SCHED_WINDOW];	// 0 = no edge
+  int distance[APEX_SCHED_WINDOW][APEX_SCHED_WINDOW];	// Positions apart
+  int first[APEX_SCHED_WINDOW];	// Earliest position after what precedes
+  int height[APEX_SCHED_WINDOW];	// Longest latency path to the end
+} Window;
+
+static void
+add_edge(Window* w, int from, int to, int latency)
+{
+  if (from >= 0 && w->latency[from][to] < latency) {
+    w->latency[from][to] = latency;
+  }
+}
+
+/*
+ * Builds register (including the zero flag) and memory dependences.
+ * A true dependence carries the producer latency, anti and output
+ * dependences and memory ordering only need to keep their order.
+ * What cpu.c does not interlock becomes a distance in positions, see
+ * APEX_hazard_distance, also towards the 'num_before' instructions
+ * that run right before the window.
+ */
+static void
+build_window(Window* w, const APEX_TimingConfig* config,
+             const APEX_Instruction* code, int count,
+             const APEX_Instruction* before, int num_before)
+{
+  int writer[APEX_ZERO_FLAG_REG + 1];
+  int last_store = -1;
+
+  memset(w, 0, sizeof(*w));
+  w->count = count;
+  memset(writer, -1, sizeof(writer));
+
+  for (int j = 0; j < count; ++j) {
+    const APEX_Instruction* ins = &code[j];
+    int op_class = APEX_op_info[ins->op].op_class;
+    int srcs[4];
+    int num_srcs = APEX_ins_sources(ins, srcs);
+    int dests[2];
+    int num_dests = 0;
+
+    if (APEX_ins_dest(ins) >= 0) {
+      dests[num_dests++] = APEX_ins_dest(ins);
+    }
+    if (APEX_op_info[ins->op].sets_zero) {
+      dests[num_dests++] = APEX_ZERO_FLAG_REG;
+    }
+
+    for (int s = 0; s < num_srcs; ++s) {
+      int w_idx = writer[srcs[s]];
+      if (w_idx >= 0) {
+        add_edge(w, w_idx, j, APEX_timing_ready(config, code[w_idx].op));
+      }
+    }
+    for (int i = 0; i < j; ++i) {
+      int i_srcs[4];
+      int i_num = APEX_ins_sources(&code[i], i_srcs);
+      for (int d = 0; d < num_dests; ++d) {
+        for (int s = 0; s < i_num; ++s) {
+          if (i_srcs[s] == dests[d]) {
+            add_edge(w, i, j, 1);
+          }
+        }
+      }
+    }
+    for (int d = 0; d < num_dests; ++d) {
+      add_edge(w, writer[dests[d]], j, 1);
+      writer[dests[d]] = j;
+    }
+
+    if (op_class == APEX_CLASS_LOAD) {
+      add_edge(w, last_store, j, 1);
+    } else if (op_class == APEX_CLASS_STORE) {
+      for (int i = 0; i < j; ++i) {
+        int i_class = APEX_op_info[code[i].op].op_class;
+        if (i_class == APEX_CLASS_LOAD || i_class == APEX_CLASS_STORE) {
+          add_edge(w, i, j, 1);
+        }
+      }
+      last_store = j;
+    }
+
+    /* Control flow stays at the end of its block */
+    if (is_control(ins->op)) {
+      for (int i = 0; i < j; ++i) {
+        add_edge(w, i, j, 1);
+      }
+    }
+
+    for (int i = 0; i < j; ++i) {
+      int distance = APEX_hazard_distance(config, &code[i], ins);
+      if (distance > 1) {
+        w->distance[i][j] = distance;
+        add_edge(w, i, j, 1);
+      }
+    }
+    for (int k = 1; k <= num_before; ++k) {
+      int first = APEX_hazard_distance(config, &before[num_before - k], ins)
+                  - k;
+      if (first > w->first[j]) {
+        w->first[j] = first;
+      }
+    }
+  }
+
+  for (int i = count - 1; i >= 0; --i) {
+    for (int j = i + 1; j < count; ++j) {
+      if (w->latency[i][j] && w->height[j] + w->latency[i][j] > w->height[i]) {
+        w->height[i] = w->height[j] + w->latency[i][j];
+      }
+    }
+  }
+}
+
+/*
+ * List schedules one window. Every step picks, among instructions
+ * whose predecessors are placed far enough back, the one that can
+ * leave decode earliest, preferring the longest path to the end of
+ * the window and then the original order. 'order' receives the new
+ * order. Returns 0, or -1 when no instruction fits a position.
+ */
+static int
+list_schedule(const Window* w, int* order)
+{
+  long long issue[APEX_SCHED_WINDOW];
+  int pos[APEX_SCHED_WINDOW];
+  int placed[APEX_SCHED_WINDOW] = { 0 };
+  long long last = -1;
+
+  for (int n = 0; n < w->count; ++n) {
+    int best = -1;
+    long long best_time = 0;
+
+    for (int j = 0; j < w->count; ++j) {
+      if (placed[j] || n < w->first[j]) {
+        continue;
+      }
+      long long earliest = last + 1;
+      int ready = 1;
+      for (int i = 0; i < w->count && ready; ++i) {
+        if (!w->latency[i][j]) {
+          continue;
+        }
+        if (!placed[i] || n - pos[i] < w->distance[i][j]) {
+          ready = 0;
+        } else if (issue[i] + w->latency[i][j] > earliest) {
+          earliest = issue[i] + w->latency[i][j];
+        }
+      }
+      if (!ready) {
+        continue;
+      }
+      if (best < 0 || earliest < best_time ||
+          (earliest == best_time && w->height[j] > w->height[best])) {
+        best = j;
+        best_time = earliest;
+      }
+    }
+    if (best < 0) {
+      return -1;
+    }
+
+    placed[best] = 1;
+    pos[best] = n;
+    issue[best] = best_time;
+    last = best_time;
+    order[n] = best;
+  }
+  return 0;
+}
+
+/*
+ * Whether cpu.c computes what 'count' instructions say when 'code'
+ * replaces instructions [start, start + count) of 'program', looking
+ * at what runs right before and after them as well.
+ */
+static int
+hazard_free(const APEX_Program* program, const APEX_TimingConfig* config,
+            int start, const APEX_Instruction* code, int count)
+{
+  const APEX_Instruction* seq[APEX_SCHED_WINDOW + 2 * APEX_HAZARD_REACH];
+  int n = 0;
+  for (int i = start - APEX_HAZARD_REACH; i < start; ++i) {
+    if (i >= 0) {
+      seq[n++] = &program->code[i];
+    }
+  }
+  for (int i = 0; i < count; ++i) {
+    seq[n++] = &code[i];
+  }
+  for (int i = start + count;
+       i < start + count + APEX_HAZARD_REACH && i < program->code_size; ++i) {
+    seq[n++] = &program->code[i];
+  }
+
+  for (int j = 1; j < n; ++j) {
+    for (int i = j - 1; i >= 0 && j - i < APEX_HAZARD_REACH; --i) {
+      if (j - i < APEX_hazard_distance(config, seq[i], seq[j])) {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+/*
+ * Reorders independent instructions inside basic blocks to hide the
+ * load and ALU latencies of the pipeline. Blocks keep their size and
+ * end with the same control instruction, so branch offsets stay
+ * valid. A window is only rewritten when its static stall count
+ * drops and the pipeline still computes the same results. Windows
+ * holding a JUMP stay as they are, since where it goes is unknown.
+ * Returns 0 on success.
+ */
+int
+APEX_schedule(APEX_Program* program, const APEX_TimingConfig* config,
+              APEX_ScheduleReport* report)
+{
+  memset(report, 0, sizeof(*report));
+  if (program->mapping) {
+    return -1;
+  }
+
+  unsigned char* leader = malloc(program->code_size);
+  Window* w = malloc(sizeof(*w));
+  if (!leader || !w) {
+    free(leader);
+    free(w);
+    return -1;
+  }
+  report->blocks = APEX_find_leaders(program, leader);
+
+  int start = 0;
+  while (start < program->code_size) {
+    /* A window stops at the next leader, after control flow, or full */
+    int end = start + 1;
+    while (end < program->code_size && !leader[end] &&
+           !is_control(program->code[end - 1].op) &&
+           end - start < APEX_SCHED_WINDOW) {
+      end++;
+    }
+
+    APEX_Instruction* code = &program->code[start];
+    int count = end - start;
+    long long before = window_stalls(config, code, count);
+    long long after = before;
+
+    if (before > 0 && count > 2 && code[count - 1].op != APEX_OP_JUMP &&
+        hazard_free(program, config, start, code, count)) {
+      APEX_Instruction scheduled[APEX_SCHED_WINDOW];
+      int order[APEX_SCHED_WINDOW];
+      int num_before = start < APEX_HAZARD_REACH ? start : APEX_HAZARD_REACH;
+      build_window(w, config, code, count, code - num_before, num_before);
+      if (list_schedule(w, order) == 0) {
+        for (int i = 0; i < count; ++i) {
+          scheduled[i] = code[order[i]];
+        }
+        after = window_stalls(config, scheduled, count);
+      }
+      if (after < before &&
+          hazard_free(program, config, start, scheduled, count)) {
+        for (int i = 0; i < count; ++i) {
+          report->moved += (order[i] != i);
+        }
+        memcpy(code, scheduled, sizeof(*code) * count);
+        report->windows_changed++;
+      } else {
+        after = before;
+      }
+    }
+
+    report->stalls_before += before;
+    report->stalls_after += after;
+    start = end;
+  }
+
+  free(leader);
+  free(w);
+  return 0;
+}
+
+/*
+ * Static cycle estimate of every basic block, without running the
+ * pipeline. Blocks are issued in program order, each one falling
+ * through into the next, so registers produced at the end of a block
+ * still stall the start of the next one. A taken branch or JUMP only
+ * shows up as the block's 'penalty', since trip counts are unknown.
+ * 'total' receives the straight line estimate of the whole program,
+ * which matches the simulator for code without taken control flow.
+ * Returns an array of total->blocks entries to be freed by the
+ * caller, or NULL on failure.
+ */
+APEX_BlockEstimate*
+APEX_estimate(const APEX_Program* program, const APEX_TimingConfig* config,
+              APEX_Estimate* total)
+{
+  memset(total, 0, sizeof(*total));
+  if (program->code_size <= 0) {
+    return NULL;
+  }
+
+  unsigned char* leader = malloc(program->code_size);
+  if (!leader) {
+    return NULL;
+  }
+  total->blocks = APEX_find_leaders(program, leader);
+
+  APEX_BlockEstimate* blocks = calloc(total->blocks, sizeof(*blocks));
+  if (!blocks) {
+    free(leader);
+    return NULL;
+  }
+
+  APEX_IssueState state;
+  APEX_issue_init(&state);
+  APEX_BlockEstimate* block = blocks - 1;
+
+  for (int i = 0; i < program->code_size; ++i) {
+    const APEX_Instruction* ins = &program->code[i];
+    if (leader[i]) {
+      block++;
+      block->start = i;
+      block->worst = -1;
+    }
+
+    int producer[APEX_ZERO_FLAG_REG + 1];
+    int stall_reg;
+    long long before = state.cycle;
+    memcpy(producer, state.producer, sizeof(producer));
+
+    int stall = APEX_issue(config, &state, ins, i, &stall_reg);
+    block->count++;
+    block->cycles += state.cycle - before;
+
+    if (stall > 0) {
+      int from = producer[stall_reg];
+      if (stall_reg == APEX_ZERO_FLAG_REG) {
+        block->flag_stalls += stall;
+      } else if (from >= 0 && APEX_op_info[program->code[from].op].op_class ==
+                                APEX_CLASS_LOAD) {
+        block->load_stalls += stall;
+      } else {
+        block->alu_stalls += stall;
+      }
+      if (stall > block->worst_stall) {
+        block->worst = i;
+        block->worst_stall = stall;
+      }
+    }
+
+    if (APEX_op_info[ins->op].op_class == APEX_CLASS_BRANCH) {
+      block->penalty = config->branch_penalty;
+    } else if (ins->op == APEX_OP_JUMP) {
+      block->penalty = config->jump_penalty;
+    }
+  }
+
+  for (int b = 0; b < total->blocks; ++b) {
+    total->cycles += blocks[b].cycles;
+    total->load_stalls += blocks[b].load_stalls;
+    total->alu_stalls += blocks[b].alu_stalls;
+    total->flag_stalls += blocks[b].flag_stalls;
+  }
+  total->stalls = total->load_stalls + total->alu_stalls + total->flag_stalls;
+  /* One cycle to fetch the first instruction, then the drain of HALT */
+  total->cycles += 1 + config->drain;
+
+  free(leader);
+  return blocks;
+}
@@ -0,0 +1,64 @@
+#ifndef _APEX_ANALYSIS_H_
+#define _APEX_ANALYSIS_H_
+/**
+ *  analysis.h
+ *  Static analysis and transformation passes over decoded programs
+ *
+ *  State University of New York, Binghamton
+ */
+#include "cpu.h"
+#include "timing.h"
+
+/* Instructions reordered as one unit by the scheduler at most */
+#define APEX_SCHED_WINDOW 64
+
+/* What the scheduling pass did */
+typedef struct APEX_ScheduleReport
+{
+  int blocks;		// Basic blocks in the program
+  int windows_changed;	// Scheduling windows that were reordered
+  int moved;		// Instructions that changed position
+  long long stalls_before;	// Static decode stall cycles before
+  long long stalls_after;	// and after the pass
+} APEX_ScheduleReport;
+
+/* Static estimate of one basic block, executed once and falling through */
+typedef struct APEX_BlockEstimate
+{
+  int start;		// Index of the first instruction
+  int count;		// Instructions in the block
+  long long cycles;	// Cycles spent leaving decode, stalls included
+  long long load_stalls;	// Stall cycles waiting for LOAD/LDR results
+  long long alu_stalls;	// waiting for ALU results
+  long long flag_stalls;	// BZ/BNZ waiting for the zero flag
+  int penalty;		// Extra bubbles when the last instruction redirects
+  int worst;		// Index of the instruction stalling longest, or -1
+  int worst_stall;	// and its stall cycles
+} APEX_BlockEstimate;
+
+/* Program wide totals of APEX_estimate */
+typedef struct APEX_Estimate
+{
+  int blocks;
+  long long cycles;	// Straight line run of the whole program
+  long long stalls;
+  long long load_stalls;
+  long long alu_stalls;
+  long long flag_stalls;
+} APEX_Estimate;
+
+int
+APEX_branch_target(const APEX_Program* program, int index);
+
+int
+APEX_find_leaders(const APEX_Program* program, unsigned char* leader);
+
+int
+APEX_schedule(APEX_Program* program, const APEX_TimingConfig* config,
+              APEX_ScheduleReport* report);
+
+APEX_BlockEstimate*
+APEX_estimate(const APEX_Program* program, const APEX_TimingConfig* config,
+              APEX_Estimate* total);
+
+#endif
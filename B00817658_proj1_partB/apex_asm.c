@@ -0,0 +1,242 @@
+/*
+ *  apex_asm.c
+ *  APEX assembler driver, turns an assembly file into an .apexbin
+ *  that apex_sim maps directly as code memory, optionally running
+ *  the optimization and scheduling passes on the way, or reports a
+ *  static cycle estimate
+ *
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "analysis.h"
+#include "apexbin.h"
+#include "cpu.h"
+#include "optimize.h"
+
+/* Cycle limit of the --measure runs */
+#define MEASURE_CYCLES 10000000
+
+static void
+usage(const char* prog)
+{
+  fprintf(stderr,
+          "APEX_Help : Usage %s <input_file> [-o <output>] [--peephole] "
+          "[--unroll <n>]\n"
+          "            [--schedule] [--estimate] [--measure]\n"
+          "            output ending in .asm is written as text, anything\n"
+          "            else as .apexbin\n",
+          prog);
+}
+
+/* Prints the per block estimate of 'program' to stdout */
+static void
+print_estimate(const APEX_Program* program, const APEX_TimingConfig* config)
+{
+  APEX_Estimate total;
+  APEX_BlockEstimate* blocks = APEX_estimate(program, config, &total);
+  if (!blocks) {
+    fprintf(stderr, "APEX_Error : Unable to estimate the program\n");
+    return;
+  }
+
+  printf("%-7s %-7s %-6s %-8s %-6s %-6s %-6s %-8s %s\n", "BLOCK", "PC",
+         "INSNS", "CYCLES", "LOAD", "ALU", "FLAG", "PENALTY", "WORST");
+  for (int b = 0; b < total.blocks; ++b) {
+    const APEX_BlockEstimate* block = &blocks[b];
+    char worst[32] = "-";
+    if (block->worst >= 0) {
+      APEX_disassemble(&program->code[block->worst], worst, sizeof(worst));
+    }
+    printf("%-7d %-7d %-6d %-8lld %-6lld %-6lld %-6lld %-8d %s\n", b,
+           4000 + 4 * block->start, block->count, block->cycles,
+           block->load_stalls, block->alu_stalls, block->flag_stalls,
+           block->penalty, worst);
+  }
+  printf("APEX_Estimate : %d blocks, %lld cycles straight line, %lld stall "
+         "cycles (load %lld, alu %lld, flag %lld)\n",
+         total.blocks, total.cycles, total.stalls, total.load_stalls,
+         total.alu_stalls, total.flag_stalls);
+  free(blocks);
+}
+
+/* Runs 'program' on a fresh cpu without output */
+static APEX_CPU*
+simulate(const APEX_Program* program)
+{
+  APEX_CPU* cpu = APEX_cpu_init_program(NULL, program);
+  if (cpu) {
+    strcpy(cpu->input, "quiet");
+    cpu->clk = MEASURE_CYCLES;
+    APEX_cpu_run(cpu);
+  }
+  return cpu;
+}
+
+/*
+ * Simulates the program in 'input' as assembled and 'program' as
+ * transformed, and prints the instruction count and cycle reduction.
+ * Returns 0 when both end in the same state, 1 when they differ and
+ * -1 when they could not run.
+ */
+static int
+print_measure(const char* input, const APEX_Program* program)
+{
+  APEX_Program original;
+  if (APEX_program_load(NULL, input, &original) != 0) {
+    fprintf(stderr, "APEX_Error : Unable to load %s\n", input);
+    return -1;
+  }
+
+  APEX_CPU* before = simulate(&original);
+  APEX_CPU* after = simulate(program);
+  int ret = -1;
+  if (before && after) {
+    int same = memcmp(before->regs, after->regs, sizeof(before->regs)) == 0 &&
+               memcmp(before->data_memory, after->data_memory,
+                      sizeof(before->data_memory)) == 0;
+    double saved = before->clock
+                     ? 100.0 * (before->clock - after->clock) / before->clock
+                     : 0.0;
+    printf("APEX_Measure : instructions %d -> %d, cycles %d -> %d "
+           "(%.1f%% fewer), final state %s\n",
+           original.code_size, program->code_size, before->clock,
+           after->clock, saved, same ? "matches" : "DIFFERS");
+    ret = !same;
+  } else {
+    fprintf(stderr, "APEX_Error : Unable to initialize CPU\n");
+  }
+
+  if (before) {
+    APEX_cpu_stop(before);
+  }
+  if (after) {
+    APEX_cpu_stop(after);
+  }
+  APEX_program_release(&original);
+  return ret;
+}
+
+static int
+ends_with(const char* str, const char* suffix)
+{
+  size_t len = strlen(str);
+  size_t suffix_len = strlen(suffix);
+  return len >= suffix_len && strcmp(str + len - suffix_len, suffix) == 0;
+}
+
+int
+main(int argc, char const* argv[])
+{
+  const char* input = NULL;
+  const char* output = NULL;
+  int schedule = 0;
+  int estimate = 0;
+  int peephole = 0;
+  int unroll = 1;
+  int measure = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      output = argv[++i];
+    } else if (strcmp(argv[i], "--schedule") == 0) {
+      schedule = 1;
+    } else if (strcmp(argv[i], "--estimate") == 0) {
+      estimate = 1;
+    } else if (strcmp(argv[i], "--peephole") == 0) {
+      peephole = 1;
+    } else if (strcmp(argv[i], "--unroll") == 0 && i + 1 < argc) {
+      unroll = atoi(argv[++i]);
+      if (unroll < 1 || unroll > APEX_MAX_UNROLL) {
+        fprintf(stderr, "APEX_Error : Unroll factor must be 1..%d\n",
+                APEX_MAX_UNROLL);
+        exit(1);
+      }
+    } else if (strcmp(argv[i], "--measure") == 0) {
+      measure = 1;
+    } else if (!input && argv[i][0] != '-') {
+      input = argv[i];
+    } else {
+      usage(argv[0]);
+      exit(1);
+    }
+  }
+  if (!input || (!output && !estimate && !measure)) {
+    usage(argv[0]);
+    exit(1);
+  }
+
+  APEX_Program program;
+  if (APEX_program_load(NULL, input, &program) != 0) {
+    fprintf(stderr, "APEX_Error : Unable to load %s\n", input);
+    exit(1);
+  }
+
+  APEX_TimingConfig config;
+  APEX_timing_defaults(&config);
+
+  if (peephole || unroll > 1) {
+    APEX_OptimizeReport report;
+    memset(&report, 0, sizeof(report));
+    if ((peephole && APEX_peephole(&program, &report) != 0) ||
+        APEX_unroll(&program, unroll, &report) != 0) {
+      fprintf(stderr, "APEX_Error : Unable to optimize %s\n", input);
+      APEX_program_release(&program);
+      exit(1);
+    }
+    fprintf(stderr,
+            "APEX_Opt : %d folded, %d removed, %d loops unrolled%s\n",
+            report.folded, report.removed, report.loops,
+            report.pinned ? " (code pinned by JUMP or far branch)" : "");
+  }
+
+  if (schedule) {
+    APEX_ScheduleReport report;
+    if (APEX_schedule(&program, &config, &report) != 0) {
+      fprintf(stderr, "APEX_Error : Unable to schedule %s\n", input);
+      APEX_program_release(&program);
+      exit(1);
+    }
+    fprintf(stderr,
+            "APEX_Sched : %d blocks, %d windows reordered, %d instructions "
+            "moved\n"
+            "APEX_Sched : static stall cycles %lld -> %lld, %lld eliminated\n",
+            report.blocks, report.windows_changed, report.moved,
+            report.stalls_before, report.stalls_after,
+            report.stalls_before - report.stalls_after);
+  }
+
+  if (estimate) {
+    print_estimate(&program, &config);
+  }
+  /* A transformed program that computes something else is not written */
+  if (measure && print_measure(input, &program) != 0) {
+    fflush(stdout);
+    if (output) {
+      fprintf(stderr, "APEX_Error : Not writing %s, the final state of the "
+                      "transformed program differs\n",
+              output);
+    }
+    APEX_program_release(&program);
+    exit(1);
+  }
+  if (!output) {
+    APEX_program_release(&program);
+    return 0;
+  }
+
+  int ret = ends_with(output, ".asm") ? APEX_write_asm(output, &program)
+                                      : APEXBIN_write(output, &program);
+  if (ret != 0) {
+    fprintf(stderr, "APEX_Error : Unable to write %s\n", output);
+    APEX_program_release(&program);
+    exit(1);
+  }
+
+  fprintf(stderr, "APEX_ASM : Wrote %d instructions, %d data words to %s\n",
+          program.code_size, program.data_size, output);
+  APEX_program_release(&program);
+  return 0;
+}
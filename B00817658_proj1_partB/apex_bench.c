@@ -0,0 +1,321 @@
+/*
+ *  apex_bench.c
+ *  Throughput harness, runs a suite of APEX kernels through the
+ *  simulator and reports host speed (simulated cycles and retired
+ *  instructions per second) next to modeled IPC/CPI. Results go to a
+ *  CSV and can be checked against a stored baseline, where a different
+ *  cycle or instruction count is a modeling change and makes the exit
+ *  status 1.
+ *
+ *  Host throughput is reported against the baseline for information
+ *  when the baseline was taken on the same host (the "host" column),
+ *  and not compared otherwise. Only with --tolerance does a drop of
+ *  more than that percentage on the same host fail the run too.
+ *
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cpu.h"
+
+/* Cycle limit of one kernel run, reaching it is an error */
+#define BENCH_CYCLES 50000000
+
+typedef struct BenchResult
+{
+  char name[64];
+  long long cycles;
+  long long instructions;
+  double seconds;		// Fastest of the repeated runs
+} BenchResult;
+
+static double
+now_seconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Kernel name of 'path', the file name without directory and .asm */
+static void
+kernel_name(const char* path, char* name, size_t size)
+{
+  const char* base = strrchr(path, '/');
+  base = base ? base + 1 : path;
+  snprintf(name, size, "%s", base);
+  char* dot = strrchr(name, '.');
+  if (dot && dot != name) {
+    *dot = '\0';
+  }
+}
+
+/*
+ * Loads 'path' once into 'arena' and runs it 'repeat' times on the
+ * same cpu, reset in between. Returns 0 on success.
+ */
+static int
+run_kernel(APEX_Arena* arena, const char* path, int repeat,
+           BenchResult* result)
+{
+  APEX_Program program;
+  if (APEX_program_load(arena, path, &program) != 0) {
+    fprintf(stderr, "APEX_Error : Unable to load %s\n", path);
+    return -1;
+  }
+  APEX_CPU* cpu = APEX_cpu_init_program(arena, &program);
+  if (!cpu) {
+    fprintf(stderr, "APEX_Error : Unable to initialize CPU\n");
+    APEX_program_release(&program);
+    return -1;
+  }
+  strcpy(cpu->input, "quiet");
+  cpu->clk = BENCH_CYCLES;
+
+  kernel_name(path, result->name, sizeof(result->name));
+  result->seconds = 0;
+  int ret = 0;
+  for (int r = 0; r < repeat; ++r) {
+    APEX_cpu_reset(cpu);
+    double start = now_seconds();
+    APEX_cpu_run(cpu);
+    double seconds = now_seconds() - start;
+    if (r == 0 || seconds < result->seconds) {
+      result->seconds = seconds;
+    }
+    if (cpu->clock >= BENCH_CYCLES) {
+      fprintf(stderr, "APEX_Error : %s did not halt in %d cycles\n", path,
+              BENCH_CYCLES);
+      ret = -1;
+      break;
+    }
+  }
+  result->cycles = cpu->clock;
+  result->instructions = cpu->retired;
+
+  APEX_cpu_stop(cpu);
+  APEX_program_release(&program);
+  return ret;
+}
+
+static double
+per_second(long long count, double seconds)
+{
+  return seconds > 0 ? count / seconds : 0.0;
+}
+
+static int
+write_csv(const char* filename, const BenchResult* results, int count,
+          const char* host)
+{
+  FILE* fp = fopen(filename, "w");
+  if (!fp) {
+    return -1;
+  }
+  fprintf(fp, "kernel,cycles,instructions,ipc,cpi,host_seconds,"
+              "cycles_per_second,instructions_per_second,host\n");
+  for (int i = 0; i < count; ++i) {
+    const BenchResult* r = &results[i];
+    fprintf(fp, "%s,%lld,%lld,%.4f,%.4f,%.6f,%.0f,%.0f,%s\n", r->name,
+            r->cycles, r->instructions, (double)r->instructions / r->cycles,
+            (double)r->cycles / r->instructions, r->seconds,
+            per_second(r->cycles, r->seconds),
+            per_second(r->instructions, r->seconds), host);
+  }
+  return fclose(fp) == 0 ? 0 : -1;
+}
+
+/* One row of a baseline CSV written by write_csv */
+typedef struct BaselineRow
+{
+  char name[64];
+  long long cycles;
+  long long instructions;
+  double cycles_per_second;
+  char host[64];		// Empty when the row names none
+} BaselineRow;
+
+/* Reads at most 'max' rows of 'filename', returns the count or -1 */
+static int
+read_baseline(const char* filename, BaselineRow* rows, int max)
+{
+  FILE* fp = fopen(filename, "r");
+  if (!fp) {
+    return -1;
+  }
+  char line[512];
+  int count = 0;
+  while (count < max && fgets(line, sizeof(line), fp)) {
+    BaselineRow* row = &rows[count];
+    double ipc, cpi, seconds, ips;
+    row->host[0] = '\0';
+    if (sscanf(line, "%63[^,],%lld,%lld,%lf,%lf,%lf,%lf,%lf,%63[^,\r\n]",
+               row->name, &row->cycles, &row->instructions, &ipc, &cpi,
+               &seconds, &row->cycles_per_second, &ips, row->host) >= 7) {
+      count++;
+    }
+  }
+  fclose(fp);
+  return count;
+}
+
+/*
+ * Prints how 'results' compare to the baseline, returns regressions.
+ * Throughput only compares with rows taken on 'host', and only counts
+ * as a regression for a 'tolerance' of 0 or more.
+ */
+static int
+compare_baseline(const BenchResult* results, int count,
+                 const BaselineRow* rows, int num_rows, const char* host,
+                 double tolerance)
+{
+  int regressions = 0;
+  for (int i = 0; i < count; ++i) {
+    const BenchResult* r = &results[i];
+    const BaselineRow* row = NULL;
+    for (int j = 0; j < num_rows; ++j) {
+      if (strcmp(rows[j].name, r->name) == 0) {
+        row = &rows[j];
+      }
+    }
+    if (!row) {
+      printf("APEX_Bench : %-16s new, not in the baseline\n", r->name);
+      continue;
+    }
+
+    if (r->cycles != row->cycles || r->instructions != row->instructions) {
+      printf("APEX_Bench : %-16s MODEL CHANGED, cycles %lld -> %lld, "
+             "instructions %lld -> %lld\n",
+             r->name, row->cycles, r->cycles, row->instructions,
+             r->instructions);
+      regressions++;
+      continue;
+    }
+    if (strcmp(row->host, host) != 0 || row->cycles_per_second <= 0) {
+      printf("APEX_Bench : %-16s ok, cycles/s not compared, baseline from "
+             "host '%s'\n",
+             r->name, row->host);
+      continue;
+    }
+
+    double cps = per_second(r->cycles, r->seconds);
+    double change =
+      100.0 * (cps - row->cycles_per_second) / row->cycles_per_second;
+    if (tolerance >= 0 && change < -tolerance) {
+      printf("APEX_Bench : %-16s SLOWER, %.1f%% cycles/s\n", r->name,
+             change);
+      regressions++;
+    } else {
+      printf("APEX_Bench : %-16s ok, %+.1f%% cycles/s\n", r->name, change);
+    }
+  }
+  return regressions;
+}
+
+static void
+usage(const char* prog)
+{
+  fprintf(stderr,
+          "APEX_Help : Usage %s [--repeat <n>] [--csv <file>] "
+          "[--baseline <file>]\n"
+          "            [--tolerance <pct>] <kernel.asm>...\n",
+          prog);
+}
+
+int
+main(int argc, char const* argv[])
+{
+  int repeat = 5;
+  double tolerance = -1.0;
+  const char* csv = NULL;
+  const char* baseline = NULL;
+  int first = argc;
+
+  for (int i = 1; i < argc; ++i) {
+    if (argv[i][0] != '-') {
+      first = i;
+      break;
+    }
+    if (i + 1 >= argc) {
+      usage(argv[0]);
+      exit(1);
+    }
+    if (strcmp(argv[i], "--repeat") == 0) {
+      repeat = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--csv") == 0) {
+      csv = argv[++i];
+    } else if (strcmp(argv[i], "--baseline") == 0) {
+      baseline = argv[++i];
+    } else if (strcmp(argv[i], "--tolerance") == 0) {
+      tolerance = atof(argv[++i]);
+    } else {
+      usage(argv[0]);
+      exit(1);
+    }
+  }
+  int count = argc - first;
+  if (count <= 0 || repeat < 1) {
+    usage(argv[0]);
+    exit(1);
+  }
+
+  BenchResult* results = calloc(count, sizeof(*results));
+  if (!results) {
+    exit(1);
+  }
+  /* Programs and cpus of the whole suite, released together at the end */
+  APEX_Arena arena;
+  APEX_arena_init(&arena, 0);
+
+  printf("%-16s %10s %10s %7s %7s %12s %12s\n", "KERNEL", "CYCLES", "INSNS",
+         "IPC", "CPI", "KCYCLES/S", "KINSNS/S");
+  int failed = 0;
+  for (int i = 0; i < count; ++i) {
+    BenchResult* r = &results[i];
+    if (run_kernel(&arena, argv[first + i], repeat, r) != 0) {
+      failed = 1;
+      continue;
+    }
+    printf("%-16s %10lld %10lld %7.3f %7.3f %12.1f %12.1f\n", r->name,
+           r->cycles, r->instructions, (double)r->instructions / r->cycles,
+           (double)r->cycles / r->instructions,
+           per_second(r->cycles, r->seconds) / 1000,
+           per_second(r->instructions, r->seconds) / 1000);
+  }
+  APEX_arena_release(&arena);
+  if (failed) {
+    free(results);
+    exit(1);
+  }
+
+  char host[64] = "";
+  if (gethostname(host, sizeof(host) - 1) != 0) {
+    strcpy(host, "unknown");
+  }
+  /* The CSV has no quoting */
+  host[strcspn(host, ",\r\n")] = '\0';
+
+  if (csv && write_csv(csv, results, count, host) != 0) {
+    fprintf(stderr, "APEX_Error : Unable to write %s\n", csv);
+    failed = 1;
+  }
+
+  if (baseline) {
+    BaselineRow rows[64];
+    int num_rows = read_baseline(baseline, rows, 64);
+    if (num_rows < 0) {
+      fprintf(stderr, "APEX_Error : Unable to read %s\n", baseline);
+      failed = 1;
+    } else if (compare_baseline(results, count, rows, num_rows, host,
+                                tolerance)) {
+      failed = 1;
+    }
+  }
+
+  free(results);
+  return failed;
+}
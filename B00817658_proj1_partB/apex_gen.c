@@ -0,0 +1,497 @@
+/*
+ *  apex_gen.c
+ *  Synthetic workload generator, writes APEX assembly programs with a
+ *  chosen size, instruction mix, dependency distance, branch behavior
+ *  and memory footprint to stress the loader and the simulator
+ *
+ *  Register use of the generated code:
+ *    R0 - R12   general registers, sources and destinations
+ *    R13        data base address, always 0
+ *    R14        loop counter
+ *    R15        constant 1, the loop decrement (SUBL does not set the
+ *               zero flag, so loops count down with SUB)
+ *
+ *  Every instruction is checked against the last ones written with
+ *  APEX_hazard_distance and picked again when cpu.c would not compute
+ *  what it says, so the programs run the same on the pipeline and the
+ *  functional engine (apex_sim --check).
+ *
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "timing.h"
+
+#define REG_BASE 13
+#define REG_COUNT 14
+#define REG_ONE 15
+#define NUM_GENERAL 13
+
+/* Destinations remembered for the dependency distance */
+#define HISTORY 64
+
+/* Picks of a straight instruction before falling back to a MOVC */
+#define ATTEMPTS 16
+
+/* Straight instructions in front of the final HALT. A HALT decoded
+ * right behind a taken branch stops fetch for good in cpu.c */
+#define TAIL 4
+
+enum
+{
+  MIX_ALU,
+  MIX_MUL,
+  MIX_LOAD,
+  MIX_STORE,
+  MIX_MOVC,
+  MIX_KINDS
+};
+
+static const char* mix_names[MIX_KINDS] = { "alu", "mul", "load", "store",
+                                            "movc" };
+
+typedef struct GenConfig
+{
+  long long count;		// Instructions, HALT included
+  unsigned long long seed;
+  int mix[MIX_KINDS];		// Relative weights
+  int dist;			// Mean dependency distance, 0 for random
+  int loops;			// Chance in percent that a block is a loop
+  int body;			// Instructions in a loop body
+  int trip;			// Iterations of every loop
+  int forward;			// Chance in percent of a forward branch
+  int footprint;		// Data words loads and stores touch
+  int init;			// Emit a .data image of the footprint
+} GenConfig;
+
+typedef struct Generator
+{
+  const GenConfig* config;
+  FILE* out;
+  unsigned long long state;
+  int history[HISTORY];
+  long long produced;		// Destinations written so far
+  long long emitted;		// Instructions written so far
+  APEX_TimingConfig timing;
+  APEX_Instruction recent[APEX_HAZARD_REACH];	// Last written, newest first
+} Generator;
+
+/* xorshift64*, the same stream on every host for a given seed */
+static unsigned int
+next_random(Generator* gen)
+{
+  gen->state ^= gen->state >> 12;
+  gen->state ^= gen->state << 25;
+  gen->state ^= gen->state >> 27;
+  return (unsigned int)((gen->state * 2685821657736338717ULL) >> 32);
+}
+
+static int
+random_below(Generator* gen, int bound)
+{
+  return bound > 0 ? (int)(next_random(gen) % (unsigned int)bound) : 0;
+}
+
+/*
+ * A source register written 'dist' instructions back on average
+ * (uniform over 1 .. 2 * dist - 1), or any general register
+ */
+static int
+pick_source(Generator* gen)
+{
+  int dist = gen->config->dist;
+  if (dist <= 0 || gen->produced == 0) {
+    return random_below(gen, NUM_GENERAL);
+  }
+  int back = 1 + random_below(gen, 2 * dist - 1);
+  if (back > gen->produced) {
+    back = (int)gen->produced;
+  }
+  if (back > HISTORY) {
+    back = HISTORY;
+  }
+  return gen->history[(gen->produced - back) % HISTORY];
+}
+
+static void
+make_ins(APEX_Instruction* ins, int op, int rd, int rs1, int rs2, int imm)
+{
+  memset(ins, 0, sizeof(*ins));
+  strcpy(ins->opcode, APEX_op_info[op].name);
+  ins->op = op;
+  ins->rd = rd;
+  ins->rs1 = rs1;
+  ins->rs2 = rs2;
+  ins->imm = imm;
+}
+
+/* Whether 'ins' may follow the instructions written so far */
+static int
+is_safe(const Generator* gen, const APEX_Instruction* ins)
+{
+  for (int k = 0; k < APEX_HAZARD_REACH; ++k) {
+    if (APEX_hazard_distance(&gen->timing, &gen->recent[k], ins) > k + 1) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* Writes 'ins', a general destination counts for the dependency distance */
+static void
+put(Generator* gen, const APEX_Instruction* ins)
+{
+  char text[64];
+  APEX_disassemble(ins, text, sizeof(text));
+  fprintf(gen->out, "%s\n", text);
+
+  int rd = APEX_ins_dest(ins);
+  if (rd >= 0 && rd < NUM_GENERAL) {
+    gen->history[gen->produced % HISTORY] = rd;
+    gen->produced++;
+  }
+  memmove(&gen->recent[1], &gen->recent[0],
+          sizeof(gen->recent) - sizeof(gen->recent[0]));
+  gen->recent[0] = *ins;
+  gen->emitted++;
+}
+
+static int
+pick_kind(Generator* gen)
+{
+  int total = 0;
+  for (int k = 0; k < MIX_KINDS; ++k) {
+    total += gen->config->mix[k];
+  }
+  int pick = random_below(gen, total);
+  for (int k = 0; k < MIX_KINDS; ++k) {
+    if (pick < gen->config->mix[k]) {
+      return k;
+    }
+    pick -= gen->config->mix[k];
+  }
+  return MIX_ALU;
+}
+
+/* One instruction of the mix without control flow, never writing R13 - R15 */
+static void
+pick_straight(Generator* gen, APEX_Instruction* ins)
+{
+  static const int alu_ops[] = { APEX_OP_ADD, APEX_OP_SUB,  APEX_OP_AND,
+                                 APEX_OP_OR,  APEX_OP_XOR,  APEX_OP_ADDL,
+                                 APEX_OP_SUBL };
+  int footprint = gen->config->footprint;
+
+  switch (pick_kind(gen)) {
+    case MIX_ALU: {
+      int choice = random_below(gen, 7);
+      int rs1 = pick_source(gen);
+      if (choice < 5) {
+        int rs2 = pick_source(gen);
+        make_ins(ins, alu_ops[choice], random_below(gen, NUM_GENERAL), rs1,
+                 rs2, 0);
+      } else {
+        int imm = random_below(gen, 16);
+        make_ins(ins, alu_ops[choice], random_below(gen, NUM_GENERAL), rs1, 0,
+                 imm);
+      }
+      break;
+    }
+    case MIX_MUL: {
+      int rs1 = pick_source(gen);
+      int rs2 = pick_source(gen);
+      make_ins(ins, APEX_OP_MUL, random_below(gen, NUM_GENERAL), rs1, rs2, 0);
+      break;
+    }
+    case MIX_LOAD: {
+      int imm = random_below(gen, footprint);
+      make_ins(ins, APEX_OP_LOAD, random_below(gen, NUM_GENERAL), REG_BASE, 0,
+               imm);
+      break;
+    }
+    case MIX_STORE: {
+      int imm = random_below(gen, footprint);
+      make_ins(ins, APEX_OP_STORE, 0, pick_source(gen), REG_BASE, imm);
+      break;
+    }
+    default: {
+      int imm = random_below(gen, 256);
+      make_ins(ins, APEX_OP_MOVC, random_below(gen, NUM_GENERAL), 0, 0, imm);
+      break;
+    }
+  }
+}
+
+/*
+ * Writes a safe instruction of the mix. When the picks keep failing,
+ * a MOVC, which only a LOAD right in front can conflict with, takes
+ * the slot
+ */
+static void
+emit_straight(Generator* gen)
+{
+  APEX_Instruction ins;
+  for (int i = 0; i < ATTEMPTS; ++i) {
+    pick_straight(gen, &ins);
+    if (is_safe(gen, &ins)) {
+      put(gen, &ins);
+      return;
+    }
+  }
+  int rd = random_below(gen, NUM_GENERAL);
+  do {
+    make_ins(&ins, APEX_OP_MOVC, rd, 0, 0, random_below(gen, 256));
+    rd = (rd + 1) % NUM_GENERAL;
+  } while (!is_safe(gen, &ins));
+  put(gen, &ins);
+}
+
+/*
+ * Counted loop of 'body' straight instructions, 'body' + 3 in total:
+ *   MOVC,R14,#trip / body / SUB,R14,R14,R15 / BNZ back to the body
+ */
+static void
+emit_loop(Generator* gen, int body)
+{
+  APEX_Instruction ins;
+  make_ins(&ins, APEX_OP_MOVC, REG_COUNT, 0, 0, gen->config->trip);
+  put(gen, &ins);
+  for (int i = 0; i < body; ++i) {
+    emit_straight(gen);
+  }
+  make_ins(&ins, APEX_OP_SUB, REG_COUNT, REG_COUNT, REG_ONE, 0);
+  put(gen, &ins);
+  make_ins(&ins, APEX_OP_BNZ, 0, 0, 0, -4 * (body + 1));
+  put(gen, &ins);
+}
+
+/*
+ * ALU instruction setting the zero flag from data, then a BZ/BNZ
+ * over 1 - 4 straight instructions, taken depending on the values.
+ * Operands the pipeline would get wrong are picked again, R13 is
+ * never a wrong source
+ */
+static void
+emit_forward(Generator* gen, int skip)
+{
+  APEX_Instruction ins;
+  int i = 0;
+  do {
+    int rs1 = i < ATTEMPTS ? pick_source(gen) : REG_BASE;
+    int rs2 = i < ATTEMPTS ? pick_source(gen) : REG_BASE;
+    make_ins(&ins, APEX_OP_SUB, random_below(gen, NUM_GENERAL), rs1, rs2, 0);
+    i++;
+  } while (!is_safe(gen, &ins));
+  put(gen, &ins);
+  make_ins(&ins, random_below(gen, 2) ? APEX_OP_BZ : APEX_OP_BNZ, 0, 0, 0,
+           4 * (skip + 1));
+  put(gen, &ins);
+  for (i = 0; i < skip; ++i) {
+    emit_straight(gen);
+  }
+}
+
+/* Whether a BZ/BNZ is close enough behind to clear a new zero flag */
+static int
+branch_behind(const Generator* gen)
+{
+  for (int k = 0; k + 1 < WB - EX2; ++k) {
+    if (APEX_op_info[gen->recent[k].op].op_class == APEX_CLASS_BRANCH) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void
+generate(Generator* gen)
+{
+  const GenConfig* config = gen->config;
+  FILE* out = gen->out;
+
+  if (config->init) {
+    fprintf(out, ".data\n");
+    for (int i = 0; i < config->footprint; ++i) {
+      fprintf(out, "%s%d", i % 16 ? "," : ".word ", random_below(gen, 1000));
+      if (i % 16 == 15 || i + 1 == config->footprint) {
+        fprintf(out, "\n");
+      }
+    }
+    fprintf(out, ".text\n");
+  }
+
+  long long body_end = config->count - 1;
+  long long tail = body_end < TAIL ? body_end : TAIL;
+  body_end -= tail;
+
+  if (body_end >= 3) {
+    APEX_Instruction ins;
+    make_ins(&ins, APEX_OP_MOVC, REG_BASE, 0, 0, 0);
+    put(gen, &ins);
+    make_ins(&ins, APEX_OP_MOVC, REG_ONE, 0, 0, 1);
+    put(gen, &ins);
+  }
+
+  while (gen->emitted < body_end) {
+    long long left = body_end - gen->emitted;
+    if (left >= config->body + 3 && random_below(gen, 100) < config->loops) {
+      emit_loop(gen, config->body);
+    } else if (left >= 3 && !branch_behind(gen) &&
+               random_below(gen, 100) < config->forward) {
+      int skip = 1 + random_below(gen, 4);
+      emit_forward(gen, skip < left - 2 ? skip : (int)(left - 2));
+    } else {
+      emit_straight(gen);
+    }
+  }
+  for (long long i = 0; i < tail; ++i) {
+    emit_straight(gen);
+  }
+  APEX_Instruction halt;
+  make_ins(&halt, APEX_OP_HALT, 0, 0, 0, 0);
+  put(gen, &halt);
+}
+
+/* Parses "alu=60,load=20,..." into 'mix', kinds left out get 0 */
+static int
+parse_mix(const char* text, int* mix)
+{
+  memset(mix, 0, sizeof(int) * MIX_KINDS);
+  while (*text) {
+    const char* eq = strchr(text, '=');
+    if (!eq) {
+      return -1;
+    }
+    int kind = -1;
+    for (int k = 0; k < MIX_KINDS; ++k) {
+      if (strlen(mix_names[k]) == (size_t)(eq - text) &&
+          strncmp(text, mix_names[k], eq - text) == 0) {
+        kind = k;
+      }
+    }
+    if (kind < 0) {
+      return -1;
+    }
+    mix[kind] = atoi(eq + 1);
+    if (mix[kind] < 0) {
+      return -1;
+    }
+    const char* comma = strchr(eq, ',');
+    text = comma ? comma + 1 : eq + strlen(eq);
+  }
+
+  int total = 0;
+  for (int k = 0; k < MIX_KINDS; ++k) {
+    total += mix[k];
+  }
+  return total > 0 ? 0 : -1;
+}
+
+static void
+usage(const char* prog)
+{
+  fprintf(stderr,
+          "APEX_Help : Usage %s -n <instructions> [-o <output>] [options]\n"
+          "            --seed <n>         random seed (1)\n"
+          "            --mix <k=w,...>    weights of alu, mul, load, store,\n"
+          "                               movc (alu=50,mul=5,load=20,"
+          "store=15,movc=10)\n"
+          "            --dist <n>         mean dependency distance, 0 for\n"
+          "                               random sources (4)\n"
+          "            --loops <pct>      chance a block is a loop (10)\n"
+          "            --body <n>         loop body instructions (8)\n"
+          "            --trip <n>         loop iterations (10)\n"
+          "            --forward <pct>    chance of a forward branch (0)\n"
+          "            --footprint <n>    data words touched (256)\n"
+          "            --init             emit initialized .data\n",
+          prog);
+}
+
+int
+main(int argc, char const* argv[])
+{
+  GenConfig config;
+  const char* output = NULL;
+
+  memset(&config, 0, sizeof(config));
+  config.count = -1;
+  config.seed = 1;
+  parse_mix("alu=50,mul=5,load=20,store=15,movc=10", config.mix);
+  config.dist = 4;
+  config.loops = 10;
+  config.body = 8;
+  config.trip = 10;
+  config.footprint = 256;
+
+  for (int i = 1; i < argc; ++i) {
+    const char* arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+    if (strcmp(arg, "--init") == 0) {
+      config.init = 1;
+      continue;
+    }
+    if (!value) {
+      usage(argv[0]);
+      exit(1);
+    }
+    if (strcmp(arg, "-n") == 0) {
+      config.count = atoll(value);
+    } else if (strcmp(arg, "-o") == 0) {
+      output = value;
+    } else if (strcmp(arg, "--seed") == 0) {
+      config.seed = strtoull(value, NULL, 0);
+    } else if (strcmp(arg, "--mix") == 0) {
+      if (parse_mix(value, config.mix) != 0) {
+        fprintf(stderr, "APEX_Error : Bad instruction mix %s\n", value);
+        exit(1);
+      }
+    } else if (strcmp(arg, "--dist") == 0) {
+      config.dist = atoi(value);
+    } else if (strcmp(arg, "--loops") == 0) {
+      config.loops = atoi(value);
+    } else if (strcmp(arg, "--body") == 0) {
+      config.body = atoi(value);
+    } else if (strcmp(arg, "--trip") == 0) {
+      config.trip = atoi(value);
+    } else if (strcmp(arg, "--forward") == 0) {
+      config.forward = atoi(value);
+    } else if (strcmp(arg, "--footprint") == 0) {
+      config.footprint = atoi(value);
+    } else {
+      usage(argv[0]);
+      exit(1);
+    }
+    i++;
+  }
+
+  if (config.count < 1 || config.dist < 0 || config.body < 1 ||
+      config.trip < 1 || config.footprint < 1 ||
+      config.footprint > DATA_MEMORY_SIZE) {
+    usage(argv[0]);
+    exit(1);
+  }
+
+  FILE* out = output ? fopen(output, "w") : stdout;
+  if (!out) {
+    fprintf(stderr, "APEX_Error : Unable to open %s\n", output);
+    exit(1);
+  }
+  setvbuf(out, NULL, _IOFBF, 1 << 20);
+
+  Generator gen;
+  memset(&gen, 0, sizeof(gen));
+  gen.config = &config;
+  gen.out = out;
+  gen.state = config.seed ? config.seed : 0x9e3779b97f4a7c15ULL;
+  APEX_timing_defaults(&gen.timing);
+  generate(&gen);
+
+  if (fclose(out) != 0) {
+    fprintf(stderr, "APEX_Error : Unable to write %s\n", output);
+    exit(1);
+  }
+  return 0;
+}
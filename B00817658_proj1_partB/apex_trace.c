@@ -0,0 +1,430 @@
+/*
+ *  apex_trace.c
+ *  Offline analyzer of the binary traces "apex_sim ... --record" writes.
+ *  Replays the retired instruction stream once and reports the
+ *  instruction mix, branch behaviour, memory footprint and hottest
+ *  instructions, then drives the in-order issue model of timing.c with
+ *  the recorded control flow and compares its cycles with the run.
+ *
+ *  With --replay or --sweep the stream is kept in memory and timed by
+ *  the stage level replay model of timing.c instead, once per setting
+ *  of its parameters (--set name=value, --sweep name=first:last), so
+ *  pipeline and cache variants are compared without simulating again.
+ *
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "isa.h"
+#include "timing.h"
+#include "trace.h"
+
+/* Hottest instructions listed by default */
+#define DEFAULT_TOP 10
+
+/* Buckets of the retirement gap histogram, the last one collects the rest */
+#define GAP_BUCKETS 6
+
+typedef struct TraceSummary
+{
+  long long retired;
+  long long first_cycle;
+  long long last_cycle;
+  long long ops[APEX_NUM_OPS];
+  long long* count;		// Retirements per code index
+  long long gaps[GAP_BUCKETS];	// Cycles between retirements, 1.. and more
+  long long branches;		// BZ/BNZ retired
+  long long taken;		// of which the next instruction was not in sequence
+  long long loads;
+  long long stores;
+  long long outside;		// Accesses outside data memory
+  int lowest;			// Lowest and highest address accessed
+  int highest;
+  unsigned char touched[DATA_MEMORY_SIZE];
+  int words;			// Distinct data words accessed
+  int regs[32];			// Last result per register
+  int written[32];
+  long long model_stalls;	// Decode stalls of the issue model
+  long long model_cycles;
+
+  /* The stream itself, kept when 'keep_stream' is set */
+  int keep_stream;
+  APEX_ReplayOp* stream;
+  long long stream_capacity;
+} TraceSummary;
+
+static void
+usage(const char* prog)
+{
+  fprintf(stderr,
+          "APEX_Help : Usage %s <trace_file> [--top <n>] [--regs]\n"
+          "            [--replay] [--set <name>=<value>]... "
+          "[--sweep <name>=<first>:<last>]\n"
+          "            reads a trace written by apex_sim --record\n",
+          prog);
+}
+
+/* Replays the whole trace into 'sum'. Returns 0, -1 on a corrupt trace */
+static int
+summarize(APEX_TraceReader* reader, TraceSummary* sum)
+{
+  APEX_TimingConfig config;
+  APEX_IssueState state;
+  APEX_timing_defaults(&config);
+  APEX_issue_init(&state);
+
+  APEX_TraceEvent event;
+  int prev_index = -1;
+  int prev_op = APEX_OP_UNKNOWN;
+  long long prev_cycle = 0;
+  int ret;
+  while ((ret = APEX_trace_read(reader, &event)) == 1) {
+    const APEX_Instruction* ins = event.ins;
+    const APEX_OpInfo* info = &APEX_op_info[ins->op];
+
+    if (sum->retired == 0) {
+      sum->first_cycle = event.cycle;
+    } else {
+      long long gap = event.cycle - prev_cycle;
+      sum->gaps[gap < GAP_BUCKETS ? gap - 1 : GAP_BUCKETS - 1]++;
+    }
+    sum->retired++;
+    sum->last_cycle = event.cycle;
+    sum->ops[ins->op]++;
+    sum->count[event.index]++;
+
+    /* A taken BZ/BNZ shows as a jump in the retired code index. JUMP
+     * does not squash, the slots it loses retire as wrong path
+     * instructions and are part of the trace already */
+    if (prev_index >= 0 && event.index != prev_index + 1 &&
+        APEX_op_info[prev_op].op_class == APEX_CLASS_BRANCH) {
+      sum->taken++;
+      state.cycle += config.branch_penalty;
+    }
+    if (info->op_class == APEX_CLASS_BRANCH) {
+      sum->branches++;
+    }
+
+    if (info->op_class == APEX_CLASS_LOAD || info->op_class == APEX_CLASS_STORE) {
+      if (info->op_class == APEX_CLASS_LOAD) {
+        sum->loads++;
+      } else {
+        sum->stores++;
+      }
+      if (event.address < 0 || event.address >= DATA_MEMORY_SIZE) {
+        sum->outside++;
+      } else {
+        if (!sum->touched[event.address]) {
+          sum->touched[event.address] = 1;
+          sum->words++;
+        }
+        if (sum->loads + sum->stores - sum->outside == 1) {
+          sum->lowest = sum->highest = event.address;
+        } else if (event.address < sum->lowest) {
+          sum->lowest = event.address;
+        } else if (event.address > sum->highest) {
+          sum->highest = event.address;
+        }
+      }
+    }
+    if (info->writes_rd && ins->rd >= 0 && ins->rd < 32) {
+      sum->regs[ins->rd] = event.value;
+      sum->written[ins->rd] = 1;
+    }
+
+    sum->model_stalls += APEX_issue(&config, &state, ins, event.index, NULL);
+
+    if (sum->keep_stream) {
+      if (sum->retired > sum->stream_capacity) {
+        long long capacity = sum->stream_capacity ? 2 * sum->stream_capacity
+                                                  : 4096;
+        APEX_ReplayOp* stream =
+          realloc(sum->stream, sizeof(*stream) * capacity);
+        if (!stream) {
+          return -1;
+        }
+        sum->stream = stream;
+        sum->stream_capacity = capacity;
+      }
+      APEX_ReplayOp* op = &sum->stream[sum->retired - 1];
+      op->index = event.index;
+      op->address = event.address;
+      op->value = event.value;
+      op->redirect = 0;
+      if (sum->retired > 1 && event.index != prev_index + 1) {
+        op[-1].redirect = 1;
+      }
+    }
+
+    prev_index = event.index;
+    prev_op = ins->op;
+    prev_cycle = event.cycle;
+  }
+  /* Fetch of the first instruction, then the drain of HALT, as in
+   * APEX_estimate */
+  sum->model_cycles = state.cycle + 1 + 1 + config.drain;
+  return ret;
+}
+
+/* Retirements compare_count sorts by */
+static const long long* sort_count;
+
+static int
+compare_count(const void* a, const void* b)
+{
+  long long x = sort_count[*(const int*)a];
+  long long y = sort_count[*(const int*)b];
+  if (x != y) {
+    return x < y ? 1 : -1;
+  }
+  return *(const int*)a - *(const int*)b;
+}
+
+static void
+print_summary(const APEX_Program* program, const TraceSummary* sum, int top,
+              int show_regs)
+{
+  long long cycles = sum->retired ? sum->last_cycle + 1 : 0;
+  printf("APEX_Trace : %lld instructions retired in %lld cycles", sum->retired,
+         cycles);
+  if (cycles > 0) {
+    printf(", IPC %.3f, CPI %.3f", (double)sum->retired / cycles,
+           sum->retired ? (double)cycles / sum->retired : 0.0);
+  }
+  printf("\n\n");
+
+  printf("%-8s %12s %8s\n", "OPCODE", "RETIRED", "SHARE");
+  for (int op = 1; op < APEX_NUM_OPS; ++op) {
+    if (sum->ops[op]) {
+      printf("%-8s %12lld %7.2f%%\n", APEX_op_info[op].name, sum->ops[op],
+             100.0 * sum->ops[op] / sum->retired);
+    }
+  }
+
+  printf("\n%-8s %12s %8s\n", "GAP", "RETIRED", "SHARE");
+  for (int i = 0; i < GAP_BUCKETS; ++i) {
+    char label[16];
+    snprintf(label, sizeof(label), i < GAP_BUCKETS - 1 ? "%d" : "%d+", i + 1);
+    printf("%-8s %12lld %7.2f%%\n", label, sum->gaps[i],
+           sum->retired > 1 ? 100.0 * sum->gaps[i] / (sum->retired - 1) : 0.0);
+  }
+
+  printf("\nAPEX_Trace : %lld branches, %lld taken (%.1f%%)\n", sum->branches,
+         sum->taken,
+         sum->branches ? 100.0 * sum->taken / sum->branches : 0.0);
+  printf("APEX_Trace : %lld loads, %lld stores, %d distinct words", sum->loads,
+         sum->stores, sum->words);
+  if (sum->words) {
+    printf(" in [%d, %d]", sum->lowest, sum->highest);
+  }
+  if (sum->outside) {
+    printf(", %lld outside data memory", sum->outside);
+  }
+  printf("\n");
+
+  /* Hottest instructions */
+  int* order = malloc(sizeof(int) * (program->code_size ? program->code_size : 1));
+  if (order) {
+    for (int i = 0; i < program->code_size; ++i) {
+      order[i] = i;
+    }
+    sort_count = sum->count;
+    qsort(order, program->code_size, sizeof(int), compare_count);
+    printf("\n%-7s %12s %8s  %s\n", "PC", "RETIRED", "SHARE", "INSTRUCTION");
+    for (int i = 0; i < top && i < program->code_size && sum->count[order[i]];
+         ++i) {
+      char text[64];
+      APEX_disassemble(&program->code[order[i]], text, sizeof(text));
+      printf("%-7d %12lld %7.2f%%  %s\n", 4000 + 4 * order[i],
+             sum->count[order[i]], 100.0 * sum->count[order[i]] / sum->retired,
+             text);
+    }
+    free(order);
+  }
+
+  printf("\nAPEX_Trace : issue model %lld cycles (%lld decode stalls), "
+         "recorded %lld",
+         sum->model_cycles, sum->model_stalls, cycles);
+  if (cycles > 0) {
+    printf(", %+.1f%%", 100.0 * (sum->model_cycles - cycles) / cycles);
+  }
+  printf("\n");
+
+  if (show_regs) {
+    printf("\n");
+    for (int i = 0; i < 32; ++i) {
+      if (sum->written[i]) {
+        printf("|     REG[%02d]     |    VALUE = %-5d|\n", i, sum->regs[i]);
+      }
+    }
+  }
+}
+
+/* Times the kept stream with 'config', prints one line or a table row */
+static int
+replay(const APEX_Program* program, const TraceSummary* sum,
+       const APEX_TimingConfig* config, const char* label)
+{
+  APEX_ReplayResult result;
+  if (APEX_replay(config, program, sum->stream, sum->retired, &result) != 0) {
+    fprintf(stderr, "APEX_Error : Unable to allocate the cache model\n");
+    return -1;
+  }
+  long long recorded = sum->retired ? sum->last_cycle + 1 : 0;
+  double error =
+    recorded ? 100.0 * (result.cycles - recorded) / recorded : 0.0;
+  long long accesses = result.hits + result.misses;
+  double miss_rate = accesses ? 100.0 * result.misses / accesses : 0.0;
+  double cpi = result.instructions
+                 ? (double)result.cycles / result.instructions
+                 : 0.0;
+
+  if (label) {
+    printf("%-20s %12lld %7.3f %12lld %12lld %12lld %7.2f%% %+8.1f%%\n", label,
+           result.cycles, cpi, result.decode_stalls, result.flush_cycles,
+           result.memory_stalls, miss_rate, error);
+    return 0;
+  }
+  printf("APEX_Replay : %lld instructions in %lld cycles, CPI %.3f\n",
+         result.instructions, result.cycles, cpi);
+  printf("APEX_Replay : %lld decode stall cycles, %lld fetch cycles lost to "
+         "redirects, %lld memory stall cycles\n",
+         result.decode_stalls, result.flush_cycles, result.memory_stalls);
+  if (result.extrapolated) {
+    printf("APEX_Replay : %lld instructions timed from steady loop "
+           "iterations\n",
+           result.extrapolated);
+  }
+  if (config->cache_lines > 0) {
+    printf("APEX_Replay : cache of %d lines x %d words, %lld hits, %lld "
+           "misses (%.2f%%)\n",
+           config->cache_lines, config->line_words, result.hits,
+           result.misses, miss_rate);
+  }
+  printf("APEX_Replay : recorded %lld cycles, %+.1f%%\n", recorded, error);
+  return 0;
+}
+
+/* Splits "name=value" into 'name' and the text after '=' */
+static const char*
+split_setting(const char* setting, char* name, size_t size)
+{
+  const char* eq = strchr(setting, '=');
+  if (!eq || (size_t)(eq - setting) >= size) {
+    return NULL;
+  }
+  memcpy(name, setting, eq - setting);
+  name[eq - setting] = '\0';
+  return eq + 1;
+}
+
+int
+main(int argc, char const* argv[])
+{
+  const char* path = NULL;
+  int top = DEFAULT_TOP;
+  int show_regs = 0;
+  int replay_once = 0;
+  const char* sweep = NULL;
+  APEX_TimingConfig config;
+  APEX_timing_defaults(&config);
+  for (int i = 1; i < argc; ++i) {
+    char name[32];
+    const char* value;
+    if (strcmp(argv[i], "--top") == 0 && i + 1 < argc) {
+      top = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--regs") == 0) {
+      show_regs = 1;
+    } else if (strcmp(argv[i], "--replay") == 0) {
+      replay_once = 1;
+    } else if (strcmp(argv[i], "--set") == 0 && i + 1 < argc) {
+      value = split_setting(argv[++i], name, sizeof(name));
+      if (!value || APEX_timing_set(&config, name, atoi(value)) != 0) {
+        fprintf(stderr, "APEX_Error : Bad timing parameter %s\n", argv[i]);
+        return 1;
+      }
+      replay_once = 1;
+    } else if (strcmp(argv[i], "--sweep") == 0 && i + 1 < argc) {
+      sweep = argv[++i];
+    } else if (!path && argv[i][0] != '-') {
+      path = argv[i];
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (!path) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  FILE* in = fopen(path, "rb");
+  if (!in) {
+    fprintf(stderr, "APEX_Error : Unable to open %s\n", path);
+    return 1;
+  }
+  APEX_TraceReader reader;
+  if (APEX_trace_reader_open(&reader, in) != 0) {
+    fprintf(stderr, "APEX_Error : %s is no APEX trace\n", path);
+    fclose(in);
+    return 1;
+  }
+
+  TraceSummary* sum = calloc(1, sizeof(*sum));
+  long long* count =
+    calloc(reader.program.code_size ? reader.program.code_size : 1,
+           sizeof(long long));
+  if (!sum || !count) {
+    fprintf(stderr, "APEX_Error : Unable to allocate the summary\n");
+    return 1;
+  }
+  sum->count = count;
+  sum->keep_stream = replay_once || sweep;
+
+  int status = 0;
+  if (summarize(&reader, sum) != 0) {
+    fprintf(stderr, "APEX_Error : %s is cut short after %lld instructions\n",
+            path, sum->retired);
+    status = 1;
+  }
+
+  if (sweep) {
+    char name[32];
+    int first, last;
+    const char* range = split_setting(sweep, name, sizeof(name));
+    if (!range || sscanf(range, "%d:%d", &first, &last) != 2 ||
+        APEX_timing_set(&config, name, first) != 0) {
+      fprintf(stderr, "APEX_Error : Bad sweep %s\n", sweep);
+      return 1;
+    }
+    printf("%-20s %12s %7s %12s %12s %12s %8s %9s\n", "SETTING", "CYCLES",
+           "CPI", "DECODE", "FLUSH", "MEMORY", "MISSES", "RECORDED");
+    for (int v = first; v <= last; ++v) {
+      char label[64];
+      if (APEX_timing_set(&config, name, v) != 0) {
+        continue;
+      }
+      snprintf(label, sizeof(label), "%s=%d", name, v);
+      if (replay(&reader.program, sum, &config, label) != 0) {
+        status = 1;
+        break;
+      }
+    }
+  } else if (replay_once) {
+    if (replay(&reader.program, sum, &config, NULL) != 0) {
+      status = 1;
+    }
+  } else {
+    print_summary(&reader.program, sum, top, show_regs);
+  }
+
+  free(sum->stream);
+  free(count);
+  free(sum);
+  APEX_trace_reader_close(&reader);
+  fclose(in);
+  return status;
+}
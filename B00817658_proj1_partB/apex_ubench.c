@@ -0,0 +1,383 @@
+/*
+ *  apex_ubench.c
+ *  Microbenchmark of the pipeline stage functions. A kernel is stepped
+ *  for a few cycles while the input of every stage call (latches and
+ *  the cpu state stages share) is saved. Each of fetch, decode,
+ *  execute, execute2, memory, memory2 and writeback is then called in
+ *  isolation on its saved inputs and timed in nanoseconds per call,
+ *  once quiet and once with the display output (sent to /dev/null).
+ *  Running the kernel through APEX_cpu_run and through a bare loop
+ *  calling the stages gives the cost of a whole cycle, the overhead of
+ *  the run loop around the stages and the cost of display mode.
+ *
+ *  State University of New York, Binghamton
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cpu.h"
+#include "trace.h"
+
+/* Cycle limit of a kernel run, reaching it is an error */
+#define UBENCH_CYCLES 50000000
+
+/* Built-in kernel, a loop touching every non-control opcode */
+static const char default_kernel[] =
+  "        MOVC,R15,#1\n"
+  "        MOVC,R10,#200\n"
+  "        MOVC,R1,#0\n"
+  "        MOVC,R2,#0\n"
+  "loop:   LOAD,R3,R1,#16\n"
+  "        ADDL,R1,R1,#1\n"
+  "        ADD,R4,R3,R15\n"
+  "        MUL,R5,R4,R15\n"
+  "        STORE,R5,R1,#64\n"
+  "        LDR,R6,R1,R15\n"
+  "        AND,R7,R6,R15\n"
+  "        XOR,R8,R5,R15\n"
+  "        STR,R4,R1,R15\n"
+  "        SUBL,R9,R6,#1\n"
+  "        ADD,R2,R2,R9\n"
+  "        SUB,R10,R10,R15\n"
+  "        BNZ,loop\n"
+  "        MOVC,R11,#0\n"
+  "        MOVC,R12,#0\n"
+  "        HALT,\n";
+
+typedef int (*StageFunction)(APEX_CPU* cpu);
+
+static const struct
+{
+  const char* name;
+  int stage;
+  StageFunction function;
+} stage_table[] = {
+  { "fetch", F, fetch },         { "decode", DRF, decode },
+  { "execute", EX1, execute },   { "execute2", EX2, execute2 },
+  { "memory", MEM1, memory },    { "memory2", MEM2, memory2 },
+  { "writeback", WB, writeback },
+};
+
+#define NUM_STAGE_FUNCTIONS (int)(sizeof(stage_table) / sizeof(stage_table[0]))
+
+/* Called in place of a stage to time the latch setup alone */
+static int
+no_stage(APEX_CPU* cpu)
+{
+  return cpu->clock;
+}
+
+static double
+now_seconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Sends stdout to /dev/null until restore_stdout, returns the saved fd */
+static int
+silence_stdout()
+{
+  fflush(stdout);
+  int saved = dup(STDOUT_FILENO);
+  int null = open("/dev/null", O_WRONLY);
+  if (saved < 0 || null < 0) {
+    fprintf(stderr, "APEX_Error : Unable to redirect output\n");
+    exit(1);
+  }
+  dup2(null, STDOUT_FILENO);
+  close(null);
+  return saved;
+}
+
+static void
+restore_stdout(int saved)
+{
+  fflush(stdout);
+  dup2(saved, STDOUT_FILENO);
+  close(saved);
+}
+
+/*
+ * What a stage function reads: all latches plus the cpu state the
+ * stages pass between each other. Data memory is left out, stages
+ * only read it at addresses the latches name.
+ */
+typedef struct StageInput
+{
+  CPU_Stage stage[NUM_STAGES];
+  int regs[32];
+  int regs_valid[32];
+  int pc;
+  int zero_flag;
+  int branch;
+  int stp;
+  int sp;
+  int str;
+  int buffer;
+  int ins_completed;
+} StageInput;
+
+static void
+save_input(const APEX_CPU* cpu, StageInput* input)
+{
+  memcpy(input->stage, cpu->stage, sizeof(input->stage));
+  memcpy(input->regs, cpu->regs, sizeof(input->regs));
+  memcpy(input->regs_valid, cpu->regs_valid, sizeof(input->regs_valid));
+  input->pc = cpu->pc;
+  input->zero_flag = cpu->zero_flag;
+  input->branch = cpu->branch;
+  input->stp = cpu->stp;
+  input->sp = cpu->sp;
+  input->str = cpu->str;
+  input->buffer = cpu->buffer;
+  input->ins_completed = cpu->ins_completed;
+}
+
+static void
+load_input(APEX_CPU* cpu, const StageInput* input)
+{
+  memcpy(cpu->stage, input->stage, sizeof(input->stage));
+  memcpy(cpu->regs, input->regs, sizeof(input->regs));
+  memcpy(cpu->regs_valid, input->regs_valid, sizeof(input->regs_valid));
+  cpu->pc = input->pc;
+  cpu->zero_flag = input->zero_flag;
+  cpu->branch = input->branch;
+  cpu->stp = input->stp;
+  cpu->sp = input->sp;
+  cpu->str = input->str;
+  cpu->buffer = input->buffer;
+  cpu->ins_completed = input->ins_completed;
+}
+
+/*
+ * Steps the pipeline the way APEX_cpu_run does for at most 'max'
+ * cycles and saves the input of every stage call, inputs[i][c] for
+ * stage_table[i] in cycle c. Returns the number of cycles saved.
+ */
+static int
+record_inputs(APEX_CPU* cpu, StageInput* inputs[], int max)
+{
+  APEX_cpu_reset(cpu);
+  strcpy(cpu->input, "quiet");
+  int cycles = 0;
+  while (cycles < max && cpu->ins_completed != cpu->code_memory_size) {
+    /* Writeback first, fetch last */
+    for (int i = NUM_STAGE_FUNCTIONS - 1; i >= 0; --i) {
+      save_input(cpu, &inputs[i][cycles]);
+      stage_table[i].function(cpu);
+    }
+    cpu->clock++;
+    cycles++;
+  }
+  return cycles;
+}
+
+/* Seconds for 'calls' calls of 'function', cycling through 'inputs' */
+static double
+time_stage(APEX_CPU* cpu, StageFunction function, const StageInput* inputs,
+           int num_inputs, long calls)
+{
+  int k = 0;
+  double start = now_seconds();
+  for (long n = 0; n < calls; ++n) {
+    load_input(cpu, &inputs[k]);
+    function(cpu);
+    if (++k == num_inputs) {
+      k = 0;
+    }
+  }
+  return now_seconds() - start;
+}
+
+/* Best of 'repeat' timings in nanoseconds per call, setup subtracted */
+static double
+stage_ns(APEX_CPU* cpu, StageFunction function, const StageInput* inputs,
+         int num_inputs, long calls, int repeat)
+{
+  /* Through a volatile pointer so neither call can be inlined */
+  StageFunction volatile target = function;
+  StageFunction volatile baseline = no_stage;
+  double best = 0, best_setup = 0;
+  for (int r = 0; r < repeat; ++r) {
+    double t = time_stage(cpu, target, inputs, num_inputs, calls);
+    double s = time_stage(cpu, baseline, inputs, num_inputs, calls);
+    if (r == 0 || t < best) {
+      best = t;
+    }
+    if (r == 0 || s < best_setup) {
+      best_setup = s;
+    }
+  }
+  double ns = (best - best_setup) * 1e9 / calls;
+  return ns > 0 ? ns : 0.0;
+}
+
+/*
+ * Best of 'repeat' full runs of the kernel in nanoseconds per cycle,
+ * through APEX_cpu_run in 'mode', or with 'mode' NULL through a bare
+ * loop calling the stages in the same order.
+ */
+static double
+run_ns(APEX_CPU* cpu, const char* mode, int repeat, int* cycles)
+{
+  double best = 0;
+  strcpy(cpu->input, mode ? mode : "quiet");
+  cpu->clk = UBENCH_CYCLES;
+  for (int r = 0; r < repeat; ++r) {
+    APEX_cpu_reset(cpu);
+    double start = now_seconds();
+    if (mode) {
+      APEX_cpu_run(cpu);
+    } else {
+      while (cpu->ins_completed != cpu->code_memory_size &&
+             cpu->clock != cpu->clk) {
+        writeback(cpu);
+        memory2(cpu);
+        memory(cpu);
+        execute2(cpu);
+        execute(cpu);
+        decode(cpu);
+        fetch(cpu);
+        cpu->clock++;
+      }
+    }
+    double seconds = now_seconds() - start;
+    if (r == 0 || seconds < best) {
+      best = seconds;
+    }
+  }
+  *cycles = cpu->clock;
+  return cpu->clock > 0 ? best * 1e9 / cpu->clock : 0.0;
+}
+
+static void
+usage(const char* prog)
+{
+  fprintf(stderr,
+          "APEX_Help : Usage %s [--calls <n>] [--repeat <n>] "
+          "[<kernel.asm>]\n",
+          prog);
+}
+
+int
+main(int argc, char const* argv[])
+{
+  long calls = 1000000;
+  int max_cycles = 1024;
+  int repeat = 5;
+  const char* kernel = NULL;
+
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--calls") == 0 && i + 1 < argc) {
+      calls = atol(argv[++i]);
+    } else if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+      max_cycles = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+      repeat = atoi(argv[++i]);
+    } else if (argv[i][0] != '-' && !kernel) {
+      kernel = argv[i];
+    } else {
+      usage(argv[0]);
+      exit(1);
+    }
+  }
+  if (calls < 1 || max_cycles < 1 || repeat < 1) {
+    usage(argv[0]);
+    exit(1);
+  }
+
+  APEX_Program program;
+  int loaded = kernel ? APEX_program_load(NULL, kernel, &program)
+                      : APEX_assemble(NULL, "<built-in>", default_kernel,
+                                      sizeof(default_kernel) - 1, &program);
+  if (loaded != 0 || program.code_size == 0) {
+    fprintf(stderr, "APEX_Error : Unable to load %s\n",
+            kernel ? kernel : "the built-in kernel");
+    exit(1);
+  }
+  APEX_CPU* cpu = APEX_cpu_init_program(NULL, &program);
+  if (!cpu) {
+    fprintf(stderr, "APEX_Error : Unable to initialize CPU\n");
+    exit(1);
+  }
+  StageInput* inputs[NUM_STAGE_FUNCTIONS];
+  for (int i = 0; i < NUM_STAGE_FUNCTIONS; ++i) {
+    inputs[i] = malloc(sizeof(StageInput) * max_cycles);
+    if (!inputs[i]) {
+      fprintf(stderr, "APEX_Error : Unable to allocate stage inputs\n");
+      exit(1);
+    }
+  }
+  int recorded = record_inputs(cpu, inputs, max_cycles);
+
+  /* Stage functions on their own, display output is much slower */
+  long display_calls = calls / 10 > 0 ? calls / 10 : 1;
+  double quiet[NUM_STAGE_FUNCTIONS], display[NUM_STAGE_FUNCTIONS];
+  double quiet_sum = 0, display_sum = 0;
+  for (int i = 0; i < NUM_STAGE_FUNCTIONS; ++i) {
+    strcpy(cpu->input, "quiet");
+    quiet[i] = stage_ns(cpu, stage_table[i].function, inputs[i], recorded,
+                        calls, repeat);
+    quiet_sum += quiet[i];
+
+    strcpy(cpu->input, "display");
+    int saved = silence_stdout();
+    APEX_Trace trace;
+    if (APEX_trace_open(&trace, stdout, APEX_TRACE_DISPLAY, 0) != 0) {
+      fprintf(stderr, "APEX_Error : Unable to allocate the trace\n");
+      exit(1);
+    }
+    cpu->trace = &trace;
+    display[i] = stage_ns(cpu, stage_table[i].function, inputs[i], recorded,
+                          display_calls, repeat);
+    APEX_trace_close(&trace);
+    cpu->trace = NULL;
+    restore_stdout(saved);
+    display_sum += display[i];
+  }
+
+  /* Whole cycles through APEX_cpu_run */
+  int cycles, display_cycles;
+  double run_quiet = run_ns(cpu, "quiet", repeat, &cycles);
+  double run_bare = run_ns(cpu, NULL, repeat, &cycles);
+  int saved = silence_stdout();
+  double run_display = run_ns(cpu, "display", repeat, &display_cycles);
+  restore_stdout(saved);
+  if (cycles >= UBENCH_CYCLES) {
+    fprintf(stderr, "APEX_Error : Kernel did not halt in %d cycles\n",
+            UBENCH_CYCLES);
+    exit(1);
+  }
+
+  printf("%s, %d instructions, inputs of %d cycles, %ld calls per stage, "
+         "best of %d\n",
+         kernel ? kernel : "built-in kernel", program.code_size, recorded,
+         calls, repeat);
+  printf("%-12s %12s %12s %8s\n", "STAGE", "NS/CALL", "DISPLAY NS", "SHARE");
+  for (int i = 0; i < NUM_STAGE_FUNCTIONS; ++i) {
+    printf("%-12s %12.1f %12.1f %7.1f%%\n", stage_table[i].name, quiet[i],
+           display[i], quiet_sum > 0 ? 100.0 * quiet[i] / quiet_sum : 0.0);
+  }
+  /* Isolated calls miss the warm state a real cycle leaves behind, so
+   * the sum is an upper bound of the stage work in a cycle */
+  printf("%-12s %12.1f %12.1f\n", "all stages", quiet_sum, display_sum);
+  printf("\n%d cycles per run\n", cycles);
+  printf("%-24s %12.1f ns/cycle\n", "APEX_cpu_run quiet", run_quiet);
+  printf("%-24s %12.1f ns/cycle\n", "stages, bare loop", run_bare);
+  printf("%-24s %12.1f ns/cycle\n", "  loop overhead", run_quiet - run_bare);
+  printf("%-24s %12.1f ns/cycle\n", "APEX_cpu_run display", run_display);
+  printf("%-24s %12.1f ns/cycle\n", "  display path", run_display - run_quiet);
+
+  APEX_cpu_stop(cpu);
+  APEX_program_release(&program);
+  for (int i = 0; i < NUM_STAGE_FUNCTIONS; ++i) {
+    free(inputs[i]);
+  }
+  return 0;
+}
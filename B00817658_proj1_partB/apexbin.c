@@ -0,0 +1,166 @@
+/*
+ *  apexbin.c
+ *  Contains functions to write .apexbin files and to map them as
+ *  code memory
+ *
+ *  State University of New York, Binghamton
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "apexbin.h"
+#include "isa.h"
+
+/* Returns 1 if 'filename' starts with the .apexbin magic */
+int
+APEXBIN_is_binary(const char* filename)
+{
+  char magic[sizeof(APEXBIN_MAGIC)];
+  FILE* fp = fopen(filename, "rb");
+  if (!fp) {
+    return 0;
+  }
+  size_t nread = fread(magic, 1, sizeof(magic), fp);
+  fclose(fp);
+  return nread == sizeof(magic) &&
+         memcmp(magic, APEXBIN_MAGIC, sizeof(magic)) == 0;
+}
+
+/*
+ * Checks the header against the file size and this build, then makes
+ * sure every instruction is safe to hand to the pipeline as is
+ */
+static int
+validate(const APEXBIN_Header* header, const char* base, size_t length)
+{
+  if (header->version != APEXBIN_VERSION ||
+      header->byte_order != APEXBIN_BYTE_ORDER ||
+      header->ins_size != sizeof(APEX_Instruction)) {
+    fprintf(stderr, "APEX_Bin : Incompatible .apexbin, re-assemble it\n");
+    return -1;
+  }
+  if (!header->code_count ||
+      header->code_offset % sizeof(int) ||
+      header->code_offset > length ||
+      (length - header->code_offset) / sizeof(APEX_Instruction) <
+        header->code_count ||
+      header->data_offset % sizeof(int) ||
+      header->data_offset > length ||
+      (length - header->data_offset) / sizeof(int) < header->data_count ||
+      header->data_base > DATA_MEMORY_SIZE ||
+      header->data_count > DATA_MEMORY_SIZE - header->data_base) {
+    fprintf(stderr, "APEX_Bin : Truncated or corrupt .apexbin\n");
+    return -1;
+  }
+
+  const APEX_Instruction* code =
+    (const APEX_Instruction*)(base + header->code_offset);
+  for (uint32_t i = 0; i < header->code_count; ++i) {
+    const APEX_Instruction* ins = &code[i];
+    /* The stages go by the opcode string, the engines by 'op' */
+    if (ins->opcode[sizeof(ins->opcode) - 1] != '\0' ||
+        ins->op <= APEX_OP_UNKNOWN || ins->op >= APEX_NUM_OPS ||
+        strcmp(ins->opcode, APEX_op_info[ins->op].name) != 0 ||
+        (unsigned)ins->rd >= 32 ||
+        (unsigned)ins->rs1 >= 32 || (unsigned)ins->rs2 >= 32 ||
+        (unsigned)ins->rs3 >= 32) {
+      fprintf(stderr, "APEX_Bin : Bad instruction %u in .apexbin\n", i);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Maps 'filename' read only and points the program's code and data
+ * straight into the mapping. Returns 0 on success.
+ */
+int
+APEXBIN_map(const char* filename, APEX_Program* program)
+{
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(APEXBIN_Header)) {
+    close(fd);
+    return -1;
+  }
+
+  size_t length = st.st_size;
+  char* base = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    return -1;
+  }
+  madvise(base, length, MADV_WILLNEED);
+
+  const APEXBIN_Header* header = (const APEXBIN_Header*)base;
+  if (memcmp(header->magic, APEXBIN_MAGIC, sizeof(APEXBIN_MAGIC)) != 0 ||
+      validate(header, base, length) != 0) {
+    munmap(base, length);
+    return -1;
+  }
+
+  program->code = (APEX_Instruction*)(base + header->code_offset);
+  program->code_size = header->code_count;
+  program->data =
+    header->data_count ? (const int*)(base + header->data_offset) : NULL;
+  program->data_base = header->data_base;
+  program->data_size = header->data_count;
+  program->mapping = base;
+  program->mapping_size = length;
+  return 0;
+}
+
+/* Writes 'program' as an .apexbin file. Returns 0 on success. */
+int
+APEXBIN_write(const char* filename, const APEX_Program* program)
+{
+  APEXBIN_Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, APEXBIN_MAGIC, sizeof(APEXBIN_MAGIC));
+  header.version = APEXBIN_VERSION;
+  header.byte_order = APEXBIN_BYTE_ORDER;
+  header.ins_size = sizeof(APEX_Instruction);
+  header.code_count = program->code_size;
+  header.code_offset = sizeof(header);
+  header.data_base = program->data_base;
+  header.data_count = program->data_size;
+  header.data_offset =
+    header.code_offset + program->code_size * sizeof(APEX_Instruction);
+
+  FILE* fp = fopen(filename, "wb");
+  if (!fp) {
+    return -1;
+  }
+
+  /* Unused opcode bytes are zeroed so output is reproducible */
+  int ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+  for (int i = 0; ok && i < program->code_size; ++i) {
+    APEX_Instruction ins;
+    memset(&ins, 0, sizeof(ins));
+    strncpy(ins.opcode, program->code[i].opcode, sizeof(ins.opcode) - 1);
+    ins.op = program->code[i].op;
+    ins.rd = program->code[i].rd;
+    ins.rs1 = program->code[i].rs1;
+    ins.rs2 = program->code[i].rs2;
+    ins.rs3 = program->code[i].rs3;
+    ins.imm = program->code[i].imm;
+    ok = fwrite(&ins, sizeof(ins), 1, fp) == 1;
+  }
+  if (ok && program->data_size) {
+    ok = fwrite(program->data, sizeof(int), program->data_size, fp) ==
+         (size_t)program->data_size;
+  }
+  if (fclose(fp) != 0) {
+    ok = 0;
+  }
+  return ok ? 0 : -1;
+}
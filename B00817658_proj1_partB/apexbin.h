@@ -0,0 +1,43 @@
+#ifndef _APEX_BIN_H_
+#define _APEX_BIN_H_
+/**
+ *  apexbin.h
+ *  Compact binary program format (.apexbin). The code section holds
+ *  APEX_Instruction records exactly as laid out in memory, so a
+ *  mapped file is used as code memory without any parsing.
+ *
+ *  State University of New York, Binghamton
+ */
+#include <stdint.h>
+
+#include "cpu.h"
+
+#define APEXBIN_MAGIC "APEXBIN"
+#define APEXBIN_VERSION 1
+#define APEXBIN_BYTE_ORDER 0x01020304u
+
+/* File header, code and data sections follow at the given offsets */
+typedef struct APEXBIN_Header
+{
+  char magic[8];		// APEXBIN_MAGIC, NUL padded
+  uint32_t version;		// APEXBIN_VERSION
+  uint32_t byte_order;		// APEXBIN_BYTE_ORDER as stored by the writer
+  uint32_t ins_size;		// sizeof(APEX_Instruction) of the writer
+  uint32_t code_count;		// Number of instructions
+  uint32_t code_offset;		// File offset of the code section
+  uint32_t data_base;		// Data memory address of the first data word
+  uint32_t data_count;		// Number of initialized data words
+  uint32_t data_offset;		// File offset of the data section
+  uint32_t reserved[6];
+} APEXBIN_Header;
+
+int
+APEXBIN_is_binary(const char* filename);
+
+int
+APEXBIN_map(const char* filename, APEX_Program* program);
+
+int
+APEXBIN_write(const char* filename, const APEX_Program* program);
+
+#endif
@@ -0,0 +1,91 @@
+/*
+ *  arena.c
+ *  Contains a simple bump allocator. Everything allocated from an
+ *  arena is released together by APEX_arena_release.
+ *
+ *  State University of New York, Binghamton
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+/* Every allocation is aligned to this many bytes */
+#define APEX_ARENA_ALIGN 16
+
+static size_t
+align_up(size_t n)
+{
+  return (n + APEX_ARENA_ALIGN - 1) & ~(size_t)(APEX_ARENA_ALIGN - 1);
+}
+
+/* Block payload starts right after the (aligned) header */
+static char*
+block_data(APEX_Arena_Block* block)
+{
+  return (char*)block + align_up(sizeof(*block));
+}
+
+void
+APEX_arena_init(APEX_Arena* arena, size_t block_size)
+{
+  arena->head = NULL;
+  arena->block_size = block_size ? block_size : APEX_ARENA_BLOCK_SIZE;
+  arena->total = 0;
+}
+
+void*
+APEX_arena_alloc(APEX_Arena* arena, size_t size)
+{
+  size = align_up(size ? size : 1);
+
+  APEX_Arena_Block* block = arena->head;
+  if (!block || block->size - block->used < size) {
+    size_t block_size = size > arena->block_size ? size : arena->block_size;
+    block = malloc(align_up(sizeof(*block)) + block_size);
+    if (!block) {
+      return NULL;
+    }
+    block->size = block_size;
+    block->used = 0;
+    /* An oversized request should not retire a block that still has room */
+    if (arena->head && block_size > arena->block_size) {
+      block->next = arena->head->next;
+      arena->head->next = block;
+    } else {
+      block->next = arena->head;
+      arena->head = block;
+    }
+  }
+
+  void* ptr = block_data(block) + block->used;
+  block->used += size;
+  arena->total += size;
+  return ptr;
+}
+
+void*
+APEX_arena_calloc(APEX_Arena* arena, size_t count, size_t size)
+{
+  if (size && count > (size_t)-1 / size) {
+    return NULL;
+  }
+  void* ptr = APEX_arena_alloc(arena, count * size);
+  if (ptr) {
+    memset(ptr, 0, count * size);
+  }
+  return ptr;
+}
+
+void
+APEX_arena_release(APEX_Arena* arena)
+{
+  APEX_Arena_Block* block = arena->head;
+  while (block) {
+    APEX_Arena_Block* next = block->next;
+    free(block);
+    block = next;
+  }
+  arena->head = NULL;
+  arena->total = 0;
+}
@@ -0,0 +1,41 @@
+#ifndef _APEX_ARENA_H_
+#define _APEX_ARENA_H_
+/**
+ *  arena.h
+ *  Bump allocator used to batch decoded programs, CPU instances and
+ *  statistics buffers into a few large blocks
+ *
+ *  State University of New York, Binghamton
+ */
+#include <stddef.h>
+
+/* Default size of one arena block, larger requests get their own block */
+#define APEX_ARENA_BLOCK_SIZE (1 << 20)
+
+typedef struct APEX_Arena_Block
+{
+  struct APEX_Arena_Block* next;
+  size_t size;		// Usable bytes in this block
+  size_t used;		// Bytes handed out so far
+} APEX_Arena_Block;
+
+typedef struct APEX_Arena
+{
+  APEX_Arena_Block* head;	// Most recent block, allocations bump from here
+  size_t block_size;
+  size_t total;		// Bytes handed out over all blocks
+} APEX_Arena;
+
+void
+APEX_arena_init(APEX_Arena* arena, size_t block_size);
+
+void*
+APEX_arena_alloc(APEX_Arena* arena, size_t size);
+
+void*
+APEX_arena_calloc(APEX_Arena* arena, size_t count, size_t size);
+
+void
+APEX_arena_release(APEX_Arena* arena);
+
+#endif
@@ -0,0 +1,47 @@
+; array_sum.asm
+; Sums a 256 word array 128 times, the total goes to 'result'
+.equ N, 256
+.equ PASSES, 128
+
+.data
+result: .space 1
+array:
+.word 42, 7, 2, 36, 10, 0, 64, 80, 22, 31, 34, 93, 83, 55, 46, 71
+.word 34, 69, 9, 73, 52, 62, 49, 44, 96, 50, 31, 50, 21, 15, 65, 63
+.word 89, 97, 26, 67, 37, 23, 62, 90, 75, 41, 91, 70, 21, 0, 76, 49
+.word 63, 17, 96, 27, 53, 47, 26, 63, 93, 96, 32, 78, 4, 30, 80, 64
+.word 59, 83, 64, 37, 57, 93, 10, 30, 38, 26, 72, 21, 22, 8, 92, 30
+.word 47, 55, 91, 69, 2, 79, 48, 44, 62, 21, 68, 72, 93, 32, 10, 12
+.word 83, 58, 26, 28, 88, 92, 45, 18, 98, 17, 23, 69, 81, 10, 60, 35
+.word 35, 37, 0, 69, 38, 88, 71, 7, 38, 4, 63, 93, 10, 48, 87, 15
+.word 38, 52, 48, 23, 34, 41, 25, 17, 36, 57, 54, 13, 80, 96, 22, 14
+.word 16, 59, 87, 39, 38, 70, 57, 4, 73, 21, 49, 10, 83, 6, 41, 31
+.word 63, 31, 45, 12, 54, 46, 18, 46, 45, 39, 14, 59, 79, 53, 53, 82
+.word 53, 51, 11, 20, 65, 67, 78, 80, 74, 97, 89, 45, 21, 85, 3, 9
+.word 91, 77, 95, 66, 32, 9, 92, 82, 86, 18, 86, 90, 14, 57, 12, 62
+.word 68, 67, 73, 2, 2, 65, 80, 54, 8, 54, 51, 72, 83, 83, 21, 49
+.word 13, 73, 63, 30, 93, 84, 53, 89, 0, 94, 30, 3, 92, 22, 22, 48
+.word 92, 56, 50, 35, 66, 18, 80, 10, 95, 88, 65, 52, 47, 90, 1, 54
+
+.text
+        MOVC,R15,#1
+        MOVC,R10,#PASSES
+        MOVC,R0,#0
+        MOVC,R1,#array
+        MOVC,R2,#N
+loop:   LOAD,R3,R1,#0
+        ADDL,R1,R1,#1
+        ADD,R0,R0,R3
+        SUB,R2,R2,R15
+        BNZ,loop
+        ; Two instructions between a branch and the next flag write,
+        ; BZ/BNZ clear the zero flag on their way out
+        MOVC,R1,#array
+        MOVC,R2,#N
+        SUB,R10,R10,R15
+        BNZ,loop
+        MOVC,R4,#result
+        STORE,R0,R4,#0
+        MOVC,R10,#0
+        MOVC,R2,#0
+        HALT,
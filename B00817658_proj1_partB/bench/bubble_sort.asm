@@ -0,0 +1,46 @@
+; bubble_sort.asm
+; Sorts 128 words in place, ascending. The ISA only branches on zero,
+; the sign of a difference is tested through bit 14 (|diff| < 16384)
+.equ N, 128
+.equ SIGN, 16384
+
+.data
+array:
+.word 663, 35, 885, 79, 130, 230, 481, 233, 824, 999, 704, 823, 859, 649, 306, 806
+.word 606, 988, 702, 462, 517, 176, 684, 866, 683, 288, 611, 369, 884, 218, 621, 488
+.word 281, 975, 888, 955, 442, 901, 777, 308, 697, 661, 556, 316, 439, 321, 525, 840
+.word 272, 138, 971, 967, 502, 397, 196, 533, 935, 907, 354, 835, 180, 16, 16, 494
+.word 256, 607, 879, 925, 164, 87, 968, 579, 171, 453, 314, 103, 264, 264, 452, 731
+.word 538, 159, 30, 88, 556, 564, 567, 792, 623, 456, 281, 972, 977, 750, 383, 459
+.word 347, 218, 526, 550, 419, 897, 261, 147, 872, 704, 752, 241, 384, 381, 625, 213
+.word 891, 146, 59, 894, 411, 640, 672, 999, 187, 820, 246, 476, 748, 37, 872, 95
+
+.text
+        MOVC,R15,#1
+        MOVC,R12,#0
+        MOVC,R13,#SIGN
+        MOVC,R10,#N - 1
+        MOVC,R1,#array
+        MOVC,R2,#N - 1
+inner:  LOAD,R3,R1,#0
+        LOAD,R4,R1,#1
+        SUB,R5,R4,R3
+        AND,R6,R5,R13
+        MOVC,R7,#0
+        ADD,R6,R6,R12
+        BZ,ordered
+        STORE,R4,R1,#0
+        STORE,R3,R1,#1
+ordered: ADDL,R1,R1,#1
+        MOVC,R7,#0
+        SUB,R2,R2,R15
+        BNZ,inner
+        MOVC,R1,#array
+        MOVC,R2,#N - 1
+        SUB,R10,R10,R15
+        BNZ,inner
+        MOVC,R1,#0
+        MOVC,R3,#0
+        MOVC,R4,#0
+        MOVC,R5,#0
+        HALT,
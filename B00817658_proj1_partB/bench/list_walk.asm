@@ -0,0 +1,50 @@
+; list_walk.asm
+; Walks a 128 node linked list 128 times summing the values, nodes are
+; (value, next) pairs in shuffled order, next is 0 at the end
+.equ PASSES, 128
+
+.data
+head:   .word nodes + 88
+sum:    .space 1
+nodes:
+.word 99, 176, 72, 220, 34, 206, 1, 168, 27, 152, 94, 2, 10, 4, 14, 106
+.word 42, 84, 97, 122, 65, 244, 44, 116, 6, 188, 47, 194, 17, 0, 45, 124
+.word 60, 78, 79, 142, 64, 48, 22, 76, 81, 162, 57, 230, 46, 58, 50, 88
+.word 67, 148, 79, 16, 23, 52, 70, 256, 53, 32, 47, 92, 68, 94, 43, 86
+.word 39, 74, 14, 214, 82, 182, 74, 70, 87, 222, 30, 12, 86, 212, 7, 134
+.word 70, 50, 29, 138, 76, 216, 45, 64, 30, 190, 13, 22, 54, 18, 37, 196
+.word 16, 246, 22, 14, 65, 6, 2, 218, 78, 180, 21, 186, 37, 174, 82, 128
+.word 78, 166, 35, 204, 91, 160, 60, 232, 11, 198, 56, 40, 39, 144, 95, 110
+.word 94, 126, 73, 44, 35, 236, 7, 248, 10, 108, 94, 130, 51, 96, 77, 252
+.word 81, 202, 54, 112, 10, 132, 83, 38, 59, 30, 31, 140, 21, 36, 87, 164
+.word 27, 200, 3, 34, 90, 208, 81, 120, 64, 72, 2, 54, 24, 80, 25, 62
+.word 27, 170, 7, 224, 44, 102, 11, 228, 50, 158, 97, 100, 43, 46, 50, 156
+.word 21, 68, 52, 136, 54, 172, 40, 192, 64, 82, 72, 104, 2, 118, 8, 10
+.word 23, 60, 30, 238, 21, 26, 67, 24, 61, 178, 79, 250, 41, 240, 99, 210
+.word 68, 8, 14, 154, 25, 28, 40, 242, 83, 254, 67, 150, 15, 66, 42, 234
+.word 47, 20, 99, 146, 91, 184, 80, 42, 91, 98, 73, 56, 7, 226, 50, 114
+
+.text
+        MOVC,R15,#1
+        MOVC,R12,#0
+        MOVC,R10,#PASSES
+        MOVC,R0,#0
+        MOVC,R9,#head
+        LOAD,R1,R9,#0
+walk:   LOAD,R3,R1,#0
+        LOAD,R1,R1,#1
+        ADD,R0,R0,R3
+        ADD,R5,R1,R12
+        BNZ,walk
+        ; Not a LOAD right behind the branch, a squashed LOAD leaves
+        ; its destination marked invalid in cpu.c
+        MOVC,R5,#0
+        LOAD,R1,R9,#0
+        SUB,R10,R10,R15
+        BNZ,walk
+        STORE,R0,R9,#1
+        MOVC,R1,#0
+        MOVC,R3,#0
+        MOVC,R5,#0
+        MOVC,R9,#0
+        HALT,
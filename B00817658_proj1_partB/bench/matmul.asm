@@ -0,0 +1,91 @@
+; matmul.asm
+; C = A * B for 24x24 matrices, row major, inner product in R0
+.equ N, 24
+
+.data
+A:
+.word 3, 3, 2, 8, 7, 4, 8, 5, 3, 0, 0, 9, 3, 1, 9, 4, 7, 8, 2, 0, 3, 3, 2, 0
+.word 5, 4, 5, 8, 4, 3, 9, 2, 1, 5, 0, 5, 2, 6, 9, 7, 3, 6, 2, 6, 8, 2, 7, 3
+.word 8, 7, 7, 7, 9, 3, 0, 9, 8, 6, 0, 5, 1, 6, 9, 2, 6, 6, 7, 1, 7, 2, 5, 3
+.word 2, 4, 1, 1, 3, 8, 8, 7, 0, 2, 1, 8, 7, 1, 4, 1, 0, 7, 8, 1, 1, 1, 2, 7
+.word 9, 3, 4, 8, 6, 6, 0, 7, 7, 0, 5, 1, 4, 5, 3, 7, 4, 7, 6, 0, 0, 7, 9, 7
+.word 7, 2, 9, 6, 9, 4, 0, 5, 5, 9, 5, 0, 9, 7, 5, 8, 6, 5, 3, 7, 0, 7, 9, 0
+.word 5, 8, 3, 0, 6, 4, 8, 0, 8, 9, 2, 6, 9, 6, 3, 2, 7, 7, 3, 1, 2, 7, 5, 7
+.word 5, 0, 5, 1, 5, 8, 7, 2, 0, 8, 9, 4, 1, 6, 2, 0, 1, 2, 5, 9, 6, 7, 0, 1
+.word 8, 6, 8, 1, 0, 9, 5, 1, 0, 7, 9, 1, 0, 7, 1, 0, 7, 3, 1, 5, 8, 5, 0, 4
+.word 5, 6, 9, 5, 3, 6, 5, 4, 5, 4, 5, 8, 6, 9, 0, 4, 0, 2, 4, 7, 6, 1, 4, 4
+.word 3, 7, 9, 8, 3, 7, 9, 5, 1, 0, 0, 1, 4, 9, 7, 5, 8, 2, 0, 8, 9, 0, 6, 5
+.word 6, 0, 6, 8, 0, 4, 7, 8, 1, 3, 5, 3, 5, 3, 0, 4, 7, 1, 3, 2, 0, 4, 5, 2
+.word 5, 1, 3, 6, 6, 3, 7, 6, 1, 1, 1, 0, 3, 8, 0, 8, 2, 2, 4, 1, 7, 7, 6, 6
+.word 6, 5, 2, 2, 8, 5, 1, 8, 5, 0, 0, 1, 3, 0, 6, 8, 2, 9, 3, 1, 1, 0, 3, 8
+.word 0, 9, 1, 6, 0, 7, 4, 2, 8, 6, 6, 0, 9, 6, 0, 2, 3, 4, 4, 1, 1, 6, 4, 5
+.word 6, 2, 3, 3, 6, 8, 9, 8, 5, 5, 3, 2, 4, 7, 2, 7, 1, 1, 9, 9, 4, 8, 9, 3
+.word 4, 9, 2, 4, 7, 9, 2, 3, 4, 2, 5, 9, 1, 9, 4, 9, 2, 6, 7, 1, 1, 1, 4, 9
+.word 7, 2, 3, 1, 2, 6, 2, 9, 8, 2, 3, 3, 6, 7, 8, 6, 0, 9, 1, 5, 7, 5, 8, 7
+.word 4, 4, 8, 0, 1, 9, 6, 2, 0, 4, 1, 9, 2, 6, 2, 8, 3, 4, 5, 6, 3, 5, 6, 1
+.word 2, 3, 0, 4, 1, 6, 3, 0, 8, 8, 4, 3, 9, 0, 9, 1, 7, 3, 0, 7, 4, 1, 5, 7
+.word 2, 6, 1, 4, 9, 1, 7, 4, 7, 0, 1, 1, 7, 5, 3, 1, 6, 2, 0, 1, 2, 7, 9, 6
+.word 0, 2, 1, 3, 5, 0, 6, 0, 1, 9, 9, 0, 8, 9, 2, 5, 6, 4, 6, 9, 1, 5, 8, 7
+.word 5, 0, 1, 9, 8, 2, 0, 6, 1, 3, 4, 5, 1, 8, 7, 7, 1, 9, 4, 0, 2, 0, 8, 3
+.word 7, 6, 7, 3, 7, 2, 0, 6, 5, 8, 0, 4, 4, 9, 9, 1, 3, 1, 4, 1, 2, 7, 0, 9
+B:
+.word 4, 5, 6, 7, 4, 8, 6, 4, 9, 9, 1, 2, 7, 8, 6, 2, 6, 4, 1, 7, 4, 1, 6, 4
+.word 3, 5, 2, 0, 5, 9, 9, 3, 4, 4, 1, 0, 1, 8, 6, 0, 8, 8, 4, 2, 5, 2, 7, 5
+.word 0, 2, 0, 8, 9, 9, 9, 4, 4, 4, 8, 6, 6, 4, 4, 5, 8, 6, 7, 1, 8, 1, 2, 7
+.word 8, 4, 4, 7, 0, 0, 3, 9, 1, 6, 7, 8, 3, 9, 7, 1, 0, 8, 9, 1, 3, 5, 0, 4
+.word 2, 7, 0, 7, 5, 9, 8, 2, 7, 1, 7, 9, 8, 6, 5, 4, 0, 7, 0, 9, 6, 6, 9, 7
+.word 1, 9, 3, 2, 5, 3, 3, 5, 8, 2, 6, 1, 2, 8, 7, 8, 0, 4, 5, 6, 4, 0, 3, 9
+.word 6, 0, 6, 1, 4, 6, 8, 5, 7, 8, 6, 7, 5, 5, 7, 1, 5, 4, 0, 2, 0, 0, 6, 8
+.word 6, 5, 8, 2, 1, 0, 0, 9, 9, 4, 9, 1, 2, 6, 3, 7, 6, 3, 7, 1, 5, 3, 1, 8
+.word 5, 9, 9, 2, 7, 1, 8, 3, 7, 9, 1, 4, 7, 7, 2, 6, 8, 2, 7, 9, 8, 0, 5, 0
+.word 3, 3, 3, 8, 7, 6, 5, 8, 2, 0, 4, 5, 7, 2, 2, 4, 6, 2, 8, 4, 7, 8, 7, 0
+.word 4, 1, 4, 9, 4, 3, 4, 3, 3, 9, 9, 8, 3, 6, 9, 5, 8, 1, 0, 1, 9, 2, 4, 0
+.word 7, 5, 3, 8, 6, 8, 3, 5, 8, 5, 7, 4, 6, 3, 6, 8, 5, 0, 2, 8, 9, 9, 5, 9
+.word 3, 2, 9, 6, 1, 8, 1, 4, 1, 1, 9, 6, 7, 3, 2, 3, 5, 9, 1, 5, 5, 6, 8, 2
+.word 9, 8, 0, 5, 9, 7, 6, 2, 4, 9, 3, 0, 9, 8, 1, 9, 7, 0, 9, 0, 8, 7, 8, 6
+.word 0, 5, 7, 4, 5, 8, 8, 0, 0, 5, 8, 5, 1, 4, 1, 7, 0, 9, 0, 8, 2, 2, 3, 7
+.word 8, 1, 2, 5, 4, 8, 9, 5, 4, 7, 6, 4, 4, 7, 2, 6, 2, 7, 8, 0, 9, 7, 7, 2
+.word 7, 6, 7, 7, 9, 9, 8, 8, 0, 2, 0, 5, 1, 5, 2, 1, 1, 3, 8, 5, 6, 6, 0, 4
+.word 5, 4, 1, 3, 1, 3, 3, 0, 0, 7, 0, 0, 5, 3, 6, 0, 6, 0, 1, 1, 6, 7, 0, 5
+.word 2, 6, 6, 3, 8, 8, 1, 0, 9, 4, 1, 5, 6, 0, 2, 4, 2, 4, 6, 2, 6, 2, 7, 5
+.word 5, 6, 7, 5, 1, 0, 1, 1, 1, 0, 7, 3, 6, 6, 7, 9, 0, 2, 9, 2, 6, 5, 8, 9
+.word 6, 2, 0, 8, 0, 6, 8, 1, 7, 3, 3, 5, 2, 4, 2, 2, 4, 3, 2, 2, 8, 3, 4, 2
+.word 6, 5, 5, 7, 2, 1, 1, 4, 8, 3, 8, 5, 6, 9, 4, 3, 0, 0, 3, 3, 8, 4, 6, 0
+.word 6, 6, 5, 8, 2, 6, 8, 7, 9, 0, 4, 9, 2, 8, 3, 1, 8, 4, 5, 0, 8, 0, 2, 3
+.word 4, 0, 9, 0, 1, 1, 9, 3, 4, 7, 5, 1, 4, 2, 9, 0, 3, 7, 7, 4, 8, 6, 0, 4
+C:      .space 576
+
+.text
+        MOVC,R15,#1
+        MOVC,R6,#C
+        MOVC,R7,#A
+        MOVC,R8,#N
+        MOVC,R9,#B
+        MOVC,R10,#N
+row:    ADDL,R1,R7,#0
+        ADDL,R2,R9,#0
+        MOVC,R0,#0
+        MOVC,R11,#N
+dot:    LOAD,R3,R1,#0
+        LOAD,R4,R2,#0
+        MUL,R5,R3,R4
+        ADD,R0,R0,R5
+        ADDL,R1,R1,#1
+        ADDL,R2,R2,#N
+        SUB,R11,R11,R15
+        BNZ,dot
+        STORE,R0,R6,#0
+        ADDL,R6,R6,#1
+        ADDL,R9,R9,#1
+        SUB,R10,R10,R15
+        BNZ,row
+        ADDL,R7,R7,#N
+        MOVC,R9,#B
+        MOVC,R10,#N
+        SUB,R8,R8,R15
+        BNZ,row
+        MOVC,R1,#0
+        MOVC,R2,#0
+        MOVC,R3,#0
+        MOVC,R4,#0
+        HALT,
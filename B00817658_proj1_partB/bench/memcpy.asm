@@ -0,0 +1,63 @@
+; memcpy.asm
+; Copies a 512 word block 64 times, load/store bound
+.equ N, 512
+.equ PASSES, 64
+
+.data
+src:
+.word 522, 38, 709, 649, 369, 177, 188, 492, 866, 794, 368, 617, 662, 806, 309, 620
+.word 407, 710, 340, 895, 790, 113, 504, 919, 658, 290, 946, 543, 342, 451, 551, 486
+.word 522, 465, 678, 65, 520, 975, 400, 0, 66, 371, 534, 348, 465, 676, 334, 358
+.word 742, 761, 67, 661, 706, 323, 560, 897, 412, 648, 337, 645, 435, 256, 233, 975
+.word 366, 451, 931, 699, 285, 175, 585, 808, 379, 625, 757, 985, 487, 283, 68, 269
+.word 934, 977, 853, 99, 102, 782, 406, 205, 713, 266, 127, 763, 940, 197, 646, 310
+.word 359, 38, 83, 941, 840, 187, 63, 73, 283, 125, 784, 341, 621, 723, 670, 14
+.word 773, 202, 657, 707, 955, 38, 659, 145, 722, 340, 485, 636, 442, 911, 620, 109
+.word 256, 509, 154, 320, 368, 355, 349, 99, 470, 960, 392, 890, 75, 246, 597, 554
+.word 679, 129, 859, 374, 485, 992, 955, 397, 730, 336, 591, 740, 981, 434, 728, 740
+.word 17, 296, 400, 673, 448, 242, 283, 543, 638, 415, 822, 428, 703, 671, 876, 375
+.word 703, 981, 421, 783, 454, 804, 88, 180, 853, 815, 434, 244, 350, 202, 986, 856
+.word 551, 521, 684, 272, 322, 258, 166, 143, 178, 954, 300, 213, 608, 477, 512, 595
+.word 382, 692, 654, 387, 660, 251, 693, 562, 519, 261, 228, 457, 241, 650, 291, 640
+.word 862, 4, 5, 929, 876, 789, 749, 522, 787, 102, 252, 585, 391, 653, 872, 503
+.word 963, 373, 897, 35, 944, 984, 729, 895, 820, 636, 529, 459, 266, 105, 170, 920
+.word 807, 207, 961, 65, 283, 883, 345, 988, 987, 250, 389, 713, 439, 961, 5, 230
+.word 419, 409, 361, 455, 78, 632, 66, 526, 607, 745, 346, 376, 293, 48, 614, 186
+.word 262, 628, 875, 268, 478, 114, 840, 726, 906, 322, 76, 111, 203, 605, 219, 631
+.word 245, 726, 372, 299, 463, 405, 923, 890, 706, 585, 117, 936, 778, 705, 840, 312
+.word 853, 545, 296, 331, 765, 689, 35, 906, 438, 280, 664, 272, 221, 6, 731, 272
+.word 960, 500, 143, 408, 899, 946, 575, 244, 165, 822, 916, 400, 190, 174, 192, 191
+.word 451, 416, 295, 465, 183, 358, 475, 607, 625, 411, 379, 835, 593, 906, 340, 892
+.word 229, 907, 306, 466, 98, 546, 380, 115, 44, 448, 877, 374, 376, 88, 89, 855
+.word 227, 71, 234, 438, 29, 284, 619, 864, 877, 741, 893, 391, 174, 522, 215, 230
+.word 790, 669, 433, 729, 337, 478, 40, 422, 110, 757, 596, 916, 656, 806, 807, 31
+.word 906, 716, 454, 708, 858, 910, 91, 505, 18, 309, 245, 297, 289, 276, 25, 910
+.word 421, 827, 908, 410, 173, 798, 719, 727, 772, 325, 323, 985, 35, 317, 734, 890
+.word 719, 77, 220, 551, 496, 62, 980, 296, 247, 743, 297, 959, 574, 772, 947, 184
+.word 947, 782, 520, 604, 648, 601, 100, 732, 207, 981, 841, 98, 297, 930, 901, 190
+.word 484, 56, 469, 485, 3, 312, 282, 63, 87, 468, 974, 944, 143, 898, 590, 940
+.word 392, 708, 816, 331, 377, 674, 651, 166, 316, 136, 582, 860, 895, 204, 628, 692
+dst:    .space N
+
+.text
+        MOVC,R15,#1
+        MOVC,R10,#PASSES
+        MOVC,R1,#src
+        MOVC,R2,#dst
+        MOVC,R4,#N
+copy:   LOAD,R3,R1,#0
+        STORE,R3,R2,#0
+        ADDL,R1,R1,#1
+        ADDL,R2,R2,#1
+        SUB,R4,R4,R15
+        BNZ,copy
+        MOVC,R1,#src
+        MOVC,R2,#dst
+        MOVC,R4,#N
+        SUB,R10,R10,R15
+        BNZ,copy
+        MOVC,R1,#0
+        MOVC,R2,#0
+        MOVC,R3,#0
+        MOVC,R4,#0
+        HALT,
@@ -0,0 +1,221 @@
+; state_machine.asm
+; Counts "0 1 2" sequences in a stream of 3000 symbols 0..3, 4 times,
+; with a three state machine, a chain of BZ per symbol. JUMP is not
+; used: every case ends in its own copy of the loop tail.
+;
+; BZ/BNZ clear the zero flag again after Execute 2, so the next flag
+; write follows a branch that may fall through by three instructions
+.equ LEN, 3000
+.equ PASSES, 4
+
+.data
+count:  .space 1
+input:
+.word 1, 3, 0, 0, 1, 2, 0, 2, 2, 0, 1, 2, 2, 0, 0, 0, 1, 2, 0, 3
+.word 0, 1, 0, 1, 3, 0, 0, 1, 2, 0, 0, 1, 0, 0, 1, 2, 2, 2, 0, 0
+.word 1, 2, 3, 1, 0, 1, 2, 0, 1, 0, 1, 0, 0, 1, 2, 0, 1, 2, 0, 0
+.word 1, 2, 0, 1, 0, 0, 1, 2, 0, 0, 1, 2, 3, 0, 0, 1, 2, 0, 1, 2
+.word 2, 0, 0, 1, 2, 1, 1, 0, 0, 1, 2, 2, 2, 0, 1, 2, 0, 3, 1, 0
+.word 0, 1, 2, 0, 1, 1, 3, 0, 1, 2, 3, 0, 0, 2, 3, 0, 0, 1, 2, 1
+.word 0, 1, 2, 3, 0, 1, 3, 2, 3, 0, 1, 2, 3, 2, 1, 0, 1, 1, 2, 0
+.word 1, 2, 0, 0, 1, 0, 1, 3, 2, 0, 0, 1, 2, 0, 1, 0, 0, 1, 2, 0
+.word 1, 0, 1, 2, 3, 2, 0, 0, 0, 1, 2, 3, 0, 1, 2, 3, 2, 3, 0, 0
+.word 1, 2, 0, 1, 2, 0, 1, 0, 1, 0, 1, 2, 3, 0, 1, 2, 1, 0, 1, 2
+.word 0, 1, 2, 0, 2, 0, 0, 1, 2, 0, 2, 0, 0, 1, 2, 3, 3, 3, 0, 1
+.word 2, 0, 0, 0, 1, 2, 3, 0, 0, 1, 2, 1, 0, 0, 1, 0, 0, 1, 1, 3
+.word 1, 2, 1, 0, 1, 2, 0, 1, 2, 0, 0, 1, 2, 0, 1, 2, 0, 0, 0, 1
+.word 2, 0, 1, 2, 3, 0, 0, 1, 2, 0, 3, 0, 1, 0, 1, 0, 1, 0, 3, 0
+.word 1, 0, 1, 2, 2, 0, 1, 0, 0, 1, 2, 3, 0, 1, 1, 0, 0, 1, 2, 3
+.word 0, 1, 1, 0, 0, 0, 1, 2, 0, 0, 1, 2, 0, 1, 2, 0, 1, 3, 2, 1
+.word 2, 1, 1, 1, 3, 0, 0, 1, 0, 1, 1, 2, 0, 1, 2, 0, 2, 0, 0, 1
+.word 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 0, 1, 0, 1, 0, 1, 1, 0, 1
+.word 1, 0, 1, 2, 2, 3, 2, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0
+.word 1, 2, 1, 0, 1, 1, 0, 1, 0, 1, 0, 0, 1, 0, 1, 2, 2, 0, 1, 2
+.word 0, 1, 2, 0, 0, 1, 2, 3, 3, 3, 0, 1, 0, 0, 1, 2, 1, 0, 0, 1
+.word 2, 1, 0, 1, 0, 0, 0, 1, 2, 0, 0, 1, 2, 0, 1, 0, 0, 1, 2, 3
+.word 0, 0, 1, 2, 0, 3, 2, 0, 1, 3, 3, 1, 1, 0, 0, 1, 2, 1, 1, 1
+.word 1, 0, 0, 1, 2, 3, 3, 3, 0, 0, 1, 2, 1, 3, 0, 1, 2, 1, 1, 2
+.word 3, 3, 2, 0, 1, 2, 3, 0, 1, 2, 0, 1, 1, 1, 0, 1, 2, 0, 0, 1
+.word 2, 1, 0, 1, 0, 0, 1, 1, 0, 1, 0, 1, 0, 0, 1, 2, 2, 0, 0, 1
+.word 2, 0, 1, 1, 0, 0, 1, 2, 0, 0, 1, 2, 1, 2, 3, 2, 3, 0, 0, 1
+.word 2, 2, 0, 2, 0, 1, 2, 0, 2, 0, 1, 2, 3, 0, 3, 0, 1, 2, 3, 0
+.word 1, 2, 0, 0, 1, 2, 0, 1, 2, 2, 2, 0, 1, 0, 1, 0, 1, 3, 0, 1
+.word 2, 1, 0, 1, 0, 1, 0, 1, 2, 3, 2, 0, 0, 1, 2, 0, 1, 2, 0, 1
+.word 0, 2, 0, 0, 1, 2, 0, 1, 2, 3, 0, 0, 1, 0, 0, 1, 2, 2, 1, 1
+.word 2, 1, 0, 1, 2, 0, 1, 0, 1, 2, 3, 2, 3, 0, 1, 2, 0, 0, 1, 2
+.word 1, 0, 1, 2, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 2, 0, 0, 0, 0, 1
+.word 2, 2, 0, 1, 3, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 1, 0
+.word 0, 1, 2, 0, 1, 2, 2, 0, 1, 2, 0, 0, 0, 1, 0, 0, 1, 2, 1, 0
+.word 0, 1, 0, 1, 2, 0, 0, 1, 3, 0, 1, 2, 0, 3, 2, 3, 0, 0, 0, 0
+.word 1, 2, 3, 0, 1, 2, 2, 2, 2, 2, 1, 0, 1, 2, 0, 1, 3, 3, 3, 1
+.word 0, 2, 0, 0, 1, 2, 2, 0, 1, 0, 0, 1, 2, 0, 1, 2, 3, 3, 0, 0
+.word 1, 2, 0, 1, 0, 1, 0, 1, 2, 3, 0, 0, 1, 2, 0, 0, 1, 0, 1, 2
+.word 1, 0, 1, 2, 0, 0, 1, 2, 0, 1, 0, 1, 2, 1, 1, 1, 2, 2, 0, 1
+.word 0, 1, 2, 3, 3, 0, 1, 2, 0, 0, 1, 2, 0, 1, 3, 3, 2, 0, 0, 3
+.word 0, 0, 1, 2, 3, 3, 2, 0, 0, 1, 2, 2, 0, 0, 1, 2, 3, 0, 1, 2
+.word 0, 3, 1, 0, 0, 1, 2, 3, 0, 0, 0, 1, 2, 0, 2, 1, 1, 3, 1, 2
+.word 0, 3, 1, 1, 0, 1, 2, 0, 1, 0, 3, 3, 0, 0, 1, 2, 3, 3, 2, 2
+.word 0, 1, 2, 2, 1, 3, 0, 0, 1, 2, 2, 0, 1, 2, 2, 2, 2, 0, 0, 1
+.word 2, 0, 1, 2, 1, 0, 0, 0, 1, 2, 0, 1, 2, 0, 0, 1, 2, 2, 1, 0
+.word 1, 2, 0, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 2, 0, 0, 1, 2
+.word 2, 1, 0, 1, 0, 1, 1, 2, 0, 0, 1, 2, 1, 0, 0, 1, 2, 0, 1, 1
+.word 2, 0, 1, 0, 1, 0, 1, 0, 1, 2, 0, 0, 1, 2, 1, 0, 0, 1, 2, 0
+.word 1, 2, 0, 0, 1, 2, 0, 1, 2, 0, 0, 1, 2, 2, 0, 0, 1, 2, 0, 0
+.word 1, 2, 0, 2, 0, 1, 2, 0, 1, 2, 0, 1, 0, 2, 0, 1, 0, 1, 2, 2
+.word 0, 1, 2, 0, 1, 1, 3, 2, 0, 1, 0, 1, 2, 3, 0, 0, 1, 2, 1, 1
+.word 0, 1, 1, 1, 1, 0, 1, 3, 1, 2, 0, 0, 1, 2, 1, 3, 2, 3, 3, 2
+.word 3, 2, 0, 1, 2, 0, 0, 1, 2, 0, 0, 0, 0, 1, 2, 2, 2, 0, 0, 1
+.word 2, 0, 1, 0, 0, 1, 2, 0, 1, 0, 1, 0, 1, 2, 0, 1, 3, 1, 3, 2
+.word 2, 0, 1, 2, 2, 0, 1, 2, 0, 1, 0, 0, 1, 2, 1, 2, 0, 1, 2, 0
+.word 1, 2, 0, 0, 1, 2, 0, 1, 2, 2, 2, 0, 1, 2, 1, 0, 1, 0, 0, 1
+.word 2, 3, 0, 0, 1, 2, 3, 0, 0, 1, 2, 3, 3, 3, 0, 1, 2, 0, 0, 1
+.word 2, 0, 1, 2, 0, 1, 2, 1, 0, 1, 0, 1, 2, 1, 0, 1, 2, 0, 1, 3
+.word 3, 1, 0, 0, 1, 0, 1, 2, 0, 0, 0, 1, 2, 0, 1, 0, 0, 1, 2, 0
+.word 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 2, 2, 1, 0, 1, 2, 2, 0, 1, 2
+.word 0, 0, 1, 2, 1, 3, 0, 0, 1, 2, 2, 0, 0, 1, 2, 2, 1, 0, 0, 1
+.word 3, 0, 1, 1, 0, 1, 2, 0, 1, 0, 1, 0, 0, 1, 2, 2, 0, 0, 1, 2
+.word 2, 0, 1, 0, 1, 0, 0, 1, 2, 0, 0, 1, 2, 1, 0, 3, 0, 0, 1, 2
+.word 0, 1, 0, 0, 1, 2, 0, 0, 1, 2, 3, 3, 0, 1, 2, 0, 1, 0, 0, 1
+.word 2, 2, 0, 1, 2, 1, 2, 2, 0, 1, 2, 3, 0, 0, 0, 1, 2, 0, 1, 2
+.word 1, 0, 1, 0, 1, 2, 3, 0, 0, 1, 2, 2, 0, 1, 2, 2, 1, 0, 0, 1
+.word 2, 0, 0, 1, 2, 3, 0, 1, 3, 1, 0, 1, 2, 0, 1, 2, 0, 1, 3, 0
+.word 3, 0, 1, 0, 1, 2, 0, 0, 1, 2, 0, 1, 0, 1, 2, 2, 0, 0, 1, 2
+.word 0, 1, 2, 0, 0, 0, 1, 2, 0, 0, 1, 2, 2, 0, 1, 2, 3, 1, 2, 3
+.word 2, 0, 1, 2, 0, 1, 2, 0, 0, 1, 0, 1, 0, 0, 1, 2, 0, 1, 2, 3
+.word 1, 1, 2, 0, 0, 1, 2, 3, 0, 1, 2, 0, 1, 2, 0, 0, 1, 2, 2, 3
+.word 1, 0, 1, 2, 3, 3, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0
+.word 0, 0, 1, 2, 0, 1, 2, 1, 0, 1, 0, 1, 1, 2, 0, 1, 0, 1, 2, 2
+.word 1, 3, 1, 0, 0, 1, 2, 0, 0, 1, 2, 0, 1, 2, 0, 0, 1, 2, 2, 3
+.word 2, 0, 1, 2, 0, 0, 1, 2, 0, 1, 1, 2, 2, 0, 0, 1, 2, 0, 0, 1
+.word 2, 0, 1, 2, 0, 0, 1, 2, 3, 0, 1, 2, 1, 0, 1, 2, 2, 2, 0, 0
+.word 1, 2, 3, 2, 0, 1, 2, 0, 1, 2, 0, 1, 0, 1, 3, 1, 0, 1, 2, 0
+.word 1, 2, 3, 1, 3, 1, 2, 1, 0, 0, 0, 1, 2, 0, 0, 1, 0, 1, 3, 0
+.word 1, 2, 0, 1, 2, 0, 0, 1, 2, 1, 0, 3, 2, 0, 2, 0, 1, 2, 0, 1
+.word 3, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 3, 0, 1, 3
+.word 3, 1, 0, 0, 1, 2, 3, 2, 0, 1, 0, 0, 0, 1, 2, 3, 0, 1, 0, 0
+.word 1, 2, 2, 2, 0, 0, 0, 1, 2, 1, 0, 0, 0, 1, 2, 1, 0, 0, 1, 0
+.word 1, 2, 0, 1, 2, 2, 3, 3, 0, 0, 1, 2, 3, 0, 0, 1, 2, 0, 3, 0
+.word 0, 1, 2, 0, 1, 0, 0, 0, 1, 2, 2, 0, 0, 1, 2, 1, 2, 2, 2, 0
+.word 1, 2, 0, 2, 0, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 2, 1, 3
+.word 0, 0, 1, 2, 0, 1, 3, 1, 0, 0, 1, 2, 1, 0, 1, 2, 0, 3, 1, 0
+.word 1, 2, 0, 1, 2, 3, 0, 0, 1, 2, 0, 1, 0, 1, 0, 1, 2, 1, 0, 0
+.word 1, 2, 2, 0, 1, 0, 1, 0, 0, 1, 2, 0, 1, 2, 0, 0, 1, 2, 2, 0
+.word 1, 1, 2, 3, 1, 0, 1, 2, 1, 0, 0, 1, 2, 0, 2, 0, 0, 1, 2, 1
+.word 0, 0, 1, 2, 0, 3, 0, 1, 3, 3, 0, 1, 3, 2, 0, 1, 2, 0, 1, 0
+.word 1, 0, 0, 1, 2, 0, 0, 1, 2, 0, 1, 2, 2, 3, 0, 1, 3, 0, 0, 1
+.word 2, 0, 1, 0, 1, 0, 1, 2, 3, 3, 2, 0, 1, 2, 2, 0, 1, 0, 1, 2
+.word 0, 1, 0, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 0
+.word 1, 2, 2, 0, 0, 1, 2, 2, 1, 0, 0, 1, 2, 0, 0, 1, 0, 1, 1, 0
+.word 0, 1, 2, 1, 0, 1, 0, 1, 2, 2, 3, 2, 0, 0, 0, 1, 2, 2, 1, 0
+.word 1, 1, 1, 2, 0, 0, 0, 1, 2, 0, 1, 0, 1, 2, 0, 1, 2, 0, 1, 2
+.word 0, 1, 0, 1, 2, 0, 1, 3, 2, 0, 1, 2, 0, 1, 1, 1, 0, 1, 2, 0
+.word 1, 2, 2, 2, 0, 1, 2, 0, 1, 2, 3, 2, 3, 1, 0, 1, 3, 0, 1, 2
+.word 0, 1, 0, 1, 2, 0, 0, 1, 2, 0, 1, 1, 0, 0, 1, 2, 3, 3, 1, 0
+.word 0, 1, 0, 1, 2, 0, 0, 1, 2, 0, 1, 2, 0, 1, 2, 3, 3, 3, 0, 0
+.word 1, 2, 3, 3, 1, 2, 0, 0, 1, 2, 0, 1, 0, 1, 2, 0, 0, 1, 2, 2
+.word 0, 0, 1, 1, 0, 1, 0, 1, 2, 1, 0, 1, 0, 1, 2, 0, 1, 0, 0, 1
+.word 2, 0, 0, 0, 1, 2, 2, 1, 0, 1, 1, 1, 0, 3, 0, 0, 1, 2, 0, 0
+.word 1, 2, 3, 0, 1, 2, 1, 3, 1, 0, 2, 0, 0, 1, 2, 3, 0, 1, 3, 1
+.word 0, 1, 3, 0, 1, 2, 0, 1, 2, 0, 0, 1, 2, 3, 0, 3, 3, 0, 1, 2
+.word 2, 0, 2, 0, 1, 0, 1, 2, 0, 0, 1, 2, 2, 1, 0, 1, 2, 0, 1, 0
+.word 1, 3, 0, 1, 2, 2, 3, 0, 1, 2, 3, 2, 0, 0, 1, 0, 0, 1, 2, 0
+.word 1, 0, 0, 1, 2, 2, 2, 2, 0, 0, 1, 2, 2, 1, 3, 0, 0, 2, 0, 1
+.word 0, 0, 1, 2, 0, 1, 2, 2, 3, 3, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1
+.word 3, 0, 1, 0, 2, 0, 1, 0, 1, 3, 0, 1, 2, 1, 0, 1, 2, 0, 1, 2
+.word 0, 0, 1, 2, 0, 0, 1, 2, 2, 0, 0, 1, 2, 0, 1, 2, 0, 0, 1, 2
+.word 0, 1, 2, 3, 0, 1, 3, 0, 1, 2, 3, 3, 0, 1, 0, 0, 1, 3, 2, 0
+.word 1, 1, 2, 0, 1, 2, 0, 1, 2, 3, 0, 0, 1, 2, 1, 0, 1, 2, 0, 1
+.word 2, 3, 0, 1, 3, 0, 1, 3, 0, 1, 1, 3, 0, 0, 0, 1, 0, 1, 2, 0
+.word 1, 0, 0, 0, 1, 2, 0, 1, 2, 0, 1, 3, 3, 3, 0, 1, 3, 0, 1, 0
+.word 1, 2, 0, 1, 2, 0, 1, 2, 0, 0, 1, 0, 0, 1, 2, 0, 0, 0, 0, 1
+.word 2, 2, 0, 3, 0, 0, 1, 2, 0, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0
+.word 1, 2, 2, 0, 0, 0, 1, 2, 2, 0, 1, 2, 0, 1, 2, 3, 0, 1, 0, 1
+.word 0, 0, 1, 2, 0, 0, 1, 2, 1, 0, 3, 0, 1, 0, 0, 1, 2, 0, 1, 2
+.word 0, 0, 1, 2, 3, 2, 0, 1, 0, 0, 1, 2, 3, 0, 1, 3, 0, 1, 2, 3
+.word 1, 3, 0, 0, 1, 2, 2, 0, 1, 2, 0, 1, 2, 1, 1, 0, 1, 2, 0, 1
+.word 1, 0, 1, 2, 0, 0, 1, 2, 0, 1, 3, 0, 0, 1, 2, 2, 0, 0, 1, 2
+.word 2, 3, 3, 3, 0, 0, 1, 0, 0, 1, 2, 2, 0, 0, 1, 2, 0, 1, 0, 1
+.word 3, 0, 0, 1, 2, 3, 0, 1, 2, 0, 1, 0, 0, 1, 2, 2, 0, 1, 2, 0
+.word 0, 1, 2, 1, 0, 0, 1, 2, 0, 1, 0, 0, 1, 2, 0, 0, 1, 2, 0, 1
+.word 2, 3, 2, 0, 1, 0, 1, 1, 3, 0, 0, 1, 3, 0, 1, 0, 1, 2, 0, 1
+.word 2, 0, 0, 0, 1, 2, 1, 3, 0, 0, 1, 2, 0, 0, 1, 1, 3, 0, 1, 0
+.word 1, 2, 1, 2, 2, 0, 1, 0, 1, 0, 0, 0, 1, 0, 1, 0, 0, 1, 2, 2
+.word 0, 1, 2, 3, 3, 1, 3, 0, 1, 2, 0, 0, 1, 2, 0, 1, 0, 0, 0, 1
+.word 2, 0, 1, 2, 0, 0, 1, 0, 1, 2, 2, 0, 0, 1, 2, 0, 1, 0, 1, 0
+.word 1, 2, 0, 3, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 1, 0, 1, 3, 0, 0
+.word 1, 2, 2, 3, 3, 0, 1, 0, 1, 2, 0, 1, 2, 0, 1, 0, 1, 3, 0, 1
+.word 0, 1, 2, 1, 1, 3, 1, 2, 0, 1, 2, 1, 3, 2, 2, 0, 1, 0, 0, 1
+.word 2, 3, 0, 0, 1, 2, 0, 1, 0, 1, 0, 1, 2, 3, 0, 0, 1, 2, 2, 2
+.word 0, 1, 2, 2, 1, 1, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 0, 1, 2, 3
+.word 0, 0, 1, 2, 2, 3, 0, 3, 0, 0, 1, 2, 3, 0, 1, 2, 1, 0, 1, 0
+.word 1, 3, 0, 0, 1, 3, 0, 1, 2, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2
+.word 0, 1, 2, 2, 0, 1, 2, 0, 0, 1, 2, 3, 0, 1, 0, 1, 1, 0, 3, 0
+.word 1, 2, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 1, 2, 3, 3, 3, 2, 3
+.word 0, 1, 2, 1, 0, 0, 1, 2, 0, 1, 0, 1, 3, 1, 0, 1, 2, 1, 0, 0
+.word 1, 2, 2, 0, 1, 2, 0, 0, 1, 2, 1, 3, 2, 3, 2, 3, 0, 0, 1, 2
+.word 0, 0, 1, 2, 0, 1, 2, 2, 1, 0, 1, 2, 0, 1, 2, 0, 0, 1, 2, 0
+.word 1, 2, 3, 3, 1, 0, 0, 1, 2, 0, 1, 1, 0, 1, 3, 0, 1, 1, 0, 0
+.word 1, 2, 1, 0, 1, 1, 0, 1, 0, 1, 2, 0, 1, 2, 0, 1, 0, 1, 2, 0
+.word 1, 2, 0, 1, 0, 1, 2, 0, 0, 0, 0, 0, 0, 1, 2, 0, 1, 2, 0, 1
+.word 0, 2, 0, 1, 0, 1, 2, 0, 1, 3, 0, 0, 0, 1, 2, 0, 0, 1, 2, 2
+.word 0, 0, 1, 2, 1, 0, 0, 1, 2, 0, 1, 2, 0, 0, 1, 2, 1, 0, 2, 0
+.word 0, 0, 1, 2, 3, 0, 0, 1, 2, 1, 0, 1, 2, 0, 0, 1, 2, 0, 3, 3
+.word 0, 0, 1, 3, 3, 3, 0, 1, 2, 2, 0, 0, 0, 1, 2, 0, 1, 2, 1, 1
+
+.text
+        MOVC,R15,#1
+        MOVC,R12,#0
+        MOVC,R10,#PASSES
+        MOVC,R1,#input
+        MOVC,R2,#LEN
+        MOVC,R7,#0              ; state, 1 after "0", 2 after "0 1"
+        MOVC,R8,#0              ; sequences seen
+next:   LOAD,R3,R1,#0
+        ADDL,R1,R1,#1
+        ADD,R4,R3,R12
+        BZ,sym0
+        SUBL,R5,R3,#1
+        SUBL,R6,R7,#1
+        SUB,R4,R5,R12
+        BZ,sym1
+        SUBL,R5,R3,#2
+        SUBL,R6,R7,#2
+        SUB,R4,R5,R12
+        BZ,sym2
+        MOVC,R7,#0              ; symbol 3
+        MOVC,R9,#0
+        SUB,R2,R2,R15
+        BZ,done
+        BNZ,next
+sym0:   MOVC,R7,#1
+        SUB,R2,R2,R15
+        BZ,done
+        BNZ,next
+sym1:   ADD,R4,R6,R12
+        MOVC,R7,#0
+        BNZ,tail1
+        MOVC,R7,#2
+        MOVC,R9,#0
+tail1:  SUB,R2,R2,R15
+        BZ,done
+        BNZ,next
+sym2:   ADD,R4,R6,R12
+        MOVC,R7,#0
+        BNZ,tail2
+        ADDL,R8,R8,#1
+        MOVC,R9,#0
+tail2:  SUB,R2,R2,R15
+        BZ,done
+        BNZ,next
+done:   MOVC,R1,#input
+        MOVC,R2,#LEN
+        MOVC,R7,#0
+        SUB,R10,R10,R15
+        BNZ,next
+        MOVC,R4,#count
+        STORE,R8,R4,#0
+        MOVC,R3,#0
+        MOVC,R5,#0
+        MOVC,R6,#0
+        MOVC,R9,#0
+        HALT,
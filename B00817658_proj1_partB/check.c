@@ -0,0 +1,183 @@
+/*
+ *  check.c
+ *  Contains the lockstep checker of the pipeline against the
+ *  functional engine
+ *
+ *  State University of New York, Binghamton
+ */
+#include <string.h>
+
+#include "check.h"
+#include "functional.h"
+#include "isa.h"
+
+/*
+ * Sets up a shadow of 'cpu' that runs the same program from its
+ * power-on state. Returns 0, or -1 if it can not be allocated.
+ */
+int
+APEX_check_init(APEX_Check* check, const APEX_CPU* cpu)
+{
+  memset(check, 0, sizeof(*check));
+  APEX_arena_init(&check->arena, sizeof(APEX_CPU));
+  check->shadow = APEX_cpu_init_program(&check->arena, &cpu->program);
+  return check->shadow ? 0 : -1;
+}
+
+static void
+diverge(APEX_Check* check, const APEX_CPU* cpu, int kind, int where,
+        int value, int expected)
+{
+  check->diverged = kind;
+  check->cycle = cpu->clock;
+  check->where = where;
+  check->value = value;
+  check->expected = expected;
+}
+
+/*
+ * Called by writeback for every instruction that retires. Executes the
+ * next instruction on the shadow and compares its pc, its result and,
+ * for stores, address and data with what 'stage' carried through the
+ * pipeline. Registers are not compared here: younger instructions
+ * write theirs in Execute 2 before this one retires.
+ */
+void
+APEX_check_retire(APEX_Check* check, APEX_CPU* cpu, const CPU_Stage* stage)
+{
+  if (check->diverged) {
+    return;
+  }
+  APEX_CPU* shadow = check->shadow;
+  check->checked++;
+  check->pc = stage->pc;
+  check->expected_pc = shadow->pc;
+  if (stage->pc != shadow->pc) {
+    diverge(check, cpu, APEX_CHECK_PC, 0, stage->pc, shadow->pc);
+    return;
+  }
+
+  int index = (shadow->pc - 4000) / 4;
+  int data = 0;
+  if (!shadow->halt && shadow->pc >= 4000 &&
+      index < shadow->program.code_size) {
+    const APEX_Instruction* ins = &shadow->program.code[index];
+    if (APEX_op_info[ins->op].op_class == APEX_CLASS_STORE) {
+      data = shadow->regs[ins->rs1];
+    }
+  }
+  APEX_ReplayOp op;
+  if (!APEX_functional_step(shadow, &op)) {
+    diverge(check, cpu, APEX_CHECK_EXTRA, 0, stage->pc, shadow->pc);
+    return;
+  }
+
+  const APEX_Instruction* ins = &shadow->program.code[op.index];
+  const APEX_OpInfo* info = &APEX_op_info[ins->op];
+  if (info->writes_rd) {
+    int value = info->op_class == APEX_CLASS_LOAD ? stage->rs1_value
+                                                  : stage->buffer;
+    if (value != op.value) {
+      diverge(check, cpu, APEX_CHECK_RESULT, ins->rd, value, op.value);
+    }
+  } else if (info->op_class == APEX_CLASS_STORE) {
+    if (stage->mem_address != op.address) {
+      diverge(check, cpu, APEX_CHECK_STORE, -1, stage->mem_address,
+              op.address);
+    } else if (stage->rs1_value != data) {
+      diverge(check, cpu, APEX_CHECK_STORE, op.address, stage->rs1_value,
+              data);
+    }
+  }
+}
+
+/*
+ * Compares the register file and data memory once both ran to HALT.
+ * A run cut short by the cycle limit has younger results in flight
+ * and is only checked instruction by instruction.
+ */
+void
+APEX_check_finish(APEX_Check* check, const APEX_CPU* cpu)
+{
+  const APEX_CPU* shadow = check->shadow;
+  if (check->diverged || !shadow->halt) {
+    return;
+  }
+  check->pc = check->expected_pc = shadow->pc;
+  for (int i = 0; i < 32; ++i) {
+    if (cpu->regs[i] != shadow->regs[i]) {
+      diverge(check, cpu, APEX_CHECK_REGISTER, i, cpu->regs[i],
+              shadow->regs[i]);
+      return;
+    }
+  }
+  for (int i = 0; i < DATA_MEMORY_SIZE; ++i) {
+    if (cpu->data_memory[i] != shadow->data_memory[i]) {
+      diverge(check, cpu, APEX_CHECK_MEMORY, i, cpu->data_memory[i],
+              shadow->data_memory[i]);
+      return;
+    }
+  }
+}
+
+void
+APEX_check_report(const APEX_Check* check, FILE* fp)
+{
+  if (!check->diverged) {
+    fprintf(fp, "APEX_Check : %lld instructions retired in lockstep%s\n",
+            check->checked,
+            check->shadow->halt ? ", final state matches" : "");
+    return;
+  }
+
+  char text[64] = "";
+  const APEX_Program* program = &check->shadow->program;
+  int index = (check->expected_pc - 4000) / 4;
+  if (check->expected_pc >= 4000 && index < program->code_size) {
+    APEX_disassemble(&program->code[index], text, sizeof(text));
+  }
+  fprintf(fp, "APEX_Check : Diverged at cycle %d on instruction %lld, "
+              "functional pc %d (%s)\n",
+          check->cycle, check->checked, check->expected_pc, text);
+  switch (check->diverged) {
+    case APEX_CHECK_PC:
+      fprintf(fp, "APEX_Check : pipeline retired pc %d\n", check->value);
+      break;
+    case APEX_CHECK_RESULT:
+      fprintf(fp, "APEX_Check : R%d result %d, functional %d\n",
+              check->where, check->value, check->expected);
+      break;
+    case APEX_CHECK_STORE:
+      if (check->where < 0) {
+        fprintf(fp, "APEX_Check : store address %d, functional %d\n",
+                check->value, check->expected);
+      } else {
+        fprintf(fp, "APEX_Check : store to MEM[%d] of %d, functional %d\n",
+                check->where, check->value, check->expected);
+      }
+      break;
+    case APEX_CHECK_EXTRA:
+      fprintf(fp, "APEX_Check : pipeline retired pc %d past the end of "
+                  "the program\n",
+              check->value);
+      break;
+    case APEX_CHECK_REGISTER:
+      fprintf(fp, "APEX_Check : final R%d is %d, functional %d\n",
+              check->where, check->value, check->expected);
+      break;
+    case APEX_CHECK_MEMORY:
+      fprintf(fp, "APEX_Check : final MEM[%d] is %d, functional %d\n",
+              check->where, check->value, check->expected);
+      break;
+  }
+}
+
+void
+APEX_check_release(APEX_Check* check)
+{
+  if (check->shadow) {
+    APEX_cpu_stop(check->shadow);
+    check->shadow = NULL;
+  }
+  APEX_arena_release(&check->arena);
+}
@@ -0,0 +1,57 @@
+#ifndef _APEX_CHECK_H_
+#define _APEX_CHECK_H_
+/**
+ *  check.h
+ *  Lockstep checker: steps the functional engine on a shadow cpu every
+ *  time the pipeline retires an instruction and compares what both
+ *  did, stopping the run at the first divergence
+ *
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+
+#include "cpu.h"
+
+/* What diverged */
+enum
+{
+  APEX_CHECK_OK,
+  APEX_CHECK_PC,		// The pipeline retired another instruction
+  APEX_CHECK_RESULT,		// Different result, or loaded value
+  APEX_CHECK_STORE,		// Different store address or data
+  APEX_CHECK_EXTRA,		// The pipeline retired past HALT or the code
+  APEX_CHECK_REGISTER,		// Final register file differs after HALT
+  APEX_CHECK_MEMORY		// Final data memory differs after HALT
+};
+
+typedef struct APEX_Check
+{
+  APEX_Arena arena;		// Holds the shadow and nothing else
+  APEX_CPU* shadow;		// Runs the functional engine
+  long long checked;		// Retired instructions compared, the
+				// diverging one included
+  int diverged;			// APEX_CHECK_*
+  int cycle;			// Cycle of the divergence
+  int pc;			// Pc the pipeline retired
+  int expected_pc;		// Pc the functional engine executed
+  int where;			// Register or memory address that differs
+  int value;			// What the pipeline has
+  int expected;			// What the functional engine has
+} APEX_Check;
+
+int
+APEX_check_init(APEX_Check* check, const APEX_CPU* cpu);
+
+void
+APEX_check_retire(APEX_Check* check, APEX_CPU* cpu, const CPU_Stage* stage);
+
+void
+APEX_check_finish(APEX_Check* check, const APEX_CPU* cpu);
+
+void
+APEX_check_report(const APEX_Check* check, FILE* fp);
+
+void
+APEX_check_release(APEX_Check* check);
+
+#endif
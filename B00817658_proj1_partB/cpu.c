@@ -8,7 +8,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include "check.h"
 #include "cpu.h"
+#include "isa.h"
+#include "perf.h"
+#include "stats.h"
+#include "trace.h"
 
 /* Set this flag to 1 to enable debug messages */
 #define ENABLE_DEBUG_MESSAGES 1
@@ -21,29 +26,34 @@
  */
 APEX_CPU*
 APEX_cpu_init(const char* filename)
+{
+  return APEX_cpu_init_in(NULL, filename);
+}
+
+/*
+ * Same as APEX_cpu_init, but the cpu and its code memory are carved
+ * out of 'arena' when one is given. Such instances are released with
+ * the arena, APEX_cpu_stop leaves them alone.
+ */
+APEX_CPU*
+APEX_cpu_init_in(APEX_Arena* arena, const char* filename)
 {
   if (!filename) {
     return NULL;
   }
 
-  APEX_CPU* cpu = malloc(sizeof(*cpu));
-  if (!cpu) {
+  /* Parse input file (or map an .apexbin) and create code memory */
+  APEX_Program program;
+  if (APEX_program_load(arena, filename, &program) != 0) {
     return NULL;
   }
-  /* Initialize PC, Registers and all pipeline stages */
-  cpu->pc = 4000;
-  memset(cpu->regs, 0, sizeof(int) * 32);
-  memset(cpu->regs_valid, 1, sizeof(int) * 32);
-  memset(cpu->stage, 0, sizeof(CPU_Stage) * NUM_STAGES);
-  memset(cpu->data_memory, 0, sizeof(int) * 4000);
-
-  /* Parse input file and create code memory */
-  cpu->code_memory = create_code_memory(filename, &cpu->code_memory_size);
 
-  if (!cpu->code_memory) {
-    free(cpu);
+  APEX_CPU* cpu = APEX_cpu_init_program(arena, &program);
+  if (!cpu) {
+    APEX_program_release(&program);
     return NULL;
   }
+  cpu->owns_program = 1;
 
   if (ENABLE_DEBUG_MESSAGES) {
     fprintf(stderr,
@@ -63,16 +73,87 @@ APEX_cpu_init(const char* filename)
     }
   }
 
+  return cpu;
+}
+
+/*
+ * Creates a cpu running an already loaded 'program', which stays
+ * owned by the caller and must outlive the cpu. Used by tools that
+ * simulate programs they transformed in memory. Nothing is printed.
+ */
+APEX_CPU*
+APEX_cpu_init_program(APEX_Arena* arena, const APEX_Program* program)
+{
+  APEX_CPU* cpu = arena ? APEX_arena_alloc(arena, sizeof(*cpu))
+                        : malloc(sizeof(*cpu));
+  if (!cpu) {
+    return NULL;
+  }
+  cpu->arena = arena;
+  /* Data memory is cleared in full once, resets only clear dirty pages */
+  memset(cpu->data_memory, 0, sizeof(int) * DATA_MEMORY_SIZE);
+  cpu->mem_dirty = 0;
+  cpu->input[0] = '\0';
+  cpu->clk = 0;
+  cpu->perf = NULL;
+  cpu->stats = NULL;
+  cpu->trace = NULL;
+  cpu->check = NULL;
+
+  cpu->program = *program;
+  cpu->owns_program = 0;
+  cpu->code_memory = cpu->program.code;
+  APEX_cpu_reset(cpu);
+  return cpu;
+}
+
+/*
+ * This function puts APEX cpu back into its power-on state so the
+ * same instance and decoded code memory can run the program again.
+ * Run options (input, clk) are kept.
+ *
+ * Note : You are free to edit this function according to your
+ * 				implementation
+ */
+void
+APEX_cpu_reset(APEX_CPU* cpu)
+{
+  /* Initialize PC, Registers and all pipeline stages */
+  cpu->clock = 0;
+  cpu->pc = 4000;
+  memset(cpu->regs, 0, sizeof(cpu->regs));
+  for (int i = 0; i < 32; ++i) {
+    cpu->regs_valid[i] = 1;       //0 is INVALID & 1 is VALID
+  }
+  memset(cpu->stage, 0, sizeof(CPU_Stage) * NUM_STAGES);
+  APEX_mem_clear(cpu);
+  cpu->state_hash = 0;
+  memset(cpu->committed, 0, sizeof(cpu->committed));
+
+  /* Initialized data of the program, zero words are already in place */
+  for (int i = 0; i < cpu->program.data_size; ++i) {
+    if (cpu->program.data[i]) {
+      APEX_mem_write(cpu, cpu->program.data_base + i, cpu->program.data[i]);
+    }
+  }
+
   /* Make all stages busy except Fetch stage, initally to start the pipeline */
   for (int i = 1; i < NUM_STAGES; ++i) {
     cpu->stage[i].busy = 1;
   }
 
-  for(int i=0;i<=(sizeof(cpu->regs_valid)-113);i++)
-  {
-    cpu->regs_valid[i]=1;       //0 is INVALID & 1 is VALID
-  }
-  return cpu;
+  cpu->zero_flag = 0;
+  cpu->code_memory_size = cpu->program.code_size;
+  cpu->ins_completed = 0;
+  cpu->retired = 0;
+  cpu->fetch_seq = 1;
+  cpu->stp = 0;
+  cpu->stop = 0;
+  cpu->branch = 0;
+  cpu->sp = 0;
+  cpu->halt = 0;
+  cpu->str = 0;
+  cpu->buffer = 0;
 }
 
 /*
@@ -84,8 +165,12 @@ APEX_cpu_init(const char* filename)
 void
 APEX_cpu_stop(APEX_CPU* cpu)
 {
-  free(cpu->code_memory);
-  free(cpu);
+  if (cpu->owns_program) {
+    APEX_program_release(&cpu->program);
+  }
+  if (!cpu->arena) {
+    free(cpu);
+  }
 }
 
 
@@ -101,96 +186,46 @@ get_code_index(int pc)
   return (pc - 4000) / 4;
 }
 
-static void
-print_instruction(CPU_Stage* stage)
+/* Empty latches and NOPs are bubbles, everything else an instruction */
+int
+APEX_stage_is_bubble(const CPU_Stage* stage)
 {
-  if (strcmp(stage->opcode, "STORE") == 0) {
-    printf(
-      "%s,R%d,R%d,#%d ", stage->opcode, stage->rs1, stage->rs2, stage->imm);
-  }
-
-  if (strcmp(stage->opcode, "STR") == 0) {
-    printf(
-      "%s,R%d,R%d,R%d ", stage->opcode, stage->rs1, stage->rs2, stage->rs3);
-  }
-
-  if (strcmp(stage->opcode, "MOVC") == 0) {
-    printf("%s,R%d,#%d ", stage->opcode, stage->rd, stage->imm);
-  }
-
-   if (strcmp(stage->opcode, "ADD") == 0) {
-    printf("%s,R%d,R%d,R%d ", stage->opcode, stage->rd, stage->rs1, stage->rs2);
-  }
-
-  if (strcmp(stage->opcode, "ADDL") == 0) {
-    printf("%s,R%d,R%d,#%d ", stage->opcode, stage->rd, stage->rs1, stage->imm);
-  }
-
-  if (strcmp(stage->opcode, "SUB") == 0) {
-    printf("%s,R%d,R%d,R%d ", stage->opcode, stage->rd, stage->rs1, stage->rs2);
-  }
-
-  if (strcmp(stage->opcode, "SUBL") == 0) {
-    printf("%s,R%d,R%d,#%d ", stage->opcode, stage->rd, stage->rs1, stage->imm);
-  }
-
-  if (strcmp(stage->opcode, "LOAD") == 0) {
-    printf("%s,R%d,R%d,#%d ", stage->opcode, stage->rd, stage->rs1, stage->imm);
-  }
-
-  if (strcmp(stage->opcode, "LDR") == 0) {
-    printf("%s,R%d,R%d,R%d ", stage->opcode, stage->rd, stage->rs1, stage->rs2);
-  }
-
-  if (strcmp(stage->opcode, "MUL") == 0) {
-    printf("%s,R%d,R%d,R%d ", stage->opcode, stage->rd, stage->rs1, stage->rs2);
-  }
-
-  if (strcmp(stage->opcode, "AND") == 0) {
-    printf("%s,R%d,R%d,R%d ", stage->opcode, stage->rd, stage->rs1, stage->rs2);
-  }
-
-  if (strcmp(stage->opcode, "OR") == 0) {
-    printf("%s,R%d,R%d,R%d ", stage->opcode, stage->rd, stage->rs1, stage->rs2);
-  }
-
-  if (strcmp(stage->opcode, "XOR") == 0) {
-    printf("%s,R%d,R%d,R%d ", stage->opcode, stage->rd, stage->rs1, stage->rs2);
-  }
-
-  if (strcmp(stage->opcode, "BZ") == 0) {
-    printf("%s,#%d ", stage->opcode, stage->imm);
-  }
-
-  if (strcmp(stage->opcode, "BNZ") == 0) {
-    printf("%s,#%d ", stage->opcode, stage->imm);
-  }
-
-  if (strcmp(stage->opcode, "JUMP") == 0) {
-    printf("%s,R%d,#%d", stage->opcode, stage->rd, stage->imm);
-  }
+  return !stage->opcode[0] || strcmp(stage->opcode, "NOP") == 0;
+}
 
-  if (strcmp(stage->opcode, "HALT") == 0) {
-    printf("%s", stage->opcode);
+/* Bubble Decode/RF leaves in Execute 1 when it does not issue */
+static int
+stall_bubble(const CPU_Stage* stage)
+{
+  if (!stage->stalled) {
+    return APEX_BUBBLE_NONE;
   }
-
-  if (strcmp(stage->opcode, "NOP") == 0) {
-    printf("%s", stage->opcode);
+  if (strcmp(stage->opcode, "BZ") == 0 || strcmp(stage->opcode, "BNZ") == 0) {
+    return APEX_BUBBLE_BRANCH;
   }
+  return APEX_BUBBLE_RAW;
 }
 
-/* Debug function which dumps the cpu stage
- * content
- *
- * Note : You are not supposed to edit this function
- *
- */
+/* A taken branch in Memory 1 turns all younger instructions into bubbles */
 static void
-print_stage_content(char* name, CPU_Stage* stage)
+squash_wrong_path(APEX_CPU* cpu)
 {
-  printf("%-15s: pc(%d) ", name, stage->pc);
-  print_instruction(stage);
-  printf("\n");
+  if (cpu->stats) {
+    APEX_stats_flush(cpu->stats, cpu);
+  }
+  for (int i = F; i <= EX2; ++i) {
+    CPU_Stage* stage = &cpu->stage[i];
+    if (!APEX_stage_is_bubble(stage)) {
+      if (cpu->trace && ENABLE_DEBUG_MESSAGES) {
+        APEX_trace_squash(cpu->trace, stage);
+      }
+      stage->bubble = APEX_BUBBLE_FLUSH;
+    }
+    strcpy(stage->opcode, "NOP");
+  }
+  /* Fetch may be holding an instruction Decode/RF never took, its
+   * refetch after the redirect must not reuse the number */
+  cpu->fetch_seq++;
 }
 
 /*
@@ -211,7 +246,12 @@ fetch(APEX_CPU* cpu)
     /* Index into code memory using this pc and copy all instruction fields into
     * fetch latch
     */
-    APEX_Instruction* current_ins = &cpu->code_memory[get_code_index(cpu->pc)];
+    /* Wrong path fetches past the end of the program read a bubble */
+    static const APEX_Instruction no_instruction;
+    int index = get_code_index(cpu->pc);
+    const APEX_Instruction* current_ins =
+      (index >= 0 && index < cpu->program.code_size) ? &cpu->code_memory[index]
+                                                     : &no_instruction;
     strcpy(stage->opcode, current_ins->opcode);
     stage->rd = current_ins->rd;
     stage->rs1 = current_ins->rs1;
@@ -219,35 +259,35 @@ fetch(APEX_CPU* cpu)
     stage->rs3 = current_ins->rs3;
     stage->imm = current_ins->imm;
     stage->rd = current_ins->rd;
+    stage->bubble = APEX_BUBBLE_NONE;
+    /* Refetches while Decode/RF is stalled keep the same number */
+    stage->seq = cpu->fetch_seq;
     /* Update PC for next instruction */
     
     /* Copy data from fetch latch to decode latch*/
     if(cpu->stage[DRF].stalled==0)
     {
       cpu->pc += 4;
+      cpu->fetch_seq++;
       cpu->stage[DRF] = cpu->stage[F];
     }
 
-    if(strcmp(cpu->input,"display")==0)
-    {
-      if (ENABLE_DEBUG_MESSAGES) 
-      {
-        print_stage_content("Fetch", stage);
-      }
+    if (cpu->trace && ENABLE_DEBUG_MESSAGES) {
+      APEX_trace_stage(cpu->trace, stage, F);
     }
   }
   else
   {
     strcpy(stage->opcode,"");
+    stage->bubble = APEX_BUBBLE_NONE;
     
-    if(strcmp(cpu->input,"display")==0)
-    {
-      if (ENABLE_DEBUG_MESSAGES) 
-      {
-        print_stage_content("Fetch", stage);
-      }
+    if (cpu->trace && ENABLE_DEBUG_MESSAGES) {
+      APEX_trace_stage(cpu->trace, stage, F);
     }
   }
+  if (cpu->stats) {
+    APEX_stats_stage(cpu->stats, cpu, F);
+  }
   return 0;
 }
 /*
@@ -511,28 +551,24 @@ decode(APEX_CPU* cpu)
       else
       {
         strcpy(cpu->stage[EX1].opcode,"NOP");
+        cpu->stage[EX1].bubble = stall_bubble(stage);
         //cpu->stage[EX1] = cpu->stage[DRF];
       }
+      if (cpu->stats) {
+        APEX_stats_stage(cpu->stats, cpu, DRF);
+      }
       
       if(cpu->sp==1)
       {
-        if(strcmp(cpu->input,"display")==0)
-        {
-          if (ENABLE_DEBUG_MESSAGES) 
-          {
-            print_stage_content("Decode/RF", stage);
-          }
+        if (cpu->trace && ENABLE_DEBUG_MESSAGES) {
+          APEX_trace_stage(cpu->trace, stage, DRF);
         }
         strcpy(stage->opcode,"");
       }
       else
       {
-        if(strcmp(cpu->input,"display")==0)
-        {
-          if (ENABLE_DEBUG_MESSAGES) 
-          {
-            print_stage_content("Decode/RF", stage);
-          }
+        if (cpu->trace && ENABLE_DEBUG_MESSAGES) {
+          APEX_trace_stage(cpu->trace, stage, DRF);
         }
       }
       
@@ -688,13 +724,13 @@ execute(APEX_CPU* cpu)
   else
   {
     strcpy(cpu->stage[EX2].opcode,"NOP");
+    cpu->stage[EX2].bubble = stage->bubble;
   }
-  if(strcmp(cpu->input,"display")==0)
-  {
-    if (ENABLE_DEBUG_MESSAGES) 
-    {
-      print_stage_content("Execute 1", stage);
-    }
+  if (cpu->trace && ENABLE_DEBUG_MESSAGES) {
+    APEX_trace_stage(cpu->trace, stage, EX1);
+  }
+  if (cpu->stats) {
+    APEX_stats_stage(cpu->stats, cpu, EX1);
   }
   return 0;
 }
@@ -857,13 +893,13 @@ execute2(APEX_CPU* cpu)
   else
   {
     strcpy(cpu->stage[MEM1].opcode,"NOP");
+    cpu->stage[MEM1].bubble = stage->bubble;
   }
-  if(strcmp(cpu->input,"display")==0)
-  {
-    if (ENABLE_DEBUG_MESSAGES) 
-    {
-      print_stage_content("Execute 2", stage);
-    }
+  if (cpu->trace && ENABLE_DEBUG_MESSAGES) {
+    APEX_trace_stage(cpu->trace, stage, EX2);
+  }
+  if (cpu->stats) {
+    APEX_stats_stage(cpu->stats, cpu, EX2);
   }
   return 0;
 }
@@ -885,22 +921,22 @@ memory(APEX_CPU* cpu)
     /* Store */
     if (strcmp(stage->opcode, "STORE") == 0) 
     {
-        cpu->data_memory[stage->mem_address] = stage->rs1_value;
+        APEX_mem_write(cpu, stage->mem_address, stage->rs1_value);
     }
 
     if (strcmp(stage->opcode, "STR") == 0) 
     {
-        cpu->data_memory[stage->mem_address] = stage->rs1_value;
+        APEX_mem_write(cpu, stage->mem_address, stage->rs1_value);
     }
 
     if (strcmp(stage->opcode, "LOAD") == 0) 
     {
-      stage->rs1_value = cpu->data_memory[stage->mem_address];
+      stage->rs1_value = APEX_mem_read(cpu, stage->mem_address);
     }
 
     if (strcmp(stage->opcode, "LDR") == 0) 
     {
-      stage->rs1_value = cpu->data_memory[stage->mem_address];
+      stage->rs1_value = APEX_mem_read(cpu, stage->mem_address);
     }
 
 
@@ -917,10 +953,7 @@ memory(APEX_CPU* cpu)
           cpu->pc=cpu->buffer;
           cpu->zero_flag=0;
           cpu->branch=0;
-          strcpy(cpu->stage[F].opcode,"NOP");
-          strcpy(cpu->stage[DRF].opcode,"NOP");
-          strcpy(cpu->stage[EX1].opcode,"NOP");
-          strcpy(cpu->stage[EX2].opcode,"NOP");
+          squash_wrong_path(cpu);
         }
     }
 
@@ -931,10 +964,7 @@ memory(APEX_CPU* cpu)
           cpu->pc=cpu->buffer;
           cpu->zero_flag=0;
           cpu->branch=0;
-          strcpy(cpu->stage[F].opcode,"NOP");
-          strcpy(cpu->stage[DRF].opcode,"NOP");
-          strcpy(cpu->stage[EX1].opcode,"NOP");
-          strcpy(cpu->stage[EX2].opcode,"NOP");
+          squash_wrong_path(cpu);
         }
     }
 
@@ -945,13 +975,13 @@ memory(APEX_CPU* cpu)
   else
   {
     strcpy(cpu->stage[MEM2].opcode,"NOP");
+    cpu->stage[MEM2].bubble = stage->bubble;
   }
-  if(strcmp(cpu->input,"display")==0)
-  {
-    if (ENABLE_DEBUG_MESSAGES) 
-    {
-      print_stage_content("Memory 1", stage);
-    }
+  if (cpu->trace && ENABLE_DEBUG_MESSAGES) {
+    APEX_trace_stage(cpu->trace, stage, MEM1);
+  }
+  if (cpu->stats) {
+    APEX_stats_stage(cpu->stats, cpu, MEM1);
   }
   return 0;
 }
@@ -988,17 +1018,34 @@ int memory2(APEX_CPU *cpu)
   else
   {
     strcpy(cpu->stage[WB].opcode,"NOP");
+    cpu->stage[WB].bubble = stage->bubble;
   }
 
-  if(strcmp(cpu->input,"display")==0)
-  {
-    if (ENABLE_DEBUG_MESSAGES) 
-    { 
-      print_stage_content("Memory 2", stage);
-    }
+  if (cpu->trace && ENABLE_DEBUG_MESSAGES) {
+    APEX_trace_stage(cpu->trace, stage, MEM2);
+  }
+  if (cpu->stats) {
+    APEX_stats_stage(cpu->stats, cpu, MEM2);
   }
   return 0;
 }
+/* Hashes the result of the instruction 'stage' retires */
+static void
+commit_result(APEX_CPU* cpu, const CPU_Stage* stage)
+{
+  int index = get_code_index(stage->pc);
+  if (index < 0 || index >= cpu->program.code_size) {
+    return;
+  }
+  int op = cpu->program.code[index].op;
+  if (APEX_op_info[op].writes_rd) {
+    APEX_state_commit(cpu, stage->rd,
+                      APEX_op_info[op].op_class == APEX_CLASS_LOAD
+                        ? stage->rs1_value
+                        : stage->buffer);
+  }
+}
+
 /*
  *  Writeback Stage of APEX Pipeline
  *
@@ -1165,14 +1212,21 @@ writeback(APEX_CPU* cpu)
     }
     //cpu->stage[WB].busy=0;
     cpu->ins_completed++;
-  }
-  if(strcmp(cpu->input,"display")==0)
-  {
-    if (ENABLE_DEBUG_MESSAGES) 
-    {
-      print_stage_content("Writeback", stage);
+    /* ins_completed also counts bubbles and jumps on branches */
+    if (!APEX_stage_is_bubble(stage)) {
+      cpu->retired++;
+      commit_result(cpu, stage);
+      if (cpu->check) {
+        APEX_check_retire(cpu->check, cpu, stage);
+      }
     }
   }
+  if (cpu->trace && ENABLE_DEBUG_MESSAGES) {
+    APEX_trace_stage(cpu->trace, stage, WB);
+  }
+  if (cpu->stats) {
+    APEX_stats_stage(cpu->stats, cpu, WB);
+  }
   return 0;
 }
 
@@ -1191,12 +1245,101 @@ int display_mem(APEX_CPU* cpu)
 {
   printf("--------------------------------\n");
     printf("===============STATE OF DATA MEMORY===============\n");
-    for(int i=0;i<=(sizeof(cpu->data_memory)-16285);i++)
+    /* Only pages the program wrote can hold non-zero data */
+    for(int page=APEX_mem_next_dirty(cpu,0);page>=0;page=APEX_mem_next_dirty(cpu,page+1))
     {
-      printf("|     MEM[%02d]     |    DATA VALUE = %-5d|\n",i,cpu->data_memory[i]);
+      for(int i=page*MEM_PAGE_WORDS;i<(page+1)*MEM_PAGE_WORDS;i++)
+      {
+        printf("|     MEM[%02d]     |    DATA VALUE = %-5d|\n",i,cpu->data_memory[i]);
+      }
     }
   return 0;
 }
+
+/*
+ * The state hash is the XOR over all registers and memory words of a
+ * mix of location and value, zero words adding nothing. A write takes
+ * the old value out and puts the new one in, so the hash follows the
+ * state at constant cost and two runs that end in the same registers
+ * and memory end with the same hash, whatever the timing.
+ */
+static unsigned long long
+state_mix(int location, int value)
+{
+  if (!value) {
+    return 0;
+  }
+  unsigned long long x = ((unsigned long long)location << 32) |
+                         (unsigned int)value;
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+/*
+ * Commits 'value' to register 'reg' in the state hash. The pipeline
+ * calls it at writeback, registers themselves are written earlier.
+ */
+void
+APEX_state_commit(APEX_CPU* cpu, int reg, int value)
+{
+  int location = DATA_MEMORY_SIZE + reg;
+  cpu->state_hash ^= state_mix(location, cpu->committed[reg]) ^
+                     state_mix(location, value);
+  cpu->committed[reg] = value;
+}
+
+/*
+ * Data memory accessors. Out of range addresses read as zero and
+ * writes to them are dropped, so the dirty bitmap stays in bounds.
+ */
+int
+APEX_mem_read(APEX_CPU* cpu, int address)
+{
+  if (address < 0 || address >= DATA_MEMORY_SIZE) {
+    return 0;
+  }
+  return cpu->data_memory[address];
+}
+
+void
+APEX_mem_write(APEX_CPU* cpu, int address, int value)
+{
+  if (address < 0 || address >= DATA_MEMORY_SIZE) {
+    return;
+  }
+  cpu->state_hash ^= state_mix(address, cpu->data_memory[address]) ^
+                     state_mix(address, value);
+  cpu->data_memory[address] = value;
+  cpu->mem_dirty |= 1ULL << (address / MEM_PAGE_WORDS);
+}
+
+/* Returns the first dirty page at or after 'page', or -1 if none */
+int
+APEX_mem_next_dirty(const APEX_CPU* cpu, int page)
+{
+  if (page >= MEM_NUM_PAGES) {
+    return -1;
+  }
+  unsigned long long rest = cpu->mem_dirty >> page;
+  if (!rest) {
+    return -1;
+  }
+  return page + __builtin_ctzll(rest);
+}
+
+/* Zeroes only the pages written since the last clear */
+void
+APEX_mem_clear(APEX_CPU* cpu)
+{
+  for (int page = APEX_mem_next_dirty(cpu, 0); page >= 0;
+       page = APEX_mem_next_dirty(cpu, page + 1)) {
+    memset(&cpu->data_memory[page * MEM_PAGE_WORDS], 0,
+           sizeof(int) * MEM_PAGE_WORDS);
+  }
+  cpu->mem_dirty = 0;
+}
 /*
  *  APEX CPU simulation loop
  *
@@ -1206,41 +1349,84 @@ int display_mem(APEX_CPU* cpu)
 int
 APEX_cpu_run(APEX_CPU* cpu)
 {
+  /* The mode is looked up once per run, not per stage and cycle */
+  int quiet = strcmp(cpu->input,"quiet")==0;
+  int simulate = strcmp(cpu->input,"simulate")==0;
+  int display = strcmp(cpu->input,"display")==0;
+
+  /* Display output goes through a trace unless the caller set one up */
+  APEX_Trace* own_trace = NULL;
+  if (display && !cpu->trace)
+  {
+    own_trace = malloc(sizeof(*own_trace));
+    if (!own_trace ||
+        APEX_trace_open(own_trace, stdout, APEX_TRACE_DISPLAY, 0) != 0)
+    {
+      fprintf(stderr, "APEX_Error : Unable to allocate the trace\n");
+      free(own_trace);
+      return -1;
+    }
+    cpu->trace = own_trace;
+  }
+
   while (1) 
   {
+    /* The lockstep checker ends the run at the first divergence */
+    if (cpu->check && cpu->check->diverged)
+    {
+      break;
+    }
+
     /* All the instructions committed, so exit */
-    if(strcmp(cpu->input,"simulate")==0)
+    if(quiet)
     {
       if (cpu->ins_completed == cpu->code_memory_size || cpu->clock == cpu->clk) 
       {
-        printf("(apex) >> Simulation Complete");
-        APEX_simulate(cpu);
         break;
       }
     }
 
-    if(strcmp(cpu->input,"display")==0)
+    if(simulate)
     {
       if (cpu->ins_completed == cpu->code_memory_size || cpu->clock == cpu->clk) 
       {
         printf("(apex) >> Simulation Complete");
+        APEX_simulate(cpu);
         break;
       }
-      if (ENABLE_DEBUG_MESSAGES) 
+    }
+
+    if(display)
+    {
+      if (cpu->ins_completed == cpu->code_memory_size || cpu->clock == cpu->clk) 
       {
-        printf("--------------------------------\n");
-        printf("Clock Cycle #: %d\n", cpu->clock);
-        printf("--------------------------------\n");
+        APEX_trace_flush(cpu->trace);
+        printf("(apex) >> Simulation Complete");
+        break;
       }
     }
-    writeback(cpu);
-    memory2(cpu);
-    memory(cpu);
-    execute2(cpu);
-    execute(cpu);
-    decode(cpu);
-    fetch(cpu);
+    if (cpu->trace && ENABLE_DEBUG_MESSAGES)
+    {
+      APEX_trace_cycle(cpu->trace, cpu->clock);
+    }
+    if (cpu->perf && cpu->clock % APEX_PERF_PERIOD == 0) {
+      APEX_perf_cycle(cpu->perf, cpu);
+    } else {
+      writeback(cpu);
+      memory2(cpu);
+      memory(cpu);
+      execute2(cpu);
+      execute(cpu);
+      decode(cpu);
+      fetch(cpu);
+    }
     cpu->clock++;
   }
+  if (own_trace)
+  {
+    APEX_trace_close(own_trace);
+    free(own_trace);
+    cpu->trace = NULL;
+  }
   return 0;
 }
@@ -6,6 +6,12 @@
  *
  *  State University of New York, Binghamton
  */
+#include "arena.h"
+
+struct APEX_Check;
+struct APEX_Perf;
+struct APEX_Stats;
+struct APEX_Trace;
 
 enum
 {
@@ -19,10 +25,17 @@ enum
   NUM_STAGES
 };
 
+/* Data memory geometry. Writes are tracked per page so dumps and
+ * resets only walk the pages a program actually modified */
+#define DATA_MEMORY_SIZE 4096
+#define MEM_PAGE_WORDS 64
+#define MEM_NUM_PAGES (DATA_MEMORY_SIZE / MEM_PAGE_WORDS)
+
 /* Format of an APEX instruction  */
 typedef struct APEX_Instruction
 {
-  char opcode[128];	// Operation Code
+  char opcode[8];	// Operation Code, mnemonics are at most 5 characters
+  int op;		    // Opcode number, see isa.h
   int rd;		    // Destination Register Address
   int rs1;		    // Source-1 Register Address
   int rs2;		    // Source-2 Register Address
@@ -30,6 +43,28 @@ typedef struct APEX_Instruction
   int imm;		    // Literal Value
 } APEX_Instruction;
 
+/* A loaded program, decoded code memory plus optional initial data */
+typedef struct APEX_Program
+{
+  APEX_Instruction* code;
+  int code_size;
+  const int* data;	// Initial data memory image, NULL if none
+  int data_base;	// Data memory address of data[0]
+  int data_size;
+  APEX_Arena* arena;	// Arena holding code and data, NULL if malloc'd
+  void* mapping;	// Set when code and data live in a mapped .apexbin
+  size_t mapping_size;
+} APEX_Program;
+
+/* Why a latch holds a bubble, carried along as it moves down the pipe */
+enum
+{
+  APEX_BUBBLE_NONE,	// Pipeline fill or drain
+  APEX_BUBBLE_RAW,	// Decode/RF waiting for a source register
+  APEX_BUBBLE_BRANCH,	// Decode/RF holding a branch for the zero flag
+  APEX_BUBBLE_FLUSH	// Wrong path squashed by a taken branch
+};
+
 /* Model of CPU stage latch */
 typedef struct CPU_Stage
 {
@@ -48,6 +83,8 @@ typedef struct CPU_Stage
   int busy;		    // Flag to indicate, stage is performing some action
   int stalled;		// Flag to indicate, stage is stalled
   int next_addr;
+  int bubble;		// APEX_BUBBLE_* when the latch holds a bubble
+  int seq;		// Fetch order of the instruction, names it in traces
 } CPU_Stage;
 
 /* Model of APEX CPU */
@@ -71,11 +108,22 @@ typedef struct APEX_CPU
   APEX_Instruction* code_memory;
   int code_memory_size;
 
+  /* Program as loaded, HALT rewrites code_memory_size */
+  APEX_Program program;
+  int owns_program;	// Released by APEX_cpu_stop when set
+
   /* Data Memory */
-  int data_memory[4096];
+  int data_memory[DATA_MEMORY_SIZE];
+  unsigned long long mem_dirty;   // One bit per page written since last clear
+
+  /* Hash of the architectural state, see APEX_state_commit */
+  unsigned long long state_hash;
+  int committed[32];	// Register values as of their last writeback
 
   /* Some stats */
   int ins_completed;
+  long long retired;	// Instructions through writeback, bubbles excluded
+  int fetch_seq;	// Sequence number of the next instruction fetched
 
   /*Some additional variables for simulation*/
   int stp; 
@@ -88,14 +136,55 @@ typedef struct APEX_CPU
   int clk;
   char input[128];
 
+  /* Host time sampling of the stages, see perf.h, NULL when off */
+  struct APEX_Perf* perf;
+
+  /* Per-stage activity counters, see stats.h, NULL when off */
+  struct APEX_Stats* stats;
+
+  /* Stage latch records, see trace.h, NULL when off */
+  struct APEX_Trace* trace;
+
+  /* Lockstep functional checker, see check.h, NULL when off */
+  struct APEX_Check* check;
+
+  /* Arena owning this instance and its code memory, NULL if malloc'd */
+  APEX_Arena* arena;
+
 } APEX_CPU;
 
 APEX_Instruction*
 create_code_memory(const char* filename, int* size);
 
+APEX_Instruction*
+create_code_memory_in(APEX_Arena* arena, const char* filename, int* size);
+
+int
+APEX_assemble(APEX_Arena* arena, const char* name, const char* text,
+              size_t length, APEX_Program* program);
+
+int
+APEX_program_load(APEX_Arena* arena, const char* filename,
+                  APEX_Program* program);
+
+void
+APEX_program_release(APEX_Program* program);
+
+int
+APEX_write_asm(const char* filename, const APEX_Program* program);
+
 APEX_CPU*
 APEX_cpu_init(const char* filename);
 
+APEX_CPU*
+APEX_cpu_init_in(APEX_Arena* arena, const char* filename);
+
+APEX_CPU*
+APEX_cpu_init_program(APEX_Arena* arena, const APEX_Program* program);
+
+void
+APEX_cpu_reset(APEX_CPU* cpu);
+
 int
 APEX_cpu_run(APEX_CPU* cpu);
 
@@ -126,7 +215,25 @@ writeback(APEX_CPU* cpu);
 int 
 APEX_simulate(APEX_CPU* cpu);
 
+int
+APEX_stage_is_bubble(const CPU_Stage* stage);
+
 int display_mem(APEX_CPU* cpu);
 
+int
+APEX_mem_read(APEX_CPU* cpu, int address);
+
+void
+APEX_mem_write(APEX_CPU* cpu, int address, int value);
+
+int
+APEX_mem_next_dirty(const APEX_CPU* cpu, int page);
+
+void
+APEX_mem_clear(APEX_CPU* cpu);
+
+void
+APEX_state_commit(APEX_CPU* cpu, int reg, int value);
+
 
 #endif
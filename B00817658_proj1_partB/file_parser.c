@@ -1,199 +1,1268 @@
 /*
  *  file_parser.c
- *  Contains functions to parse input file and create
+ *  Contains the APEX assembler that parses an input file and creates
  *  code memory, you can edit this file to add new instructions
  *
+ *  Besides plain "OPCODE,operand,..." lines the assembler accepts
+ *
+ *    ; comment                 rest of the line is ignored
+ *    name:                     label, code or data address of what follows
+ *    .text / .data             switch between code and data memory
+ *    .word expr, ...           initialized data words
+ *    .space n                  n zero data words
+ *    .org expr                 set the current data address
+ *    .equ NAME, expr           constant (also .set)
+ *    .macro NAME a, b ... .endm
+ *                              macro, body refers to arguments as \a and
+ *                              to a per-expansion unique number as \@
+ *
+ *  Expressions are numbers (decimal or 0x hex) and symbols joined by
+ *  + and -. Literals are written "#expr". A symbolic BZ/BNZ operand
+ *  ("BNZ,loop" or "#loop") names the branch target and is turned into
+ *  the pc relative offset, "#-12" style numbers are kept as offsets.
+ *  Symbols may be used before they are defined.
+ *
  *  State University of New York, Binghamton
  */
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "apexbin.h"
 #include "cpu.h"
+#include "isa.h"
+
+/* Arguments a macro takes at most */
+#define MAX_MACRO_PARAMS 8
+
+/* Maximum comma separated tokens looked at on one line, enough for the
+   arguments of any macro plus one to notice a call with too many */
+#define MAX_TOKENS (MAX_MACRO_PARAMS + 1)
+
+/* Locale independent and cheap, this runs for every input byte */
+static inline int
+is_space(char c)
+{
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' ||
+         c == '\f';
+}
+
+/* A token is a [begin, end) slice of the input, nothing is copied */
+typedef struct Token
+{
+  const char* begin;
+  const char* end;
+} Token;
 
 /*
- * This function is related to parsing input file
- *
- * Note : You are not supposed to edit this function
+ * Parses the number following the leading 'R' or '#' of a token into
+ * '*value', with the same leniency as atoi (stops at the first
+ * non-digit). Returns -1 when the number does not fit in an int.
  */
 static int
-get_num_from_string(char* buffer)
+get_num_from_token(const Token* token, int* value)
 {
-  char str[16];
-  int j = 0;
-  for (int i = 1; buffer[i] != '\0'; ++i) {
-    str[j] = buffer[i];
-    j++;
+  const char* p = token->begin + 1;
+  int negative = 0;
+  long long number = 0;
+
+  while (p < token->end && is_space(*p)) {
+    p++;
+  }
+  if (p < token->end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    p++;
   }
-  str[j] = '\0';
-  return atoi(str);
+  while (p < token->end && (*p >= '0' && *p <= '9')) {
+    number = number * 10 + (*p - '0');
+    if (number > (long long)INT_MAX + 1) {
+      return -1;
+    }
+    p++;
+  }
+  if (!negative && number > INT_MAX) {
+    return -1;
+  }
+  *value = (int)(negative ? -number : number);
+  return 0;
+}
+
+/* Splits [p, end) at commas into trimmed tokens, returns the count */
+static int
+split_tokens(const char* p, const char* end, Token* tokens)
+{
+  int token_num = 0;
+  while (p <= end && token_num < MAX_TOKENS) {
+    const char* comma = memchr(p, ',', end - p);
+    const char* stop = comma ? comma : end;
+    Token* token = &tokens[token_num];
+    token->begin = p;
+    token->end = stop;
+    while (token->begin < token->end && is_space(*token->begin)) {
+      token->begin++;
+    }
+    while (token->end > token->begin && is_space(token->end[-1])) {
+      token->end--;
+    }
+    token_num++;
+    if (!comma) {
+      break;
+    }
+    p = comma + 1;
+  }
+  return token_num;
+}
+
+/* Returns 1 if [p, end) holds only white space */
+static int
+is_blank(const char* p, const char* end)
+{
+  while (p < end) {
+    if (!is_space(*p)) {
+      return 0;
+    }
+    p++;
+  }
+  return 1;
 }
 
 /*
- * This function is related to parsing input file
+ * Maps the whole file read only. Falls back to reading it into a heap
+ * buffer when the file cannot be mapped (pipes, special files).
+ * '*mapped' tells the caller how to release the buffer.
+ */
+static char*
+load_file(const char* filename, size_t* length, int* mapped)
+{
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+    *length = st.st_size;
+    if (!*length) {
+      close(fd);
+      return NULL;
+    }
+    char* data = mmap(NULL, *length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      madvise(data, *length, MADV_SEQUENTIAL);
+      close(fd);
+      *mapped = 1;
+      return data;
+    }
+  }
+
+  size_t capacity = 4096;
+  char* data = malloc(capacity);
+  *length = 0;
+  ssize_t nread;
+  while (data && (nread = read(fd, data + *length, capacity - *length)) > 0) {
+    *length += nread;
+    if (*length == capacity) {
+      capacity *= 2;
+      char* grown = realloc(data, capacity);
+      if (!grown) {
+        free(data);
+      }
+      data = grown;
+    }
+  }
+  close(fd);
+  if (data && !*length) {
+    free(data);
+    data = NULL;
+  }
+  *mapped = 0;
+  return data;
+}
+
+
+#define MAX_MACRO_DEPTH 16
+#define MAX_EXPANDED_LINE 1024
+
+/* Code address of the first instruction, see get_code_index */
+#define CODE_BASE 4000
+
+/* Fixup target for a data word instead of an instruction field */
+#define FIXUP_DATA -1
+
+typedef struct Symbol
+{
+  char* name;		// NULL for an empty hash slot
+  int value;
+} Symbol;
+
+/* A reference to a symbol that was not defined yet */
+typedef struct Fixup
+{
+  int index;		// Instruction index, or data address for FIXUP_DATA
+  int field;		// APEX_FIELD_* to patch, or FIXUP_DATA
+  char* name;
+  int sign;
+  int addend;		// Rest of the expression, already folded
+  int relative;		// Store target - pc (symbolic branch operands)
+  int line_no;
+} Fixup;
+
+typedef struct Macro
+{
+  char* name;
+  int num_params;
+  char* params[MAX_MACRO_PARAMS];
+  char* body;		// Body lines separated by '\n'
+  size_t body_len;
+} Macro;
+
+/* Assembler state for one input */
+typedef struct Assembler
+{
+  const char* filename;
+  int line_no;
+  int errors;
+
+  APEX_Instruction* code;
+  int code_size;
+  int code_capacity;
+
+  int* data;		// Image of data memory from address 0
+  int data_capacity;
+  int data_addr;	// Next .word goes here
+  int data_low;		// Lowest and highest address initialized so far
+  int data_high;
+  int in_data;
+
+  Symbol* symbols;	// Open addressing table, capacity is a power of 2
+  int symbol_count;
+  int symbol_capacity;
+
+  Fixup* fixups;
+  int fixup_count;
+  int fixup_capacity;
+
+  Macro* macros;
+  int macro_count;
+  int macro_capacity;
+  Macro* defining;	// Macro whose body is being collected
+  int expansion;	// Value of \@ in the current expansion
+  int depth;
+} Assembler;
+
+static void
+asm_error(Assembler* as, const char* fmt, ...)
+{
+  va_list args;
+  fprintf(stderr, "APEX_Parser : %s:%d: ", as->filename, as->line_no);
+  va_start(args, fmt);
+  vfprintf(stderr, fmt, args);
+  va_end(args);
+  fprintf(stderr, "\n");
+  as->errors++;
+}
+
+/* Makes room for one more element of 'size' bytes, returns 0 on success */
+static int
+grow(void** array, int* capacity, int count, size_t size)
+{
+  if (count < *capacity) {
+    return 0;
+  }
+  int new_capacity = *capacity ? *capacity * 2 : 16;
+  void* grown = realloc(*array, size * new_capacity);
+  if (!grown) {
+    return -1;
+  }
+  *array = grown;
+  *capacity = new_capacity;
+  return 0;
+}
+
+static char*
+copy_slice(const char* p, const char* end)
+{
+  char* copy = malloc(end - p + 1);
+  if (copy) {
+    memcpy(copy, p, end - p);
+    copy[end - p] = '\0';
+  }
+  return copy;
+}
+
+static int
+is_ident_start(char c)
+{
+  return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_';
+}
+
+static int
+is_ident_char(char c)
+{
+  return is_ident_start(c) || (c >= '0' && c <= '9');
+}
+
+/* Returns the end of the identifier starting at p, p if there is none */
+static const char*
+scan_ident(const char* p, const char* end)
+{
+  if (p < end && is_ident_start(*p)) {
+    p++;
+    while (p < end && is_ident_char(*p)) {
+      p++;
+    }
+  }
+  return p;
+}
+
+static const char*
+skip_space(const char* p, const char* end)
+{
+  while (p < end && is_space(*p)) {
+    p++;
+  }
+  return p;
+}
+
+static const char*
+trim_end(const char* p, const char* end)
+{
+  while (end > p && is_space(end[-1])) {
+    end--;
+  }
+  return end;
+}
+
+static int
+slice_equals(const char* p, const char* end, const char* str)
+{
+  size_t len = strlen(str);
+  return (size_t)(end - p) == len && memcmp(p, str, len) == 0;
+}
+
+static unsigned
+hash_slice(const char* p, const char* end)
+{
+  unsigned hash = 2166136261u;
+  while (p < end) {
+    hash = (hash ^ (unsigned char)*p++) * 16777619u;
+  }
+  return hash;
+}
+
+static Symbol*
+find_slot(Symbol* symbols, int capacity, const char* p, const char* end)
+{
+  unsigned slot = hash_slice(p, end) & (capacity - 1);
+  while (symbols[slot].name &&
+         !slice_equals(p, end, symbols[slot].name)) {
+    slot = (slot + 1) & (capacity - 1);
+  }
+  return &symbols[slot];
+}
+
+static Symbol*
+find_symbol(Assembler* as, const char* p, const char* end)
+{
+  if (!as->symbol_capacity) {
+    return NULL;
+  }
+  Symbol* symbol = find_slot(as->symbols, as->symbol_capacity, p, end);
+  return symbol->name ? symbol : NULL;
+}
+
+static void
+define_symbol(Assembler* as, const char* p, const char* end, int value)
+{
+  if (find_symbol(as, p, end)) {
+    asm_error(as, "'%.*s' is already defined", (int)(end - p), p);
+    return;
+  }
+
+  /* Keep the table at most half full */
+  if ((as->symbol_count + 1) * 2 > as->symbol_capacity) {
+    int capacity = as->symbol_capacity ? as->symbol_capacity * 2 : 64;
+    Symbol* symbols = calloc(capacity, sizeof(*symbols));
+    if (!symbols) {
+      asm_error(as, "out of memory");
+      return;
+    }
+    for (int i = 0; i < as->symbol_capacity; ++i) {
+      Symbol* old = &as->symbols[i];
+      if (old->name) {
+        *find_slot(symbols, capacity, old->name,
+                   old->name + strlen(old->name)) = *old;
+      }
+    }
+    free(as->symbols);
+    as->symbols = symbols;
+    as->symbol_capacity = capacity;
+  }
+
+  Symbol* symbol = find_slot(as->symbols, as->symbol_capacity, p, end);
+  symbol->name = copy_slice(p, end);
+  symbol->value = value;
+  as->symbol_count++;
+}
+
+/* Address the next instruction or data word will get */
+static int
+current_address(Assembler* as)
+{
+  return as->in_data ? as->data_addr : CODE_BASE + 4 * as->code_size;
+}
+
+/*
+ * Parses a decimal or 0x hex number, returns the end or p on failure.
+ * A number past 32 bits stops growing at UINT_MAX + 1.
+ */
+static const char*
+scan_number(const char* p, const char* end, unsigned long long* value)
+{
+  const char* start = p;
+  *value = 0;
+  if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+    p += 2;
+    while (p < end) {
+      int digit;
+      if (*p >= '0' && *p <= '9') {
+        digit = *p - '0';
+      } else if (*p >= 'a' && *p <= 'f') {
+        digit = *p - 'a' + 10;
+      } else if (*p >= 'A' && *p <= 'F') {
+        digit = *p - 'A' + 10;
+      } else {
+        break;
+      }
+      *value = *value * 16 + digit;
+      if (*value > UINT_MAX) {
+        *value = (unsigned long long)UINT_MAX + 1;
+      }
+      p++;
+    }
+    return p == start + 2 ? start : p;
+  }
+  while (p < end && *p >= '0' && *p <= '9') {
+    *value = *value * 10 + (*p - '0');
+    if (*value > UINT_MAX) {
+      *value = (unsigned long long)UINT_MAX + 1;
+    }
+    p++;
+  }
+  return p;
+}
+
+/*
+ * Evaluates [p, end) as terms joined by + and -. Defined symbols are
+ * folded into '*value'. At most one undefined symbol is allowed, it is
+ * returned through 'pending' with its sign so the caller can record a
+ * fixup. '*symbolic' tells if any symbol appeared. Returns 0 on success.
+ */
+static int
+eval_expr(Assembler* as, const char* p, const char* end, int* value,
+          Token* pending, int* pending_sign, int* symbolic)
+{
+  long long total = 0;
+  int sign = 1;
+  int terms = 0;
+
+  pending->begin = pending->end = NULL;
+  *symbolic = 0;
+  p = skip_space(p, end);
+  end = trim_end(p, end);
+  const char* start = p;
+  if (p < end && (*p == '-' || *p == '+')) {
+    sign = (*p == '-') ? -1 : 1;
+    p = skip_space(p + 1, end);
+  }
+
+  while (p < end) {
+    const char* ident_end = scan_ident(p, end);
+    if (ident_end != p) {
+      *symbolic = 1;
+      Symbol* symbol = find_symbol(as, p, ident_end);
+      if (symbol) {
+        total += sign * (long long)symbol->value;
+      } else if (!pending->begin) {
+        pending->begin = p;
+        pending->end = ident_end;
+        *pending_sign = sign;
+      } else {
+        asm_error(as, "more than one undefined symbol in '%.*s'",
+                  (int)(end - p), p);
+        return -1;
+      }
+      p = ident_end;
+    } else {
+      unsigned long long number;
+      const char* number_end = scan_number(p, end, &number);
+      if (number_end == p) {
+        asm_error(as, "bad expression '%.*s'", (int)(end - p), p);
+        return -1;
+      }
+      if (number > UINT_MAX) {
+        asm_error(as, "number '%.*s' does not fit in 32 bits",
+                  (int)(number_end - p), p);
+        return -1;
+      }
+      total += sign * (long long)number;
+      p = number_end;
+    }
+    terms++;
+
+    p = skip_space(p, end);
+    if (p == end) {
+      break;
+    }
+    if (*p != '+' && *p != '-') {
+      asm_error(as, "bad expression '%.*s'", (int)(end - p), p);
+      return -1;
+    }
+    sign = (*p == '-') ? -1 : 1;
+    p = skip_space(p + 1, end);
+  }
+
+  if (!terms) {
+    asm_error(as, "missing expression");
+    return -1;
+  }
+  /* 32-bit values above INT_MAX, such as 0xFFFFFFFF, wrap to negative */
+  if (total < INT_MIN || total > UINT_MAX) {
+    asm_error(as, "value of '%.*s' does not fit in 32 bits",
+              (int)(end - start), start);
+    return -1;
+  }
+  *value = (int)(unsigned int)total;
+  return 0;
+}
+
+static void
+add_fixup(Assembler* as, int index, int field, const Token* name, int sign,
+          int addend, int relative)
+{
+  if (grow((void**)&as->fixups, &as->fixup_capacity, as->fixup_count,
+           sizeof(*as->fixups)) != 0) {
+    asm_error(as, "out of memory");
+    return;
+  }
+  Fixup* fixup = &as->fixups[as->fixup_count++];
+  fixup->index = index;
+  fixup->field = field;
+  fixup->name = copy_slice(name->begin, name->end);
+  fixup->sign = sign;
+  fixup->addend = addend;
+  fixup->relative = relative;
+  fixup->line_no = as->line_no;
+}
+
+static void
+set_field(APEX_Instruction* ins, int field, int value)
+{
+  switch (field) {
+    case APEX_FIELD_RD:
+      ins->rd = value;
+      break;
+    case APEX_FIELD_RS1:
+      ins->rs1 = value;
+      break;
+    case APEX_FIELD_RS2:
+      ins->rs2 = value;
+      break;
+    case APEX_FIELD_RS3:
+      ins->rs3 = value;
+      break;
+    case APEX_FIELD_IMM:
+      ins->imm = value;
+      break;
+  }
+}
+
+/*
+ * Decodes the literal operand 'token' of instruction 'index'.
+ * Symbolic operands of BZ/BNZ name the target and become pc relative.
+ */
+static int
+literal_operand(Assembler* as, const Token* token, int index, int op)
+{
+  const char* p = token->begin;
+  int branch = (op == APEX_OP_BZ || op == APEX_OP_BNZ);
+
+  if (*p == '#') {
+    p++;
+  } else if (!is_ident_start(*p)) {
+    /* Legacy leniency, whatever the first character is, skip it */
+    int value;
+    if (get_num_from_token(token, &value) != 0) {
+      asm_error(as, "literal '%.*s' out of range",
+                (int)(token->end - token->begin), token->begin);
+      return 0;
+    }
+    return value;
+  }
+
+  int value;
+  int sign = 1;
+  int symbolic;
+  Token pending;
+  if (eval_expr(as, p, token->end, &value, &pending, &sign, &symbolic) != 0) {
+    return 0;
+  }
+
+  int pc = CODE_BASE + 4 * index;
+  if (pending.begin) {
+    add_fixup(as, index, APEX_FIELD_IMM, &pending, sign, value,
+              branch && symbolic);
+    return 0;
+  }
+  if (branch && symbolic) {
+    return value - pc;
+  }
+  return value;
+}
+
+/*
+ * Decodes one instruction line [line, end) into 'ins', which is
+ * instruction number 'index'. Operand tokens are mapped to
+ * instruction fields through the opcode table in isa.c
  *
- * Note : you can edit this function to add new instructions
+ * Note : add new instructions to APEX_op_info rather than here
  */
 static void
-create_APEX_instruction(APEX_Instruction* ins, char* buffer)
+create_APEX_instruction(Assembler* as, APEX_Instruction* ins, int index,
+                        int op, const char* line, const char* end)
 {
-  char* token = strtok(buffer, ",");
-  int token_num = 0;
-  char tokens[6][128];
-  while (token != NULL) {
-    strcpy(tokens[token_num], token);
-    token_num++;
-    token = strtok(NULL, ",");
+  Token tokens[MAX_TOKENS];
+  int token_num = split_tokens(line, end, tokens);
+
+  memset(ins, 0, sizeof(*ins));
+
+  size_t len = tokens[0].end - tokens[0].begin;
+  if (len >= sizeof(ins->opcode)) {
+    len = sizeof(ins->opcode) - 1;
+  }
+  memcpy(ins->opcode, tokens[0].begin, len);
+  ins->opcode[len] = '\0';
+
+  ins->op = op;
+  if (ins->op == APEX_OP_UNKNOWN) {
+    asm_error(as, "unknown opcode '%s'", ins->opcode);
+    return;
+  }
+
+  const APEX_OpInfo* info = &APEX_op_info[ins->op];
+  for (int i = 0; i < APEX_MAX_OPERANDS && i + 1 < token_num; ++i) {
+    const Token* token = &tokens[i + 1];
+    if (token->begin == token->end || info->fields[i] == APEX_FIELD_NONE) {
+      continue;
+    }
+    if (info->fields[i] == APEX_FIELD_IMM) {
+      ins->imm = literal_operand(as, token, index, ins->op);
+      continue;
+    }
+    int reg = 0;
+    if (get_num_from_token(token, &reg) != 0 || reg < 0 || reg >= 32) {
+      asm_error(as, "register '%.*s' out of range",
+                (int)(token->end - token->begin), token->begin);
+    }
+    set_field(ins, info->fields[i], reg);
+  }
+}
+
+static void
+emit_instruction(Assembler* as, int op, const char* line, const char* end)
+{
+  if (as->in_data) {
+    asm_error(as, "instruction in .data section");
+    return;
+  }
+  if (grow((void**)&as->code, &as->code_capacity, as->code_size,
+           sizeof(*as->code)) != 0) {
+    asm_error(as, "out of memory");
+    return;
   }
+  int index = as->code_size++;
+  create_APEX_instruction(as, &as->code[index], index, op, line, end);
+}
 
-  strcpy(ins->opcode, tokens[0]);
+/* Stores one initialized data word at the current data address */
+static int
+emit_word(Assembler* as, int value)
+{
+  int addr = as->data_addr;
+  if (addr < 0 || addr >= DATA_MEMORY_SIZE) {
+    asm_error(as, "data address %d outside data memory", addr);
+    return -1;
+  }
+  if (addr >= as->data_capacity) {
+    int capacity = as->data_capacity ? as->data_capacity : 256;
+    while (capacity <= addr) {
+      capacity *= 2;
+    }
+    int* data = realloc(as->data, sizeof(int) * capacity);
+    if (!data) {
+      asm_error(as, "out of memory");
+      return -1;
+    }
+    memset(data + as->data_capacity, 0,
+           sizeof(int) * (capacity - as->data_capacity));
+    as->data = data;
+    as->data_capacity = capacity;
+  }
+  as->data[addr] = value;
+  if (as->data_high < as->data_low || addr < as->data_low) {
+    as->data_low = addr;
+  }
+  if (addr > as->data_high) {
+    as->data_high = addr;
+  }
+  as->data_addr++;
+  return addr;
+}
 
-  if (strcmp(ins->opcode, "MOVC") == 0) {
-    ins->rd = get_num_from_string(tokens[1]);
-    ins->imm = get_num_from_string(tokens[2]);
+/* Evaluates an expression that has to be known right now */
+static int
+eval_now(Assembler* as, const char* p, const char* end, int* value)
+{
+  Token pending;
+  int sign;
+  int symbolic;
+  if (eval_expr(as, p, end, value, &pending, &sign, &symbolic) != 0) {
+    return -1;
+  }
+  if (pending.begin) {
+    asm_error(as, "'%.*s' must be defined before this line",
+              (int)(pending.end - pending.begin), pending.begin);
+    return -1;
   }
+  return 0;
+}
+
+static void
+start_macro(Assembler* as, const char* p, const char* end)
+{
+  p = skip_space(p, end);
+  const char* name_end = scan_ident(p, end);
+  if (name_end == p) {
+    asm_error(as, ".macro needs a name");
+    return;
+  }
+  if (grow((void**)&as->macros, &as->macro_capacity, as->macro_count,
+           sizeof(*as->macros)) != 0) {
+    asm_error(as, "out of memory");
+    return;
+  }
+
+  Macro* macro = &as->macros[as->macro_count++];
+  memset(macro, 0, sizeof(*macro));
+  macro->name = copy_slice(p, name_end);
+
+  p = name_end;
+  while ((p = skip_space(p, end)) < end) {
+    if (*p == ',') {
+      p++;
+      continue;
+    }
+    const char* param_end = scan_ident(p, end);
+    if (param_end == p || macro->num_params == MAX_MACRO_PARAMS) {
+      asm_error(as, "bad parameter list of macro '%s'", macro->name);
+      break;
+    }
+    macro->params[macro->num_params++] = copy_slice(p, param_end);
+    p = param_end;
+  }
+  as->defining = macro;
+}
+
+static void
+append_macro_line(Assembler* as, const char* p, const char* end)
+{
+  Macro* macro = as->defining;
+  size_t len = end - p;
+  char* body = realloc(macro->body, macro->body_len + len + 1);
+  if (!body) {
+    asm_error(as, "out of memory");
+    return;
+  }
+  memcpy(body + macro->body_len, p, len);
+  body[macro->body_len + len] = '\n';
+  macro->body = body;
+  macro->body_len += len + 1;
+}
+
+static Macro*
+find_macro(Assembler* as, const char* p, const char* end)
+{
+  for (int i = 0; i < as->macro_count; ++i) {
+    if (slice_equals(p, end, as->macros[i].name)) {
+      return &as->macros[i];
+    }
+  }
+  return NULL;
+}
 
-  if (strcmp(ins->opcode, "STORE") == 0) {
-    ins->rs1 = get_num_from_string(tokens[1]);
-    ins->rs2 = get_num_from_string(tokens[2]);
-    ins->imm = get_num_from_string(tokens[3]);
+static void assemble_line(Assembler* as, const char* p, const char* end);
+
+/* Substitutes the arguments into every body line and assembles it */
+static void
+expand_macro(Assembler* as, Macro* macro, const char* p, const char* end)
+{
+  Token args[MAX_MACRO_PARAMS];
+  int num_args = 0;
+  p = skip_space(p, end);
+  if (p < end && *p == ',') {
+    p++;
+  }
+  if (skip_space(p, end) < end) {
+    Token tokens[MAX_TOKENS];
+    num_args = split_tokens(p, end, tokens);
+    for (int i = 0; i < num_args && i < MAX_MACRO_PARAMS; ++i) {
+      args[i] = tokens[i];
+    }
+  }
+  if (num_args != macro->num_params) {
+    asm_error(as, "macro '%s' takes %d arguments, got %d", macro->name,
+              macro->num_params, num_args);
+    return;
   }
+  if (as->depth == MAX_MACRO_DEPTH) {
+    asm_error(as, "macro '%s' nests too deep", macro->name);
+    return;
+  }
+
+  int expansion = ++as->expansion;
+  const char* line = macro->body;
+  const char* body_end = macro->body + macro->body_len;
+  as->depth++;
+  while (line < body_end) {
+    const char* line_end = memchr(line, '\n', body_end - line);
+    char out[MAX_EXPANDED_LINE];
+    int len = 0;
+    int too_long = 0;
 
-  if (strcmp(ins->opcode, "STR") == 0) {
-    ins->rs1 = get_num_from_string(tokens[1]);
-    ins->rs2 = get_num_from_string(tokens[2]);
-    ins->rs3 = get_num_from_string(tokens[3]);
+    /* 16 bytes stay free for the digits of \@ */
+    for (const char* c = line; c < line_end;) {
+      if (len >= MAX_EXPANDED_LINE - 16) {
+        too_long = 1;
+        break;
+      }
+      if (*c != '\\' || c + 1 == line_end) {
+        out[len++] = *c++;
+        continue;
+      }
+      if (c[1] == '@') {
+        len += snprintf(out + len, MAX_EXPANDED_LINE - len, "%d", expansion);
+        c += 2;
+        continue;
+      }
+      const char* name_end = scan_ident(c + 1, line_end);
+      int param = -1;
+      for (int i = 0; i < macro->num_params; ++i) {
+        if (slice_equals(c + 1, name_end, macro->params[i])) {
+          param = i;
+        }
+      }
+      if (param < 0) {
+        out[len++] = *c++;
+        continue;
+      }
+      int arg_len = args[param].end - args[param].begin;
+      if (len + arg_len >= MAX_EXPANDED_LINE - 16) {
+        too_long = 1;
+        break;
+      }
+      memcpy(out + len, args[param].begin, arg_len);
+      len += arg_len;
+      c = name_end;
+    }
+    if (too_long) {
+      asm_error(as, "macro expansion too long");
+    } else {
+      assemble_line(as, out, out + len);
+    }
+    line = line_end + 1;
   }
+  as->depth--;
+}
 
-  if (strcmp(ins->opcode, "ADD") == 0) {
-    ins->rd = get_num_from_string(tokens[1]);
-    ins->rs1 = get_num_from_string(tokens[2]);
-    ins->rs2 = get_num_from_string(tokens[3]);
+static void
+directive(Assembler* as, const char* name, const char* name_end,
+          const char* p, const char* end)
+{
+  if (slice_equals(name, name_end, ".text")) {
+    as->in_data = 0;
+  } else if (slice_equals(name, name_end, ".data")) {
+    as->in_data = 1;
+  } else if (slice_equals(name, name_end, ".word")) {
+    if (!as->in_data) {
+      asm_error(as, ".word outside .data section");
+      return;
+    }
+    while (p < end) {
+      const char* comma = memchr(p, ',', end - p);
+      const char* word_end = comma ? comma : end;
+      int value;
+      Token pending;
+      int sign = 1;
+      int symbolic;
+      if (eval_expr(as, p, word_end, &value, &pending, &sign, &symbolic) ==
+          0) {
+        int addr = emit_word(as, value);
+        if (addr >= 0 && pending.begin) {
+          add_fixup(as, addr, FIXUP_DATA, &pending, sign, value, 0);
+        }
+      }
+      p = comma ? comma + 1 : end;
+    }
+  } else if (slice_equals(name, name_end, ".space")) {
+    int count;
+    if (!as->in_data) {
+      asm_error(as, ".space outside .data section");
+    } else if (eval_now(as, p, end, &count) == 0) {
+      if (count < 0 || as->data_addr + count > DATA_MEMORY_SIZE) {
+        asm_error(as, ".space %d does not fit in data memory", count);
+      } else {
+        as->data_addr += count;
+      }
+    }
+  } else if (slice_equals(name, name_end, ".org")) {
+    int addr;
+    if (!as->in_data) {
+      asm_error(as, ".org is only supported in the .data section");
+    } else if (eval_now(as, p, end, &addr) == 0) {
+      as->data_addr = addr;
+    }
+  } else if (slice_equals(name, name_end, ".equ") ||
+             slice_equals(name, name_end, ".set")) {
+    p = skip_space(p, end);
+    const char* sym_end = scan_ident(p, end);
+    const char* comma = memchr(sym_end, ',', end - sym_end);
+    int value;
+    if (sym_end == p || !comma) {
+      asm_error(as, "expected '%.*s NAME, value'", (int)(name_end - name),
+                name);
+    } else if (eval_now(as, comma + 1, end, &value) == 0) {
+      define_symbol(as, p, sym_end, value);
+    }
+  } else if (slice_equals(name, name_end, ".macro")) {
+    start_macro(as, p, end);
+  } else if (slice_equals(name, name_end, ".endm")) {
+    asm_error(as, ".endm without .macro");
+  } else {
+    asm_error(as, "unknown directive '%.*s'", (int)(name_end - name), name);
   }
+}
 
-  if (strcmp(ins->opcode, "ADDL") == 0) {
-    ins->rd = get_num_from_string(tokens[1]);
-    ins->rs1 = get_num_from_string(tokens[2]);
-    ins->imm = get_num_from_string(tokens[3]);
+/* Assembles one source line, or one line of an expanded macro */
+static void
+assemble_line(Assembler* as, const char* p, const char* end)
+{
+  const char* comment = memchr(p, ';', end - p);
+  if (comment) {
+    end = comment;
   }
+  p = skip_space(p, end);
+  end = trim_end(p, end);
 
-  if (strcmp(ins->opcode, "SUB") == 0) {
-    ins->rd = get_num_from_string(tokens[1]);
-    ins->rs1 = get_num_from_string(tokens[2]);
-    ins->rs2 = get_num_from_string(tokens[3]);
+  if (as->defining) {
+    const char* word_end = scan_ident(p + (p < end && *p == '.'), end);
+    if (slice_equals(p, word_end, ".endm")) {
+      as->defining = NULL;
+    } else if (slice_equals(p, word_end, ".macro")) {
+      asm_error(as, "macro definitions cannot nest");
+    } else {
+      append_macro_line(as, p, end);
+    }
+    return;
   }
 
-  if (strcmp(ins->opcode, "SUBL") == 0) {
-    ins->rd = get_num_from_string(tokens[1]);
-    ins->rs1 = get_num_from_string(tokens[2]);
-    ins->imm = get_num_from_string(tokens[3]);
+  /* Labels, possibly followed by an instruction on the same line */
+  for (;;) {
+    const char* label_end = scan_ident(p, end);
+    const char* colon = skip_space(label_end, end);
+    if (label_end == p || colon == end || *colon != ':') {
+      break;
+    }
+    define_symbol(as, p, label_end, current_address(as));
+    p = skip_space(colon + 1, end);
+  }
+  if (p == end) {
+    return;
   }
 
-  if (strcmp(ins->opcode, "LOAD") == 0) {
-    ins->rd = get_num_from_string(tokens[1]);
-    ins->rs1 = get_num_from_string(tokens[2]);
-    ins->imm = get_num_from_string(tokens[3]);
+  /* Mnemonics end at the first comma or blank */
+  const char* word_end = p + (*p == '.');
+  word_end = scan_ident(word_end, end);
+  if (word_end == p) {
+    word_end = p + 1;
+    while (word_end < end && *word_end != ',' && !is_space(*word_end)) {
+      word_end++;
+    }
   }
 
-  if (strcmp(ins->opcode, "LDR") == 0) {
-    ins->rd = get_num_from_string(tokens[1]);
-    ins->rs1 = get_num_from_string(tokens[2]);
-    ins->rs2 = get_num_from_string(tokens[3]);
+  if (*p == '.') {
+    directive(as, p, word_end, word_end, end);
+    return;
   }
+  int op = APEX_op_lookup(p, word_end - p);
+  if (op == APEX_OP_UNKNOWN) {
+    Macro* macro = find_macro(as, p, word_end);
+    if (macro) {
+      expand_macro(as, macro, word_end, end);
+      return;
+    }
+  }
+  emit_instruction(as, op, p, end);
+}
 
-  if (strcmp(ins->opcode, "AND") == 0) {
-    ins->rd = get_num_from_string(tokens[1]);
-    ins->rs1 = get_num_from_string(tokens[2]);
-    ins->rs2 = get_num_from_string(tokens[3]);
+/* Patches every recorded forward reference, now that all symbols exist */
+static void
+apply_fixups(Assembler* as)
+{
+  for (int i = 0; i < as->fixup_count; ++i) {
+    Fixup* fixup = &as->fixups[i];
+    const char* name = fixup->name;
+    Symbol* symbol = name ? find_symbol(as, name, name + strlen(name)) : NULL;
+    as->line_no = fixup->line_no;
+    if (!symbol) {
+      asm_error(as, "undefined symbol '%s'", name ? name : "");
+      continue;
+    }
+    int value = fixup->addend + fixup->sign * symbol->value;
+    if (fixup->field == FIXUP_DATA) {
+      as->data[fixup->index] = value;
+      continue;
+    }
+    if (fixup->relative) {
+      value -= CODE_BASE + 4 * fixup->index;
+    }
+    set_field(&as->code[fixup->index], fixup->field, value);
   }
+}
 
-  if (strcmp(ins->opcode, "OR") == 0) {
-    ins->rd = get_num_from_string(tokens[1]);
-    ins->rs1 = get_num_from_string(tokens[2]);
-    ins->rs2 = get_num_from_string(tokens[3]);
+static void
+free_assembler(Assembler* as)
+{
+  for (int i = 0; i < as->symbol_capacity; ++i) {
+    free(as->symbols[i].name);
+  }
+  for (int i = 0; i < as->fixup_count; ++i) {
+    free(as->fixups[i].name);
+  }
+  for (int i = 0; i < as->macro_count; ++i) {
+    free(as->macros[i].name);
+    for (int j = 0; j < as->macros[i].num_params; ++j) {
+      free(as->macros[i].params[j]);
+    }
+    free(as->macros[i].body);
   }
+  free(as->symbols);
+  free(as->fixups);
+  free(as->macros);
+  free(as->code);
+  free(as->data);
+}
 
-  if (strcmp(ins->opcode, "XOR") == 0) {
-    ins->rd = get_num_from_string(tokens[1]);
-    ins->rs1 = get_num_from_string(tokens[2]);
-    ins->rs2 = get_num_from_string(tokens[3]);
+/* Moves a finished heap buffer into 'arena' when there is one */
+static void*
+finish_buffer(APEX_Arena* arena, void* buffer, size_t size)
+{
+  if (!arena) {
+    void* shrunk = realloc(buffer, size);
+    return shrunk ? shrunk : buffer;
   }
+  void* copy = APEX_arena_alloc(arena, size);
+  if (copy) {
+    memcpy(copy, buffer, size);
+  }
+  free(buffer);
+  return copy;
+}
 
-  if (strcmp(ins->opcode, "BZ") == 0) {
-    ins->imm = get_num_from_string(tokens[1]);
+/*
+ * Assembles 'length' bytes of source text into 'program'. Code and
+ * data come from 'arena' when one is given. 'name' is only used in
+ * error messages. Returns 0 on success.
+ *
+ * Everything happens in one pass over the text, references to symbols
+ * defined further down are patched at the end.
+ */
+int
+APEX_assemble(APEX_Arena* arena, const char* name, const char* text,
+              size_t length, APEX_Program* program)
+{
+  Assembler as;
+  memset(&as, 0, sizeof(as));
+  memset(program, 0, sizeof(*program));
+  as.filename = name;
+  as.data_low = 0;
+  as.data_high = -1;
+
+  /* Typical lines are 10 to 20 bytes, start from a guess and grow */
+  as.code_capacity = length / 16 + 16;
+  as.code = malloc(sizeof(*as.code) * as.code_capacity);
+  if (!as.code) {
+    return -1;
   }
 
-  if (strcmp(ins->opcode, "BNZ") == 0) {
-    ins->imm = get_num_from_string(tokens[1]);
+  const char* p = text;
+  const char* end = text + length;
+  while (p < end) {
+    const char* newline = memchr(p, '\n', end - p);
+    const char* line_end = newline ? newline : end;
+    as.line_no++;
+    if (!is_blank(p, line_end)) {
+      assemble_line(&as, p, line_end);
+    }
+    p = line_end + 1;
   }
 
-  if (strcmp(ins->opcode, "MUL") == 0) {
-    ins->rd = get_num_from_string(tokens[1]);
-    ins->rs1 = get_num_from_string(tokens[2]);
-    ins->rs2 = get_num_from_string(tokens[3]);
+  if (as.defining) {
+    asm_error(&as, "missing .endm of macro '%s'", as.defining->name);
+  }
+  apply_fixups(&as);
+  if (as.errors || !as.code_size) {
+    free_assembler(&as);
+    return -1;
   }
 
-  if (strcmp(ins->opcode, "JUMP") == 0) {
-    ins->rd = get_num_from_string(tokens[1]);
-    ins->imm = get_num_from_string(tokens[2]);
+  program->code_size = as.code_size;
+  program->code =
+    finish_buffer(arena, as.code, sizeof(*as.code) * as.code_size);
+  as.code = NULL;
+
+  if (as.data_high >= as.data_low) {
+    program->data_base = as.data_low;
+    program->data_size = as.data_high - as.data_low + 1;
+    memmove(as.data, as.data + as.data_low, sizeof(int) * program->data_size);
+    program->data =
+      finish_buffer(arena, as.data, sizeof(int) * program->data_size);
+    as.data = NULL;
   }
+  program->arena = arena;
+  free_assembler(&as);
 
-  if(strcmp(ins->opcode, "HALT") == 0)
-  {
+  if (!program->code || (program->data_size && !program->data)) {
+    APEX_program_release(program);
+    return -1;
   }
+  return 0;
+}
 
-  if(strcmp(ins->opcode, "NOP") == 0)
-  {
+/* Assembles the text file 'filename' */
+static int
+assemble_file(APEX_Arena* arena, const char* filename, APEX_Program* program)
+{
+  size_t length;
+  int mapped;
+  char* text = load_file(filename, &length, &mapped);
+  if (!text) {
+    memset(program, 0, sizeof(*program));
+    return -1;
   }
 
+  int ret = APEX_assemble(arena, filename, text, length, program);
+
+  if (mapped) {
+    munmap(text, length);
+  } else {
+    free(text);
+  }
+  return ret;
 }
 
 /*
  * This function is related to parsing input file
- *
- * Note : You are not supposed to edit this function
  */
 APEX_Instruction*
 create_code_memory(const char* filename, int* size)
 {
-  if (!filename) {
-    return NULL;
-  }
+  return create_code_memory_in(NULL, filename, size);
+}
 
-  FILE* fp = fopen(filename, "r");
-  if (!fp) {
+/*
+ * Same as create_code_memory, but code memory comes from 'arena'
+ * when one is given. Initialized data, if any, is dropped, use
+ * APEX_program_load to keep it.
+ */
+APEX_Instruction*
+create_code_memory_in(APEX_Arena* arena, const char* filename, int* size)
+{
+  APEX_Program program;
+  *size = 0;
+  if (!filename || assemble_file(arena, filename, &program) != 0) {
     return NULL;
   }
+  if (!arena) {
+    free((void*)program.data);
+  }
+  *size = program.code_size;
+  return program.code;
+}
 
-  char* line = NULL;
-  size_t len = 0;
-  ssize_t nread;
-  int code_memory_size = 0;
-
-  while ((nread = getline(&line, &len, fp)) != -1) {
-    code_memory_size++;
+/*
+ * Loads 'filename' into 'program'. An .apexbin file is mapped as is,
+ * anything else is parsed as assembly text. Returns 0 on success.
+ */
+int
+APEX_program_load(APEX_Arena* arena, const char* filename,
+                  APEX_Program* program)
+{
+  memset(program, 0, sizeof(*program));
+  if (!filename) {
+    return -1;
   }
-  *size = code_memory_size;
-  if (!code_memory_size) {
-    fclose(fp);
-    return NULL;
+
+  if (APEXBIN_is_binary(filename)) {
+    return APEXBIN_map(filename, program);
   }
 
-  APEX_Instruction* code_memory =
-    malloc(sizeof(*code_memory) * code_memory_size);
-  if (!code_memory) {
-    fclose(fp);
-    return NULL;
+  return assemble_file(arena, filename, program);
+}
+
+/*
+ * Writes 'program' back out as assembly text that APEX_assemble reads.
+ * Branches keep their numeric offsets. Returns 0 on success.
+ */
+int
+APEX_write_asm(const char* filename, const APEX_Program* program)
+{
+  FILE* fp = fopen(filename, "w");
+  if (!fp) {
+    return -1;
   }
 
-  rewind(fp);
-  int current_instruction = 0;
-  while ((nread = getline(&line, &len, fp)) != -1) {
-    create_APEX_instruction(&code_memory[current_instruction], line);
-    current_instruction++;
+  char line[128];
+  for (int i = 0; i < program->code_size; ++i) {
+    APEX_disassemble(&program->code[i], line, sizeof(line));
+    fprintf(fp, "%s\n", line);
   }
+  if (program->data_size) {
+    fprintf(fp, ".data\n.org %d\n", program->data_base);
+    for (int i = 0; i < program->data_size; ++i) {
+      fprintf(fp, "%s%d", i % 8 ? ", " : ".word ", program->data[i]);
+      if (i % 8 == 7 || i == program->data_size - 1) {
+        fprintf(fp, "\n");
+      }
+    }
+  }
+  return fclose(fp) == 0 ? 0 : -1;
+}
 
-  free(line);
-  fclose(fp);
-  return code_memory;
+/* Releases what APEX_program_load allocated or mapped */
+void
+APEX_program_release(APEX_Program* program)
+{
+  if (program->mapping) {
+    munmap(program->mapping, program->mapping_size);
+  } else if (!program->arena) {
+    free(program->code);
+    free((void*)program->data);
+  }
+  memset(program, 0, sizeof(*program));
 }
@@ -0,0 +1,872 @@
+/*
+ *  functional.c
+ *  Contains the functional engine and the decoupled run, which
+ *  executes the program on one host thread and times it on another
+ *
+ *  State University of New York, Binghamton
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "functional.h"
+#include "isa.h"
+
+/* Wrapping arithmetic, like the int arithmetic of the pipeline */
+static int
+wrap_add(int a, int b)
+{
+  return (int)((unsigned int)a + (unsigned int)b);
+}
+
+static int
+wrap_sub(int a, int b)
+{
+  return (int)((unsigned int)a - (unsigned int)b);
+}
+
+static int
+wrap_mul(int a, int b)
+{
+  return (int)((unsigned int)a * (unsigned int)b);
+}
+
+/*
+ * Executes the instruction at cpu->pc and describes it in '*op'.
+ * Results are those the pipeline computes, OR and XOR included, which
+ * take the literal as second operand. Two effects of cpu.c are
+ * simplified:
+ *
+ *  - BZ/BNZ clear the zero flag when they execute, where the pipeline
+ *    clears it when they reach writeback, after younger ADD, SUB or MUL
+ *    may have set it,
+ *  - JUMP continues at R[rd] + literal, where the pipeline also keeps
+ *    fetching after it.
+ *
+ * Returns 1, or 0 once HALT executed or the pc left the code.
+ */
+int
+APEX_functional_step(APEX_CPU* cpu, APEX_ReplayOp* op)
+{
+  int index = (cpu->pc - 4000) / 4;
+  if (cpu->halt || cpu->pc < 4000 || index >= cpu->program.code_size) {
+    return 0;
+  }
+  const APEX_Instruction* ins = &cpu->program.code[index];
+  const APEX_OpInfo* info = &APEX_op_info[ins->op];
+  int* regs = cpu->regs;
+  int next = cpu->pc + 4;
+  int value = 0;
+  int address = 0;
+  int taken = 0;
+
+  switch (ins->op) {
+    case APEX_OP_MOVC:
+      value = ins->imm;
+      break;
+    case APEX_OP_ADD:
+      value = wrap_add(regs[ins->rs1], regs[ins->rs2]);
+      break;
+    case APEX_OP_ADDL:
+      value = wrap_add(regs[ins->rs1], ins->imm);
+      break;
+    case APEX_OP_SUB:
+      value = wrap_sub(regs[ins->rs1], regs[ins->rs2]);
+      break;
+    case APEX_OP_SUBL:
+      value = wrap_sub(regs[ins->rs1], ins->imm);
+      break;
+    case APEX_OP_MUL:
+      value = wrap_mul(regs[ins->rs1], regs[ins->rs2]);
+      break;
+    case APEX_OP_AND:
+      value = regs[ins->rs1] & regs[ins->rs2];
+      break;
+    case APEX_OP_OR:
+      value = regs[ins->rs1] | ins->imm;
+      break;
+    case APEX_OP_XOR:
+      value = regs[ins->rs1] ^ ins->imm;
+      break;
+    case APEX_OP_LOAD:
+      address = wrap_add(regs[ins->rs1], ins->imm);
+      value = APEX_mem_read(cpu, address);
+      break;
+    case APEX_OP_LDR:
+      address = wrap_add(regs[ins->rs1], regs[ins->rs2]);
+      value = APEX_mem_read(cpu, address);
+      break;
+    case APEX_OP_STORE:
+      address = wrap_add(regs[ins->rs2], ins->imm);
+      APEX_mem_write(cpu, address, regs[ins->rs1]);
+      break;
+    case APEX_OP_STR:
+      address = wrap_add(regs[ins->rs2], regs[ins->rs3]);
+      APEX_mem_write(cpu, address, regs[ins->rs1]);
+      break;
+    case APEX_OP_BZ:
+    case APEX_OP_BNZ:
+      taken = ins->op == APEX_OP_BZ ? cpu->zero_flag : !cpu->zero_flag;
+      if (taken) {
+        int target = abs(cpu->pc + ins->imm);
+        next = target - target % 4;
+      }
+      cpu->zero_flag = 0;
+      break;
+    case APEX_OP_JUMP: {
+      int target = wrap_add(regs[ins->rd], ins->imm);
+      next = target - target % 4;
+      break;
+    }
+    case APEX_OP_HALT:
+      cpu->halt = 1;
+      break;
+    default:
+      break;
+  }
+
+  if (info->writes_rd) {
+    regs[ins->rd] = value;
+    APEX_state_commit(cpu, ins->rd, value);
+  }
+  if (info->sets_zero) {
+    cpu->zero_flag = value == 0;
+  }
+  if (ins->op != APEX_OP_NOP) {
+    cpu->retired++;
+  }
+
+  op->index = index;
+  op->address = address;
+  op->value = value;
+  op->redirect = next != cpu->pc + 4;
+  cpu->pc = next;
+  return 1;
+}
+
+/* What a micro-op does, literals are read through the same pointers */
+enum
+{
+  UOP_MOV,
+  UOP_ADD,
+  UOP_ADDZ,			// Z: also sets the zero flag
+  UOP_SUB,
+  UOP_SUBZ,
+  UOP_MULZ,
+  UOP_AND,
+  UOP_OR,
+  UOP_XOR,
+  UOP_LOAD,			// dst = MEM[a + b]
+  UOP_STORE			// MEM[b + c] = a
+};
+
+/* How a block ends */
+enum
+{
+  EXIT_FALL,			// Runs into the next block
+  EXIT_BZ,
+  EXIT_BNZ,
+  EXIT_JUMP,
+  EXIT_HALT
+};
+
+typedef struct MicroOp
+{
+  int kind;			// UOP_*
+  int* dst;
+  const int* a;			// A register, or 'imm' below
+  const int* b;
+  const int* c;
+  int imm;
+} MicroOp;
+
+typedef struct APEX_Block
+{
+  MicroOp* uops;
+  int num_uops;
+  int retired;			// Instructions it retires, NOPs excluded
+  int exit;			// EXIT_*
+  const int* jump_base;		// Register a JUMP adds its literal to
+  int jump_imm;
+  int fall;			// Code index after the block
+  int target_pc;		// Pc of a taken BZ/BNZ
+  int target;			// Its code index, -1 outside the code
+  struct APEX_Block* fall_block;	// Chained successors, NULL until used
+  struct APEX_Block* target_block;
+} APEX_Block;
+
+/*
+ * Sets up an empty block cache for 'cpu'. Blocks are translated the
+ * first time they run. Returns 0, or -1 if it can not be allocated.
+ */
+int
+APEX_block_cache_init(APEX_BlockCache* cache, APEX_CPU* cpu)
+{
+  cache->cpu = cpu;
+  cache->code_size = cpu->program.code_size;
+  cache->translated = 0;
+  APEX_arena_init(&cache->arena, 0);
+  cache->blocks = APEX_arena_calloc(&cache->arena, cache->code_size + 1,
+                                    sizeof(APEX_Block*));
+  return cache->blocks ? 0 : -1;
+}
+
+void
+APEX_block_cache_release(APEX_BlockCache* cache)
+{
+  APEX_arena_release(&cache->arena);
+  cache->blocks = NULL;
+}
+
+/*
+ * Translates the block starting at code index 'start': the instructions
+ * up to the first BZ, BNZ, JUMP or HALT, at most APEX_BLOCK_LIMIT.
+ * Register operands become pointers into the register file and
+ * literals pointers to the micro-op's own copy. Returns NULL when out
+ * of memory.
+ */
+static APEX_Block*
+translate(APEX_BlockCache* cache, int start)
+{
+  APEX_CPU* cpu = cache->cpu;
+  int* regs = cpu->regs;
+  int end = start;
+  while (end < cache->code_size && end - start < APEX_BLOCK_LIMIT) {
+    int op_class = APEX_op_info[cpu->program.code[end++].op].op_class;
+    if (op_class == APEX_CLASS_BRANCH || op_class == APEX_CLASS_JUMP ||
+        op_class == APEX_CLASS_HALT) {
+      break;
+    }
+  }
+
+  APEX_Block* block = APEX_arena_calloc(&cache->arena, 1, sizeof(*block));
+  MicroOp* uops = APEX_arena_calloc(&cache->arena, end - start,
+                                    sizeof(*uops));
+  if (!block || !uops) {
+    return NULL;
+  }
+  block->uops = uops;
+  block->exit = EXIT_FALL;
+  block->fall = end;
+  block->target = -1;
+
+  for (int index = start; index < end; ++index) {
+    const APEX_Instruction* ins = &cpu->program.code[index];
+    MicroOp* u = &uops[block->num_uops];
+    u->imm = ins->imm;
+    u->dst = &regs[ins->rd];
+    u->a = &regs[ins->rs1];
+    u->b = &regs[ins->rs2];
+    if (ins->op != APEX_OP_NOP) {
+      block->retired++;
+    }
+    switch (ins->op) {
+      case APEX_OP_MOVC:
+        u->kind = UOP_MOV;
+        u->a = &u->imm;
+        break;
+      case APEX_OP_ADD:
+        u->kind = UOP_ADDZ;
+        break;
+      case APEX_OP_ADDL:
+        u->kind = UOP_ADD;
+        u->b = &u->imm;
+        break;
+      case APEX_OP_SUB:
+        u->kind = UOP_SUBZ;
+        break;
+      case APEX_OP_SUBL:
+        u->kind = UOP_SUB;
+        u->b = &u->imm;
+        break;
+      case APEX_OP_MUL:
+        u->kind = UOP_MULZ;
+        break;
+      case APEX_OP_AND:
+        u->kind = UOP_AND;
+        break;
+      case APEX_OP_OR:
+        u->kind = UOP_OR;
+        u->b = &u->imm;
+        break;
+      case APEX_OP_XOR:
+        u->kind = UOP_XOR;
+        u->b = &u->imm;
+        break;
+      case APEX_OP_LOAD:
+        u->kind = UOP_LOAD;
+        u->b = &u->imm;
+        break;
+      case APEX_OP_LDR:
+        u->kind = UOP_LOAD;
+        break;
+      case APEX_OP_STORE:
+        u->kind = UOP_STORE;
+        u->c = &u->imm;
+        break;
+      case APEX_OP_STR:
+        u->kind = UOP_STORE;
+        u->c = &regs[ins->rs3];
+        break;
+      case APEX_OP_BZ:
+      case APEX_OP_BNZ: {
+        int target = abs(4000 + 4 * index + ins->imm);
+        block->exit = ins->op == APEX_OP_BZ ? EXIT_BZ : EXIT_BNZ;
+        block->target_pc = target - target % 4;
+        if (block->target_pc >= 4000 &&
+            (block->target_pc - 4000) / 4 < cache->code_size) {
+          block->target = (block->target_pc - 4000) / 4;
+        }
+        continue;
+      }
+      case APEX_OP_JUMP:
+        block->exit = EXIT_JUMP;
+        block->jump_base = &regs[ins->rd];
+        block->jump_imm = ins->imm;
+        continue;
+      case APEX_OP_HALT:
+        block->exit = EXIT_HALT;
+        continue;
+      default:
+        continue;
+    }
+    block->num_uops++;
+  }
+  cache->translated++;
+  cache->blocks[start] = block;
+  return block;
+}
+
+/* Block at code index 'index', translated on first use */
+static APEX_Block*
+lookup(APEX_BlockCache* cache, int index)
+{
+  APEX_Block* block = cache->blocks[index];
+  return block ? block : translate(cache, index);
+}
+
+/*
+ * Runs the cpu of 'cache' functionally for at most 'limit' instructions,
+ * with the semantics of APEX_functional_step, until HALT or the pc
+ * leaving the code. Whole blocks run from their micro-ops and jump
+ * straight to the block that follows, whose pointer is kept in the
+ * block after its first use; only JUMP looks its target up. A block
+ * that would cross 'limit' runs an instruction at a time. Returns the
+ * instructions retired, or -1 when a block can not be translated.
+ */
+long long
+APEX_functional_run(APEX_BlockCache* cache, long long limit)
+{
+  APEX_CPU* cpu = cache->cpu;
+  long long first = cpu->retired;
+  long long retired = cpu->retired;
+  int zero = cpu->zero_flag;
+  APEX_Block* block = NULL;
+  int failed = 0;
+
+  while (!cpu->halt) {
+    int index = (cpu->pc - 4000) / 4;
+    if (cpu->pc < 4000 || index >= cache->code_size) {
+      break;
+    }
+    if (!block && !(block = lookup(cache, index))) {
+      failed = 1;
+      break;
+    }
+    if (retired - first + block->retired > limit) {
+      /* The last few instructions, one at a time */
+      APEX_ReplayOp op;
+      cpu->zero_flag = zero;
+      cpu->retired = retired;
+      while (cpu->retired - first < limit && APEX_functional_step(cpu, &op)) {
+      }
+      retired = cpu->retired;
+      zero = cpu->zero_flag;
+      break;
+    }
+
+    for (const MicroOp* u = block->uops; u < block->uops + block->num_uops;
+         ++u) {
+      switch (u->kind) {
+        case UOP_MOV:
+          *u->dst = *u->a;
+          break;
+        case UOP_ADD:
+          *u->dst = wrap_add(*u->a, *u->b);
+          break;
+        case UOP_ADDZ:
+          *u->dst = wrap_add(*u->a, *u->b);
+          zero = *u->dst == 0;
+          break;
+        case UOP_SUB:
+          *u->dst = wrap_sub(*u->a, *u->b);
+          break;
+        case UOP_SUBZ:
+          *u->dst = wrap_sub(*u->a, *u->b);
+          zero = *u->dst == 0;
+          break;
+        case UOP_MULZ:
+          *u->dst = wrap_mul(*u->a, *u->b);
+          zero = *u->dst == 0;
+          break;
+        case UOP_AND:
+          *u->dst = *u->a & *u->b;
+          break;
+        case UOP_OR:
+          *u->dst = *u->a | *u->b;
+          break;
+        case UOP_XOR:
+          *u->dst = *u->a ^ *u->b;
+          break;
+        case UOP_LOAD:
+          *u->dst = APEX_mem_read(cpu, wrap_add(*u->a, *u->b));
+          break;
+        case UOP_STORE:
+          APEX_mem_write(cpu, wrap_add(*u->b, *u->c), *u->a);
+          break;
+      }
+    }
+    retired += block->retired;
+
+    APEX_Block* next = NULL;
+    int taken = 0;
+    switch (block->exit) {
+      case EXIT_FALL:
+        cpu->pc = 4000 + 4 * block->fall;
+        if (block->fall < cache->code_size) {
+          if (!block->fall_block) {
+            block->fall_block = lookup(cache, block->fall);
+          }
+          next = block->fall_block;
+        }
+        break;
+      case EXIT_BZ:
+      case EXIT_BNZ:
+        taken = block->exit == EXIT_BZ ? zero : !zero;
+        zero = 0;
+        if (!taken) {
+          cpu->pc = 4000 + 4 * block->fall;
+          if (block->fall < cache->code_size) {
+            if (!block->fall_block) {
+              block->fall_block = lookup(cache, block->fall);
+            }
+            next = block->fall_block;
+          }
+        } else {
+          cpu->pc = block->target_pc;
+          if (block->target >= 0) {
+            if (!block->target_block) {
+              block->target_block = lookup(cache, block->target);
+            }
+            next = block->target_block;
+          }
+        }
+        break;
+      case EXIT_JUMP: {
+        int target = wrap_add(*block->jump_base, block->jump_imm);
+        cpu->pc = target - target % 4;
+        break;
+      }
+      case EXIT_HALT:
+        cpu->pc = 4000 + 4 * block->fall;
+        cpu->halt = 1;
+        break;
+    }
+    block = next;
+  }
+
+  cpu->zero_flag = zero;
+  cpu->retired = retired;
+  /* Block results bypass APEX_state_commit, which only keeps state */
+  for (int r = 0; r < 32; ++r) {
+    APEX_state_commit(cpu, r, cpu->regs[r]);
+  }
+  return failed ? -1 : retired - first;
+}
+
+/*
+ * The interpreter dispatches through a table of handler addresses with
+ * GCC's labels as values; other compilers, or a build with
+ * -DAPEX_SWITCH_DISPATCH, get a switch over the opcode.
+ */
+#if defined(__GNUC__) && !defined(APEX_SWITCH_DISPATCH)
+#define APEX_THREADED_DISPATCH 1
+#endif
+
+#ifdef APEX_THREADED_DISPATCH
+#define HANDLER(name) op_##name:
+#define DISPATCH()                                                             \
+  do {                                                                         \
+    ins = &code[index];                                                        \
+    goto* thread[index];                                                       \
+  } while (0)
+#else
+#define HANDLER(name) case APEX_OP_##name:
+#define DISPATCH() goto dispatch
+#endif
+
+/* Retires the instruction and continues at 'target' */
+#define RETIRE_TO(target)                                                      \
+  do {                                                                         \
+    int pc_ = (target);                                                        \
+    retired++;                                                                 \
+    if (pc_ < 4000 || (pc_ - 4000) / 4 >= size) {                              \
+      cpu->pc = pc_;                                                           \
+      goto leave;                                                              \
+    }                                                                          \
+    index = (pc_ - 4000) / 4;                                                  \
+    if (retired == limit) {                                                    \
+      goto done;                                                               \
+    }                                                                          \
+    DISPATCH();                                                                \
+  } while (0)
+
+/* Retires the instruction and continues with the next one */
+#define RETIRE()                                                               \
+  do {                                                                         \
+    retired++;                                                                 \
+    index++;                                                                   \
+    if (retired == limit) {                                                    \
+      goto done;                                                               \
+    }                                                                          \
+    DISPATCH();                                                                \
+  } while (0)
+
+/*
+ * Runs 'cpu' functionally for at most 'limit' instructions with the
+ * semantics of APEX_functional_step, straight from code memory. With
+ * threaded dispatch the code is first turned into one handler address
+ * per instruction, plus one past the end that stops the run, and every
+ * handler jumps to the next one itself, so each has its own indirect
+ * branch for the host to predict. There is no translation to amortize,
+ * which suits short runs better than APEX_functional_run. Returns the
+ * instructions retired, or -1 if the handler table can not be
+ * allocated.
+ */
+long long
+APEX_functional_interpret(APEX_CPU* cpu, long long limit)
+{
+  const APEX_Instruction* code = cpu->program.code;
+  const APEX_Instruction* ins;
+  int size = cpu->program.code_size;
+  int* regs = cpu->regs;
+  int zero = cpu->zero_flag;
+  int index = (cpu->pc - 4000) / 4;
+  long long retired = 0;
+
+  if (limit <= 0 || cpu->halt || cpu->pc < 4000 || index >= size) {
+    return 0;
+  }
+
+#ifdef APEX_THREADED_DISPATCH
+  static void* const handlers[APEX_NUM_OPS] = {
+    [APEX_OP_UNKNOWN] = &&op_UNKNOWN, [APEX_OP_MOVC] = &&op_MOVC,
+    [APEX_OP_STORE] = &&op_STORE,     [APEX_OP_STR] = &&op_STR,
+    [APEX_OP_ADD] = &&op_ADD,         [APEX_OP_ADDL] = &&op_ADDL,
+    [APEX_OP_SUB] = &&op_SUB,         [APEX_OP_SUBL] = &&op_SUBL,
+    [APEX_OP_LOAD] = &&op_LOAD,       [APEX_OP_LDR] = &&op_LDR,
+    [APEX_OP_AND] = &&op_AND,         [APEX_OP_OR] = &&op_OR,
+    [APEX_OP_XOR] = &&op_XOR,         [APEX_OP_BZ] = &&op_BZ,
+    [APEX_OP_BNZ] = &&op_BNZ,         [APEX_OP_MUL] = &&op_MUL,
+    [APEX_OP_JUMP] = &&op_JUMP,       [APEX_OP_HALT] = &&op_HALT,
+    [APEX_OP_NOP] = &&op_NOP,
+  };
+  void** thread = malloc(sizeof(void*) * (size + 1));
+  if (!thread) {
+    return -1;
+  }
+  for (int i = 0; i < size; ++i) {
+    thread[i] = handlers[code[i].op];
+  }
+  thread[size] = &&op_end;
+  DISPATCH();
+#else
+dispatch:
+  if (index >= size) {
+    goto done;
+  }
+  ins = &code[index];
+  switch (ins->op) {
+#endif
+
+  HANDLER(MOVC)
+  {
+    regs[ins->rd] = ins->imm;
+    RETIRE();
+  }
+  HANDLER(ADD)
+  {
+    regs[ins->rd] = wrap_add(regs[ins->rs1], regs[ins->rs2]);
+    zero = regs[ins->rd] == 0;
+    RETIRE();
+  }
+  HANDLER(ADDL)
+  {
+    regs[ins->rd] = wrap_add(regs[ins->rs1], ins->imm);
+    RETIRE();
+  }
+  HANDLER(SUB)
+  {
+    regs[ins->rd] = wrap_sub(regs[ins->rs1], regs[ins->rs2]);
+    zero = regs[ins->rd] == 0;
+    RETIRE();
+  }
+  HANDLER(SUBL)
+  {
+    regs[ins->rd] = wrap_sub(regs[ins->rs1], ins->imm);
+    RETIRE();
+  }
+  HANDLER(MUL)
+  {
+    regs[ins->rd] = wrap_mul(regs[ins->rs1], regs[ins->rs2]);
+    zero = regs[ins->rd] == 0;
+    RETIRE();
+  }
+  HANDLER(AND)
+  {
+    regs[ins->rd] = regs[ins->rs1] & regs[ins->rs2];
+    RETIRE();
+  }
+  HANDLER(OR)
+  {
+    regs[ins->rd] = regs[ins->rs1] | ins->imm;
+    RETIRE();
+  }
+  HANDLER(XOR)
+  {
+    regs[ins->rd] = regs[ins->rs1] ^ ins->imm;
+    RETIRE();
+  }
+  HANDLER(LOAD)
+  {
+    regs[ins->rd] = APEX_mem_read(cpu, wrap_add(regs[ins->rs1], ins->imm));
+    RETIRE();
+  }
+  HANDLER(LDR)
+  {
+    regs[ins->rd] =
+      APEX_mem_read(cpu, wrap_add(regs[ins->rs1], regs[ins->rs2]));
+    RETIRE();
+  }
+  HANDLER(STORE)
+  {
+    APEX_mem_write(cpu, wrap_add(regs[ins->rs2], ins->imm), regs[ins->rs1]);
+    RETIRE();
+  }
+  HANDLER(STR)
+  {
+    APEX_mem_write(cpu, wrap_add(regs[ins->rs2], regs[ins->rs3]),
+                   regs[ins->rs1]);
+    RETIRE();
+  }
+  HANDLER(BZ)
+  {
+    int taken = zero;
+    zero = 0;
+    if (taken) {
+      int target = abs(4000 + 4 * index + ins->imm);
+      RETIRE_TO(target - target % 4);
+    }
+    RETIRE();
+  }
+  HANDLER(BNZ)
+  {
+    int taken = !zero;
+    zero = 0;
+    if (taken) {
+      int target = abs(4000 + 4 * index + ins->imm);
+      RETIRE_TO(target - target % 4);
+    }
+    RETIRE();
+  }
+  HANDLER(JUMP)
+  {
+    int target = wrap_add(regs[ins->rd], ins->imm);
+    RETIRE_TO(target - target % 4);
+  }
+  HANDLER(HALT)
+  {
+    cpu->halt = 1;
+    retired++;
+    index++;
+    goto done;
+  }
+  HANDLER(NOP)
+  {
+    index++;
+    DISPATCH();
+  }
+  HANDLER(UNKNOWN)
+  {
+    RETIRE();
+  }
+
+#ifdef APEX_THREADED_DISPATCH
+op_end:
+  goto done;
+#else
+  }
+#endif
+
+done:
+  cpu->pc = 4000 + 4 * index;
+leave:
+#ifdef APEX_THREADED_DISPATCH
+  free(thread);
+#endif
+  cpu->zero_flag = zero;
+  cpu->retired += retired;
+  /* Results bypass APEX_state_commit, which only keeps state */
+  for (int r = 0; r < 32; ++r) {
+    APEX_state_commit(cpu, r, regs[r]);
+  }
+  return retired;
+}
+
+#undef RETIRE
+#undef RETIRE_TO
+#undef DISPATCH
+#undef HANDLER
+
+/*
+ * Single producer, single consumer ring of ops. The engine owns 'head'
+ * and the timing model 'tail', each on its own cache line; a slot is
+ * only read after the acquire of the 'head' that covers it, and only
+ * overwritten after the acquire of the 'tail' that freed it.
+ */
+typedef struct OpRing
+{
+  APEX_ReplayOp ops[APEX_FUNCTIONAL_RING];
+  _Alignas(64) atomic_ulong head;	// Ops the engine published
+  _Alignas(64) atomic_ulong tail;	// Ops the timing model is done with
+  _Alignas(64) atomic_int done;		// The engine stopped, 'head' is final
+  atomic_int stop;			// The timing model reached the cycle limit
+  APEX_CPU* cpu;
+  long long limit;			// Ops the engine executes at most
+} OpRing;
+
+/* Engine thread: executes and publishes ops a batch at a time */
+static void*
+engine_run(void* arg)
+{
+  OpRing* ring = arg;
+  unsigned long head = 0;
+  int running = 1;
+
+  while (running) {
+    while (head - atomic_load_explicit(&ring->tail, memory_order_acquire) >
+           APEX_FUNCTIONAL_RING - APEX_FUNCTIONAL_BATCH) {
+      if (atomic_load_explicit(&ring->stop, memory_order_relaxed)) {
+        running = 0;
+        break;
+      }
+      sched_yield();
+    }
+    for (int i = 0; running && i < APEX_FUNCTIONAL_BATCH; ++i) {
+      APEX_ReplayOp* op = &ring->ops[head & (APEX_FUNCTIONAL_RING - 1)];
+      if ((long long)head == ring->limit ||
+          !APEX_functional_step(ring->cpu, op)) {
+        running = 0;
+        break;
+      }
+      head++;
+    }
+    atomic_store_explicit(&ring->head, head, memory_order_release);
+    if (atomic_load_explicit(&ring->stop, memory_order_relaxed)) {
+      running = 0;
+    }
+  }
+  atomic_store_explicit(&ring->done, 1, memory_order_release);
+  return NULL;
+}
+
+/*
+ * Runs the program of 'cpu' functional first: an engine thread
+ * executes it and streams the ops through the ring, the calling thread
+ * times them with APEX_steady_step as they arrive, which skips the
+ * detailed timing of loop iterations once the pipeline repeats itself.
+ * The run ends when HALT retires or the timing model reaches cpu->clk
+ * cycles. Since no instruction takes less than a cycle, the engine
+ * stops after cpu->clk instructions; when the cycle limit ends the run,
+ * the registers and memory may hold the results of a few instructions
+ * past it.
+ *
+ * Leaves the result in 'result', cpu->clock and cpu->retired. Returns
+ * 0, or -1 if the ring, the cache or the thread can not be set up.
+ */
+int
+APEX_decoupled_run(APEX_CPU* cpu, const APEX_TimingConfig* config,
+                   APEX_ReplayResult* result)
+{
+  APEX_SteadyState* state = malloc(sizeof(*state));
+  if (!state) {
+    return -1;
+  }
+  if (APEX_steady_init(state, config, &cpu->program) < 0) {
+    free(state);
+    return -1;
+  }
+  OpRing* ring = aligned_alloc(64, sizeof(OpRing));
+  if (!ring) {
+    APEX_steady_finish(state, result);
+    free(state);
+    return -1;
+  }
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  atomic_init(&ring->done, 0);
+  atomic_init(&ring->stop, 0);
+  ring->cpu = cpu;
+  ring->limit = cpu->clk;
+
+  pthread_t engine;
+  if (pthread_create(&engine, NULL, engine_run, ring) != 0) {
+    free(ring);
+    APEX_steady_finish(state, result);
+    free(state);
+    return -1;
+  }
+
+  unsigned long tail = 0;
+  int limited = 0;
+  while (!limited) {
+    unsigned long head = atomic_load_explicit(&ring->head,
+                                              memory_order_acquire);
+    if (tail == head) {
+      if (!atomic_load_explicit(&ring->done, memory_order_acquire)) {
+        sched_yield();
+        continue;
+      }
+      head = atomic_load_explicit(&ring->head, memory_order_acquire);
+      if (tail == head) {
+        break;
+      }
+    }
+    for (; tail < head; ++tail) {
+      const APEX_ReplayOp* op = &ring->ops[tail & (APEX_FUNCTIONAL_RING - 1)];
+      if (APEX_steady_step(state, op) >= cpu->clk) {
+        limited = 1;
+        break;
+      }
+    }
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+  }
+  if (limited) {
+    atomic_store_explicit(&ring->stop, 1, memory_order_relaxed);
+  }
+  pthread_join(engine, NULL);
+  free(ring);
+
+  APEX_steady_finish(state, result);
+  free(state);
+  if (limited) {
+    /* The op that crossed the limit had not retired by then */
+    result->instructions--;
+    result->cycles = cpu->clk;
+  }
+  cpu->clock = (int)result->cycles;
+  cpu->retired = result->instructions;
+  return 0;
+}
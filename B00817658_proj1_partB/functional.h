@@ -0,0 +1,60 @@
+#ifndef _APEX_FUNCTIONAL_H_
+#define _APEX_FUNCTIONAL_H_
+/**
+ *  functional.h
+ *  Functional engine: executes the program one instruction at a time
+ *  on the register file and data memory of an APEX_CPU, without any
+ *  pipeline, and describes every instruction as an APEX_ReplayOp. The
+ *  decoupled run feeds those ops through a lock-free ring to the
+ *  replay model of timing.h on a second host thread. For plain fast
+ *  runs the engine translates basic blocks into micro-ops once and
+ *  chains them, see APEX_functional_run, or interprets the code with
+ *  threaded dispatch, see APEX_functional_interpret.
+ *
+ *  State University of New York, Binghamton
+ */
+#include "arena.h"
+#include "cpu.h"
+#include "timing.h"
+
+/* Ops in flight between the engine and the timing model, a power of two */
+#define APEX_FUNCTIONAL_RING (1 << 12)
+
+/* Ops the engine executes before publishing them */
+#define APEX_FUNCTIONAL_BATCH 256
+
+/* Instructions a translated block holds at most */
+#define APEX_BLOCK_LIMIT 64
+
+struct APEX_Block;
+
+/* Translated blocks of one cpu, their operands point at its registers */
+typedef struct APEX_BlockCache
+{
+  APEX_CPU* cpu;
+  APEX_Arena arena;		// Blocks and their micro-ops
+  struct APEX_Block** blocks;	// Block starting at each code index, or NULL
+  int code_size;
+  long long translated;		// Blocks translated so far
+} APEX_BlockCache;
+
+int
+APEX_functional_step(APEX_CPU* cpu, APEX_ReplayOp* op);
+
+int
+APEX_block_cache_init(APEX_BlockCache* cache, APEX_CPU* cpu);
+
+void
+APEX_block_cache_release(APEX_BlockCache* cache);
+
+long long
+APEX_functional_run(APEX_BlockCache* cache, long long limit);
+
+long long
+APEX_functional_interpret(APEX_CPU* cpu, long long limit);
+
+int
+APEX_decoupled_run(APEX_CPU* cpu, const APEX_TimingConfig* config,
+                   APEX_ReplayResult* result);
+
+#endif
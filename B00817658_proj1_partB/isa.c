@@ -0,0 +1,142 @@
+/*
+ *  isa.c
+ *  Contains the opcode table of the APEX instruction set
+ *
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "isa.h"
+
+#define RD APEX_FIELD_RD
+#define RS1 APEX_FIELD_RS1
+#define RS2 APEX_FIELD_RS2
+#define RS3 APEX_FIELD_RS3
+#define IMM APEX_FIELD_IMM
+
+const APEX_OpInfo APEX_op_info[APEX_NUM_OPS] = {
+  /*            name     operands          class               rd zero */
+  [APEX_OP_UNKNOWN] = { "", { 0 }, APEX_CLASS_NONE, 0, 0 },
+  [APEX_OP_MOVC] = { "MOVC", { RD, IMM }, APEX_CLASS_ALU, 1, 0 },
+  [APEX_OP_STORE] = { "STORE", { RS1, RS2, IMM }, APEX_CLASS_STORE, 0, 0 },
+  [APEX_OP_STR] = { "STR", { RS1, RS2, RS3 }, APEX_CLASS_STORE, 0, 0 },
+  [APEX_OP_ADD] = { "ADD", { RD, RS1, RS2 }, APEX_CLASS_ALU, 1, 1 },
+  [APEX_OP_ADDL] = { "ADDL", { RD, RS1, IMM }, APEX_CLASS_ALU, 1, 0 },
+  [APEX_OP_SUB] = { "SUB", { RD, RS1, RS2 }, APEX_CLASS_ALU, 1, 1 },
+  [APEX_OP_SUBL] = { "SUBL", { RD, RS1, IMM }, APEX_CLASS_ALU, 1, 0 },
+  [APEX_OP_LOAD] = { "LOAD", { RD, RS1, IMM }, APEX_CLASS_LOAD, 1, 0 },
+  [APEX_OP_LDR] = { "LDR", { RD, RS1, RS2 }, APEX_CLASS_LOAD, 1, 0 },
+  [APEX_OP_AND] = { "AND", { RD, RS1, RS2 }, APEX_CLASS_ALU, 1, 0 },
+  [APEX_OP_OR] = { "OR", { RD, RS1, RS2 }, APEX_CLASS_ALU, 1, 0 },
+  [APEX_OP_XOR] = { "XOR", { RD, RS1, RS2 }, APEX_CLASS_ALU, 1, 0 },
+  [APEX_OP_BZ] = { "BZ", { IMM }, APEX_CLASS_BRANCH, 0, 0 },
+  [APEX_OP_BNZ] = { "BNZ", { IMM }, APEX_CLASS_BRANCH, 0, 0 },
+  [APEX_OP_MUL] = { "MUL", { RD, RS1, RS2 }, APEX_CLASS_ALU, 1, 1 },
+  [APEX_OP_JUMP] = { "JUMP", { RD, IMM }, APEX_CLASS_JUMP, 0, 0 },
+  [APEX_OP_HALT] = { "HALT", { 0 }, APEX_CLASS_HALT, 0, 0 },
+  [APEX_OP_NOP] = { "NOP", { 0 }, APEX_CLASS_NONE, 0, 0 },
+};
+
+#undef RD
+#undef RS1
+#undef RS2
+#undef RS3
+#undef IMM
+
+/*
+ * Maps a mnemonic of 'len' characters (not necessarily NUL terminated)
+ * to its opcode number, APEX_OP_UNKNOWN if there is none
+ */
+int
+APEX_op_lookup(const char* name, size_t len)
+{
+  if (!len) {
+    return APEX_OP_UNKNOWN;
+  }
+  for (int op = 1; op < APEX_NUM_OPS; ++op) {
+    const char* mnemonic = APEX_op_info[op].name;
+    if (mnemonic[0] == name[0] && strncmp(mnemonic, name, len) == 0 &&
+        mnemonic[len] == '\0') {
+      return op;
+    }
+  }
+  return APEX_OP_UNKNOWN;
+}
+
+/* Register written by 'ins', or -1 */
+int
+APEX_ins_dest(const APEX_Instruction* ins)
+{
+  return APEX_op_info[ins->op].writes_rd ? ins->rd : -1;
+}
+
+/*
+ * Stores the registers 'ins' reads into 'srcs' (room for 4) and
+ * returns how many there are. Branches read APEX_ZERO_FLAG_REG.
+ */
+int
+APEX_ins_sources(const APEX_Instruction* ins, int* srcs)
+{
+  const APEX_OpInfo* info = &APEX_op_info[ins->op];
+  int count = 0;
+
+  if (info->op_class == APEX_CLASS_BRANCH) {
+    srcs[count++] = APEX_ZERO_FLAG_REG;
+    return count;
+  }
+  for (int i = 0; i < APEX_MAX_OPERANDS; ++i) {
+    switch (info->fields[i]) {
+      case APEX_FIELD_RD:
+        if (!info->writes_rd) {
+          srcs[count++] = ins->rd;
+        }
+        break;
+      case APEX_FIELD_RS1:
+        srcs[count++] = ins->rs1;
+        break;
+      case APEX_FIELD_RS2:
+        srcs[count++] = ins->rs2;
+        break;
+      case APEX_FIELD_RS3:
+        srcs[count++] = ins->rs3;
+        break;
+    }
+  }
+  return count;
+}
+
+/*
+ * Formats 'ins' back into assembly text, the way the parser reads it.
+ * Returns the snprintf result.
+ */
+int
+APEX_disassemble(const APEX_Instruction* ins, char* buffer, size_t size)
+{
+  const APEX_OpInfo* info = &APEX_op_info[ins->op];
+  int len = snprintf(buffer, size, "%s,", ins->opcode);
+
+  for (int i = 0; i < APEX_MAX_OPERANDS && info->fields[i]; ++i) {
+    size_t used = (size_t)len < size ? (size_t)len : size;
+    const char* sep = i ? "," : "";
+    switch (info->fields[i]) {
+      case APEX_FIELD_RD:
+        len += snprintf(buffer + used, size - used, "%sR%d", sep, ins->rd);
+        break;
+      case APEX_FIELD_RS1:
+        len += snprintf(buffer + used, size - used, "%sR%d", sep, ins->rs1);
+        break;
+      case APEX_FIELD_RS2:
+        len += snprintf(buffer + used, size - used, "%sR%d", sep, ins->rs2);
+        break;
+      case APEX_FIELD_RS3:
+        len += snprintf(buffer + used, size - used, "%sR%d", sep, ins->rs3);
+        break;
+      case APEX_FIELD_IMM:
+        len += snprintf(buffer + used, size - used, "%s#%d", sep, ins->imm);
+        break;
+    }
+  }
+  return len;
+}
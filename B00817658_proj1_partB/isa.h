@@ -0,0 +1,90 @@
+#ifndef _APEX_ISA_H_
+#define _APEX_ISA_H_
+/**
+ *  isa.h
+ *  Opcode numbering and operand layout of the APEX instruction set
+ *
+ *  State University of New York, Binghamton
+ */
+#include <stddef.h>
+
+enum
+{
+  APEX_OP_UNKNOWN,
+  APEX_OP_MOVC,
+  APEX_OP_STORE,
+  APEX_OP_STR,
+  APEX_OP_ADD,
+  APEX_OP_ADDL,
+  APEX_OP_SUB,
+  APEX_OP_SUBL,
+  APEX_OP_LOAD,
+  APEX_OP_LDR,
+  APEX_OP_AND,
+  APEX_OP_OR,
+  APEX_OP_XOR,
+  APEX_OP_BZ,
+  APEX_OP_BNZ,
+  APEX_OP_MUL,
+  APEX_OP_JUMP,
+  APEX_OP_HALT,
+  APEX_OP_NOP,
+  APEX_NUM_OPS
+};
+
+/* Instruction fields an operand token can be decoded into */
+enum
+{
+  APEX_FIELD_NONE,
+  APEX_FIELD_RD,
+  APEX_FIELD_RS1,
+  APEX_FIELD_RS2,
+  APEX_FIELD_RS3,
+  APEX_FIELD_IMM
+};
+
+#define APEX_MAX_OPERANDS 3
+
+/* What an opcode does, as far as the timing model is concerned */
+enum
+{
+  APEX_CLASS_NONE,
+  APEX_CLASS_ALU,
+  APEX_CLASS_LOAD,
+  APEX_CLASS_STORE,
+  APEX_CLASS_BRANCH,
+  APEX_CLASS_JUMP,
+  APEX_CLASS_HALT
+};
+
+/* Static description of one opcode */
+typedef struct APEX_OpInfo
+{
+  const char* name;		// Mnemonic as written in assembly
+  int fields[APEX_MAX_OPERANDS];	// Field of each operand, in text order
+  int op_class;			// APEX_CLASS_*
+  int writes_rd;		// Result goes to rd (JUMP only reads rd)
+  int sets_zero;		// Updates the zero flag
+} APEX_OpInfo;
+
+/* Register number used for the zero flag in dependence tracking */
+#define APEX_ZERO_FLAG_REG 32
+
+extern const APEX_OpInfo APEX_op_info[APEX_NUM_OPS];
+
+struct APEX_Instruction;
+
+int
+APEX_op_lookup(const char* name, size_t len);
+
+int
+APEX_ins_dest(const struct APEX_Instruction* ins);
+
+int
+APEX_ins_sources(const struct APEX_Instruction* ins, int* srcs);
+
+int
+APEX_disassemble(const struct APEX_Instruction* ins, char* buffer,
+                 size_t size);
+
+#endif
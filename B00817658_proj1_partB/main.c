@@ -14,12 +14,64 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "check.h"
 #include "cpu.h"
+#include "functional.h"
+#include "perf.h"
+#include "stats.h"
+#include "trace.h"
 
 int
 main(int argc, char const* argv[])
 {
-  if (argc != 4) {
+  /* Options after the cycle count: --perf reports host speed,
+   * --stats the CPI stack and stage occupancy, --profile <file>
+   * writes stall cycles and flushes per instruction, --pipeview <file>
+   * writes a Kanata log of every instruction's stages, --record <file>
+   * a binary trace of the retired instructions for apex_trace,
+   * --trace-thread formats the display output or either file on a
+   * background thread, --decoupled executes the program functionally
+   * and times it with the replay model on a second thread, --check
+   * compares every retired instruction with the functional engine and
+   * stops at the first divergence, --hash prints the hash of the
+   * final registers and memory, --functional only executes the
+   * program, from translated blocks, with the cycle count as a limit
+   * on instructions, --interpret does the same with the threaded
+   * interpreter */
+  int measure = 0, statistics = 0, trace_thread = 0, decoupled = 0;
+  int lockstep = 0, hash = 0, functional = 0, interpret = 0;
+  const char* profile = NULL;
+  const char* pipeview = NULL;
+  const char* record = NULL;
+  int usage = argc < 4;
+  for (int i = 4; i < argc; ++i) {
+    if (strcmp(argv[i], "--perf") == 0) {
+      measure = 1;
+    } else if (strcmp(argv[i], "--stats") == 0) {
+      statistics = 1;
+    } else if (strcmp(argv[i], "--trace-thread") == 0) {
+      trace_thread = 1;
+    } else if (strcmp(argv[i], "--decoupled") == 0) {
+      decoupled = 1;
+    } else if (strcmp(argv[i], "--functional") == 0) {
+      functional = 1;
+    } else if (strcmp(argv[i], "--interpret") == 0) {
+      interpret = 1;
+    } else if (strcmp(argv[i], "--check") == 0) {
+      lockstep = 1;
+    } else if (strcmp(argv[i], "--hash") == 0) {
+      hash = 1;
+    } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+      profile = argv[++i];
+    } else if (strcmp(argv[i], "--pipeview") == 0 && i + 1 < argc) {
+      pipeview = argv[++i];
+    } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+      record = argv[++i];
+    } else {
+      usage = 1;
+    }
+  }
+  if (usage) {
     fprintf(stderr, "APEX_Help : Usage %s <input_file>\n", argv[0]);
     exit(1);
   }
@@ -34,7 +86,164 @@ main(int argc, char const* argv[])
   //printf
   cpu->clk = atoi(argv[3]);
 
-  APEX_cpu_run(cpu);
+  const char* engine = decoupled    ? "--decoupled"
+                       : functional ? "--functional"
+                       : interpret  ? "--interpret"
+                                    : NULL;
+  if (engine && (statistics || profile || pipeview || record || lockstep ||
+                 decoupled + functional + interpret > 1 ||
+                 strcmp(cpu->input, "display") == 0)) {
+    fprintf(stderr, "APEX_Error : %s runs no pipeline, it takes "
+                    "simulate or quiet mode, --perf and --hash only\n",
+            engine);
+    exit(1);
+  }
+
+  APEX_Stats stats;
+  if (statistics || profile) {
+    APEX_stats_init(&stats);
+    if (profile && APEX_stats_profile(&stats, cpu->program.code_size) != 0) {
+      fprintf(stderr, "APEX_Error : Unable to allocate the profile\n");
+      exit(1);
+    }
+    cpu->stats = &stats;
+  }
+  /* The simulator feeds one trace, the display text or one file */
+  APEX_Trace trace;
+  const char* trace_file = pipeview ? pipeview : record;
+  FILE* trace_fp = NULL;
+  if (pipeview && record) {
+    fprintf(stderr, "APEX_Error : --pipeview and --record exclude each other\n");
+    exit(1);
+  }
+  if (trace_file) {
+    if (strcmp(cpu->input, "display") == 0) {
+      fprintf(stderr, "APEX_Error : %s needs simulate or quiet mode\n",
+              pipeview ? "--pipeview" : "--record");
+      exit(1);
+    }
+    trace_fp = fopen(trace_file, pipeview ? "w" : "wb");
+    if (!trace_fp) {
+      fprintf(stderr, "APEX_Error : Unable to write %s\n", trace_file);
+      exit(1);
+    }
+    int ret = pipeview ? APEX_trace_open(&trace, trace_fp, APEX_TRACE_KANATA,
+                                         trace_thread)
+                       : APEX_trace_open_binary(&trace, trace_fp,
+                                                &cpu->program, trace_thread);
+    if (ret != 0) {
+      fprintf(stderr, "APEX_Error : Unable to allocate the trace\n");
+      exit(1);
+    }
+    cpu->trace = &trace;
+  } else if (trace_thread && strcmp(cpu->input, "display") == 0) {
+    if (APEX_trace_open(&trace, stdout, APEX_TRACE_DISPLAY, 1) != 0) {
+      fprintf(stderr, "APEX_Error : Unable to allocate the trace\n");
+      exit(1);
+    }
+    cpu->trace = &trace;
+  }
+  APEX_Check check;
+  if (lockstep) {
+    if (APEX_check_init(&check, cpu) != 0) {
+      fprintf(stderr, "APEX_Error : Unable to allocate the checker\n");
+      exit(1);
+    }
+    cpu->check = &check;
+  }
+  APEX_Perf perf;
+  if (measure) {
+    APEX_perf_init(&perf);
+    cpu->perf = &perf;
+    APEX_perf_start(&perf);
+  }
+  if (decoupled) {
+    APEX_TimingConfig config;
+    APEX_ReplayResult result;
+    APEX_timing_defaults(&config);
+    if (APEX_decoupled_run(cpu, &config, &result) != 0) {
+      fprintf(stderr, "APEX_Error : Unable to start the decoupled run\n");
+      exit(1);
+    }
+    if (strcmp(cpu->input, "simulate") == 0) {
+      printf("(apex) >> Simulation Complete");
+      APEX_simulate(cpu);
+    }
+    fprintf(stderr, "APEX_Decoupled : %lld instructions in %lld cycles\n",
+            result.instructions, result.cycles);
+  } else if (functional) {
+    APEX_BlockCache cache;
+    long long retired = -1;
+    if (APEX_block_cache_init(&cache, cpu) == 0) {
+      retired = APEX_functional_run(&cache, cpu->clk);
+    }
+    if (retired < 0) {
+      fprintf(stderr, "APEX_Error : Unable to translate the program\n");
+      exit(1);
+    }
+    if (strcmp(cpu->input, "simulate") == 0) {
+      printf("(apex) >> Simulation Complete");
+      APEX_simulate(cpu);
+    }
+    fprintf(stderr, "APEX_Functional : %lld instructions from %lld "
+                    "translated blocks\n",
+            retired, cache.translated);
+    APEX_block_cache_release(&cache);
+  } else if (interpret) {
+    long long retired = APEX_functional_interpret(cpu, cpu->clk);
+    if (retired < 0) {
+      fprintf(stderr, "APEX_Error : Unable to allocate the interpreter\n");
+      exit(1);
+    }
+    if (strcmp(cpu->input, "simulate") == 0) {
+      printf("(apex) >> Simulation Complete");
+      APEX_simulate(cpu);
+    }
+    fprintf(stderr, "APEX_Interpret : %lld instructions\n", retired);
+  } else {
+    APEX_cpu_run(cpu);
+  }
+  if (cpu->trace) {
+    APEX_trace_close(&trace);
+    cpu->trace = NULL;
+  }
+  if (trace_fp) {
+    fclose(trace_fp);
+  }
+  if (hash) {
+    fflush(stdout);
+    fprintf(stderr, "APEX_Hash : %016llx\n", cpu->state_hash);
+  }
+  if (measure) {
+    APEX_perf_stop(&perf);
+    fflush(stdout);
+    APEX_perf_report(&perf, cpu, stderr);
+    APEX_perf_close(&perf);
+  }
+  if (statistics) {
+    printf("\n");
+    APEX_stats_report(&stats, stdout);
+  }
+  if (profile) {
+    FILE* fp = fopen(profile, "w");
+    if (fp) {
+      APEX_stats_write_profile(&stats, cpu, fp);
+      fclose(fp);
+    } else {
+      fprintf(stderr, "APEX_Error : Unable to write %s\n", profile);
+    }
+  }
+  if (cpu->stats) {
+    APEX_stats_release(&stats);
+  }
+  int status = 0;
+  if (cpu->check) {
+    APEX_check_finish(&check, cpu);
+    fflush(stdout);
+    APEX_check_report(&check, stderr);
+    status = check.diverged ? 1 : 0;
+    APEX_check_release(&check);
+  }
   APEX_cpu_stop(cpu);
-  return 0;
+  return status;
 }
\ No newline at end of file
@@ -0,0 +1,579 @@
+/*
+ *  optimize.c
+ *  Contains the peephole optimizer and the loop unroller. Both keep
+ *  the final register and memory state of the program unchanged on
+ *  the pipeline in cpu.c, including its missing interlocks.
+ *
+ *  State University of New York, Binghamton
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "analysis.h"
+#include "isa.h"
+#include "optimize.h"
+
+/* Old index of a branch target in Emitter.target when not a branch */
+#define NO_TARGET -1
+
+/* New code being built, with the old index every BZ/BNZ goes to */
+typedef struct Emitter
+{
+  APEX_Instruction* code;
+  int* target;
+  int size;
+  int capacity;
+} Emitter;
+
+static int
+emit(Emitter* em, const APEX_Instruction* ins, int target)
+{
+  if (em->size == em->capacity) {
+    int capacity = em->capacity ? 2 * em->capacity : 64;
+    APEX_Instruction* code = realloc(em->code, sizeof(*code) * capacity);
+    if (!code) {
+      return -1;
+    }
+    em->code = code;
+    int* grown = realloc(em->target, sizeof(int) * capacity);
+    if (!grown) {
+      return -1;
+    }
+    em->target = grown;
+    em->capacity = capacity;
+  }
+  em->code[em->size] = *ins;
+  em->target[em->size] = target;
+  em->size++;
+  return 0;
+}
+
+static int
+is_branch(int op)
+{
+  return APEX_op_info[op].op_class == APEX_CLASS_BRANCH;
+}
+
+static int
+is_control(int op)
+{
+  int op_class = APEX_op_info[op].op_class;
+  return op_class == APEX_CLASS_BRANCH || op_class == APEX_CLASS_JUMP ||
+         op_class == APEX_CLASS_HALT || op == APEX_OP_UNKNOWN;
+}
+
+static int
+reads_reg(const APEX_Instruction* ins, int reg)
+{
+  int srcs[4];
+  int num_srcs = APEX_ins_sources(ins, srcs);
+  for (int i = 0; i < num_srcs; ++i) {
+    if (srcs[i] == reg) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int
+writes_reg(const APEX_Instruction* ins, int reg)
+{
+  if (reg == APEX_ZERO_FLAG_REG) {
+    return APEX_op_info[ins->op].sets_zero;
+  }
+  return APEX_ins_dest(ins) == reg;
+}
+
+static void
+set_op(APEX_Instruction* ins, int op)
+{
+  ins->op = op;
+  strcpy(ins->opcode, APEX_op_info[op].name);
+}
+
+/*
+ * Code can only move when every control transfer has a known target
+ * inside the program: JUMP goes to a register value and BZ/BNZ out
+ * of the program would need their absolute address kept.
+ */
+static int
+code_is_movable(const APEX_Program* program)
+{
+  for (int i = 0; i < program->code_size; ++i) {
+    int op = program->code[i].op;
+    if (op == APEX_OP_JUMP ||
+        (is_branch(op) && APEX_branch_target(program, i) < 0)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/*
+ * Whether the value of 'reg' after instruction 'index' may be read,
+ * following the fall through path of its block and skipping deleted
+ * instructions. Anything past the block counts as a read, so does
+ * HALT for registers since the final register file is the result.
+ */
+static int
+live_after(const APEX_Program* program, const unsigned char* leader,
+           const unsigned char* keep, int index, int reg)
+{
+  for (int i = index + 1; i < program->code_size; ++i) {
+    const APEX_Instruction* ins = &program->code[i];
+    if (leader[i]) {
+      return 1;
+    }
+    if (!keep[i]) {
+      continue;
+    }
+    if (reads_reg(ins, reg)) {
+      return 1;
+    }
+    if (ins->op == APEX_OP_HALT) {
+      return reg != APEX_ZERO_FLAG_REG;
+    }
+    if (writes_reg(ins, reg)) {
+      return 0;
+    }
+    if (is_control(ins->op)) {
+      return 1;
+    }
+  }
+  return 1;
+}
+
+/*
+ * ADDL never clears the valid bit of its destination, so the next
+ * instruction to reach decode would read the old value. Only MOVCs
+ * may be deleted later, so they are skipped when looking for it.
+ */
+static int
+next_reads(const APEX_Program* program, int index, int reg)
+{
+  for (int i = index + 1; i < program->code_size; ++i) {
+    if (program->code[i].op != APEX_OP_MOVC) {
+      return reads_reg(&program->code[i], reg);
+    }
+  }
+  return 0;
+}
+
+/*
+ * Whether instruction 'index' can go without bringing the kept
+ * instructions around it closer than cpu.c needs them, see
+ * APEX_hazard_distance. A MOVC may be what keeps a reader away from
+ * an ADDL, AND, OR or XOR.
+ */
+static int
+can_delete(const APEX_Program* program, const unsigned char* keep,
+           const APEX_TimingConfig* config, int index)
+{
+  const APEX_Instruction* before[APEX_HAZARD_REACH];
+  const APEX_Instruction* after[APEX_HAZARD_REACH];
+  int num_before = 0;
+  int num_after = 0;
+  for (int i = index - 1; i >= 0 && num_before < APEX_HAZARD_REACH; --i) {
+    if (keep[i]) {
+      before[num_before++] = &program->code[i];
+    }
+  }
+  for (int i = index + 1;
+       i < program->code_size && num_after < APEX_HAZARD_REACH; ++i) {
+    if (keep[i]) {
+      after[num_after++] = &program->code[i];
+    }
+  }
+
+  /* The k-th kept instruction before and m-th after end up k + m apart */
+  for (int k = 0; k < num_before; ++k) {
+    for (int m = 0; m < num_after; ++m) {
+      if (APEX_hazard_distance(config, before[k], after[m]) > k + m + 1) {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+/* Moves 'em' into 'program' as its code memory */
+static int
+replace_code(APEX_Program* program, Emitter* em)
+{
+  APEX_Instruction* code = em->code;
+  size_t size = sizeof(*code) * (em->size ? em->size : 1);
+
+  if (program->arena) {
+    code = APEX_arena_alloc(program->arena, size);
+    if (!code) {
+      return -1;
+    }
+    memcpy(code, em->code, sizeof(*code) * em->size);
+    free(em->code);
+  } else {
+    free(program->code);
+  }
+  em->code = NULL;
+  program->code = code;
+  program->code_size = em->size;
+  return 0;
+}
+
+/*
+ * Points every BZ/BNZ in 'em' at the new position of its old target.
+ * 'map' gives the new index of each old instruction, deleted ones map
+ * to the next instruction kept.
+ */
+static void
+fix_branches(Emitter* em, const int* map)
+{
+  for (int j = 0; j < em->size; ++j) {
+    if (em->target[j] != NO_TARGET) {
+      em->code[j].imm = 4 * (map[em->target[j]] - j);
+    }
+  }
+}
+
+/*
+ * Peephole pass over each basic block, tracking registers last set
+ * by MOVC in the block:
+ *  - ADD/SUB of two known values becomes a MOVC of the result,
+ *  - ADD/SUB with a known second operand (either one for ADD)
+ *    becomes ADDL/SUBL,
+ *  - a MOVC of the value a register already holds is deleted,
+ *  - ADDL Rd,Rd,#0 is deleted,
+ *  - a MOVC whose register is written again before any read is
+ *    deleted.
+ * ADD/SUB set the zero flag, so they are only rewritten when the
+ * flag is written again before it is read. Deletions are skipped
+ * when code cannot move or when they would bring instructions around
+ * them too close, see can_delete. Returns 0 on success.
+ */
+int
+APEX_peephole(APEX_Program* program, APEX_OptimizeReport* report)
+{
+  if (program->mapping || program->code_size <= 0) {
+    return -1;
+  }
+
+  int size = program->code_size;
+  unsigned char* leader = malloc(size);
+  unsigned char* keep = malloc(size);
+  int* map = malloc(sizeof(int) * (size + 1));
+  if (!leader || !keep || !map) {
+    free(leader);
+    free(keep);
+    free(map);
+    return -1;
+  }
+  APEX_find_leaders(program, leader);
+  memset(keep, 1, size);
+  int movable = code_is_movable(program);
+  APEX_TimingConfig config;
+  APEX_timing_defaults(&config);
+  report->pinned |= !movable;
+
+  int known[APEX_ZERO_FLAG_REG];
+  int value[APEX_ZERO_FLAG_REG];
+
+  for (int i = 0; i < size; ++i) {
+    APEX_Instruction* ins = &program->code[i];
+    if (leader[i]) {
+      memset(known, 0, sizeof(known));
+    }
+
+    if (ins->op == APEX_OP_ADD || ins->op == APEX_OP_SUB) {
+      int flag_dead = !live_after(program, leader, keep, i,
+                                  APEX_ZERO_FLAG_REG);
+      int a = ins->rs1;
+      int b = ins->rs2;
+      if (flag_dead && known[a] && known[b]) {
+        ins->imm = ins->op == APEX_OP_ADD ? value[a] + value[b]
+                                          : value[a] - value[b];
+        set_op(ins, APEX_OP_MOVC);
+        report->folded++;
+      } else if (flag_dead && ins->op == APEX_OP_ADD &&
+                 (known[a] || known[b]) &&
+                 !next_reads(program, i, ins->rd)) {
+        ins->imm = known[b] ? value[b] : value[a];
+        ins->rs1 = known[b] ? a : b;
+        set_op(ins, APEX_OP_ADDL);
+        report->folded++;
+      } else if (flag_dead && ins->op == APEX_OP_SUB && known[b]) {
+        ins->imm = value[b];
+        set_op(ins, APEX_OP_SUBL);
+        report->folded++;
+      }
+    }
+
+    if (movable && ins->op == APEX_OP_MOVC && known[ins->rd] &&
+        value[ins->rd] == ins->imm && can_delete(program, keep, &config, i)) {
+      keep[i] = 0;
+      report->removed++;
+      continue;
+    }
+    if (movable && ins->op == APEX_OP_ADDL && ins->rd == ins->rs1 &&
+        ins->imm == 0 && can_delete(program, keep, &config, i)) {
+      keep[i] = 0;
+      report->removed++;
+      continue;
+    }
+
+    int dest = APEX_ins_dest(ins);
+    if (ins->op == APEX_OP_MOVC) {
+      known[dest] = 1;
+      value[dest] = ins->imm;
+    } else if (dest >= 0 && dest < APEX_ZERO_FLAG_REG) {
+      known[dest] = 0;
+    }
+  }
+
+  if (movable) {
+    for (int i = 0; i < size; ++i) {
+      const APEX_Instruction* ins = &program->code[i];
+      if (keep[i] && ins->op == APEX_OP_MOVC &&
+          !live_after(program, leader, keep, i, ins->rd) &&
+          can_delete(program, keep, &config, i)) {
+        keep[i] = 0;
+        report->removed++;
+      }
+    }
+  }
+
+  int ret = 0;
+  if (movable) {
+    Emitter em = { 0 };
+    for (int i = 0; i < size && ret == 0; ++i) {
+      if (keep[i]) {
+        int target = is_branch(program->code[i].op)
+                       ? APEX_branch_target(program, i)
+                       : NO_TARGET;
+        ret = emit(&em, &program->code[i], target);
+      }
+    }
+    map[size] = em.size;
+    for (int i = size - 1; i >= 0; --i) {
+      map[i] = keep[i] ? map[i + 1] - 1 : map[i + 1];
+    }
+    if (ret == 0) {
+      fix_branches(&em, map);
+      ret = replace_code(program, &em);
+    }
+    free(em.code);
+    free(em.target);
+  }
+
+  free(leader);
+  free(keep);
+  free(map);
+  return ret;
+}
+
+/* Instruction 'pos' of two copies of the loop start .. end back to back */
+static const APEX_Instruction*
+copy_at(const APEX_Program* program, int start, int end, int pos)
+{
+  int len = end - start + 1;
+  return &program->code[start + pos % len];
+}
+
+/*
+ * Whether some path from instruction 'from' reads 'reg' before writing
+ * it. Control the branches do not describe counts as a read.
+ */
+static int
+read_before_write(const APEX_Program* program, int from, int reg)
+{
+  unsigned char* seen = calloc(program->code_size + 1, 1);
+  int* stack = malloc(sizeof(int) * (program->code_size + 1));
+  int read = 1;
+  if (seen && stack) {
+    int top = 0;
+    stack[top++] = from;
+    read = 0;
+    while (top > 0 && !read) {
+      for (int i = stack[--top]; i < program->code_size && !seen[i]; ++i) {
+        const APEX_Instruction* ins = &program->code[i];
+        seen[i] = 1;
+        if (reads_reg(ins, reg) || ins->op == APEX_OP_JUMP) {
+          read = 1;
+          break;
+        }
+        if (writes_reg(ins, reg) || ins->op == APEX_OP_HALT) {
+          break;
+        }
+        if (is_branch(ins->op)) {
+          int target = APEX_branch_target(program, i);
+          if (target < 0) {
+            read = 1;
+            break;
+          }
+          if (!seen[target]) {
+            stack[top++] = target;
+          }
+        }
+      }
+    }
+  }
+  free(seen);
+  free(stack);
+  return read;
+}
+
+/*
+ * Whether the first instructions of a copy may follow the last ones of
+ * the copy in front and its exit branch, see APEX_hazard_distance.
+ * The destination a LOAD, LDR or SUBL right behind the exit branch
+ * leaves invalid when the loop exits only matters if the next
+ * instruction of the copy, still in Decode/RF at the squash, or the
+ * code after the loop reads it before writing it.
+ */
+static int
+seam_is_safe(const APEX_Program* program, const APEX_TimingConfig* config,
+             int start, int end)
+{
+  int len = end - start + 1;
+  int first = len > APEX_HAZARD_REACH ? len - APEX_HAZARD_REACH : 0;
+  for (int p = first; p < len; ++p) {
+    for (int q = len; q < len + APEX_HAZARD_REACH; ++q) {
+      const APEX_Instruction* ins = copy_at(program, start, end, q);
+      if (p == len - 1 && q == len &&
+          (ins->op == APEX_OP_LOAD || ins->op == APEX_OP_LDR ||
+           ins->op == APEX_OP_SUBL) &&
+          !reads_reg(copy_at(program, start, end, q + 1), ins->rd) &&
+          !read_before_write(program, end + 1, ins->rd)) {
+        continue;
+      }
+      if (APEX_hazard_distance(config, copy_at(program, start, end, p), ins) >
+          q - p) {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+/*
+ * Whether the loop closed by the branch at 'end' can be unrolled: a
+ * single basic block branching back to its own start, that sets the
+ * zero flag itself and has an instruction after it to exit to.
+ *
+ * BZ/BNZ clear the zero flag again in Memory 2 and Writeback, so the
+ * flag of an unrolled copy has to be set at least 3 instructions into
+ * the copy, after the exit branch of the previous copy retired. The
+ * exit branch does not take the pipeline off the body like the taken
+ * branch back did, so the seam between copies is checked as well.
+ */
+static int
+can_unroll(const APEX_Program* program, const unsigned char* leader,
+           const APEX_TimingConfig* config, int end)
+{
+  int start = APEX_branch_target(program, end);
+  if (!is_branch(program->code[end].op) || start < 0 || start >= end ||
+      end + 1 >= program->code_size) {
+    return 0;
+  }
+
+  int last_setter = -1;
+  for (int i = start; i < end; ++i) {
+    if ((i > start && leader[i]) || is_control(program->code[i].op)) {
+      return 0;
+    }
+    if (APEX_op_info[program->code[i].op].sets_zero) {
+      last_setter = i - start;
+    }
+  }
+  return leader[end] == 0 && last_setter >= 2 &&
+         seam_is_safe(program, config, start, end);
+}
+
+/*
+ * Unrolls every loop that is one basic block ending in a BZ/BNZ back
+ * to its start by 'factor'. The body is copied 'factor' times, all
+ * but the last copy followed by the inverted branch out of the loop,
+ * so no trip count needs to be known and the taken branch (and its
+ * squashed instructions) is paid once every 'factor' iterations.
+ * Returns 0 on success.
+ */
+int
+APEX_unroll(APEX_Program* program, int factor, APEX_OptimizeReport* report)
+{
+  if (program->mapping || program->code_size <= 0 || factor < 1 ||
+      factor > APEX_MAX_UNROLL) {
+    return -1;
+  }
+  if (factor == 1) {
+    return 0;
+  }
+  if (!code_is_movable(program)) {
+    report->pinned = 1;
+    return 0;
+  }
+
+  int size = program->code_size;
+  unsigned char* leader = malloc(size);
+  int* loop_end = malloc(sizeof(int) * size);
+  int* map = malloc(sizeof(int) * (size + 1));
+  if (!leader || !loop_end || !map) {
+    free(leader);
+    free(loop_end);
+    free(map);
+    return -1;
+  }
+  APEX_find_leaders(program, leader);
+  APEX_TimingConfig config;
+  APEX_timing_defaults(&config);
+
+  /* loop_end[start] is the closing branch of the loop starting there */
+  memset(loop_end, -1, sizeof(int) * size);
+  for (int i = 0; i < size; ++i) {
+    if (can_unroll(program, leader, &config, i)) {
+      loop_end[APEX_branch_target(program, i)] = i;
+    }
+  }
+
+  Emitter em = { 0 };
+  int ret = 0;
+  for (int i = 0; i < size && ret == 0;) {
+    const APEX_Instruction* code = program->code;
+    int end = loop_end[i];
+    if (end < 0) {
+      map[i] = em.size;
+      ret = emit(&em, &code[i],
+                 is_branch(code[i].op) ? APEX_branch_target(program, i)
+                                       : NO_TARGET);
+      i++;
+      continue;
+    }
+
+    /* Old indices of the body map into the first copy */
+    for (int k = i; k <= end; ++k) {
+      map[k] = em.size + (k - i);
+    }
+    APEX_Instruction exit = code[end];
+    set_op(&exit, code[end].op == APEX_OP_BZ ? APEX_OP_BNZ : APEX_OP_BZ);
+    for (int copy = 0; copy < factor && ret == 0; ++copy) {
+      for (int k = i; k < end && ret == 0; ++k) {
+        ret = emit(&em, &code[k], NO_TARGET);
+      }
+      if (ret == 0) {
+        ret = copy + 1 < factor ? emit(&em, &exit, end + 1)
+                                : emit(&em, &code[end], i);
+      }
+    }
+    report->loops++;
+    i = end + 1;
+  }
+  map[size] = em.size;
+
+  if (ret == 0) {
+    fix_branches(&em, map);
+    ret = replace_code(program, &em);
+  }
+  free(em.code);
+  free(em.target);
+  free(leader);
+  free(loop_end);
+  free(map);
+  return ret;
+}
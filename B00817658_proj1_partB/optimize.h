@@ -0,0 +1,29 @@
+#ifndef _APEX_OPTIMIZE_H_
+#define _APEX_OPTIMIZE_H_
+/**
+ *  optimize.h
+ *  Peephole optimizer and loop unroller over decoded programs
+ *
+ *  State University of New York, Binghamton
+ */
+#include "cpu.h"
+
+/* Copies of a loop body the unroller makes at most */
+#define APEX_MAX_UNROLL 16
+
+/* What the optimization passes did, accumulated over passes */
+typedef struct APEX_OptimizeReport
+{
+  int folded;		// ADD/SUB turned into ADDL/SUBL or MOVC
+  int removed;		// Redundant or dead instructions deleted
+  int loops;		// Loops unrolled
+  int pinned;		// Set when code could not move (JUMP or far branch)
+} APEX_OptimizeReport;
+
+int
+APEX_peephole(APEX_Program* program, APEX_OptimizeReport* report);
+
+int
+APEX_unroll(APEX_Program* program, int factor, APEX_OptimizeReport* report);
+
+#endif
@@ -0,0 +1,241 @@
+/*
+ *  perf.c
+ *  Self-measurement of the simulator. Wall time and host counters
+ *  cover the whole run; one cycle in APEX_PERF_PERIOD has each stage
+ *  call timestamped, which splits the run time between the stage
+ *  functions and the loop around them (display banner included).
+ *
+ *  State University of New York, Binghamton
+ */
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "perf.h"
+
+/* Stage functions in the order APEX_cpu_run calls them */
+static const struct
+{
+  int stage;
+  int (*function)(APEX_CPU* cpu);
+  const char* name;
+} stage_order[NUM_STAGES] = {
+  { WB, writeback, "Writeback" },  { MEM2, memory2, "Memory 2" },
+  { MEM1, memory, "Memory 1" },    { EX2, execute2, "Execute 2" },
+  { EX1, execute, "Execute 1" },   { DRF, decode, "Decode/RF" },
+  { F, fetch, "Fetch" },
+};
+
+static double
+now_seconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Cheapest clock at hand, the TSC on x86 and nanoseconds elsewhere */
+static inline unsigned long long
+timestamp()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+#ifdef __linux__
+static int
+open_counter(unsigned int type, unsigned long long config)
+{
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+/*
+ * Opens the host counters of this process. Counters the kernel does
+ * not give out (no PMU, perf_event_paranoid) stay at -1 and are left
+ * out of the report.
+ */
+void
+APEX_perf_init(APEX_Perf* perf)
+{
+  memset(perf, 0, sizeof(*perf));
+  for (int i = 0; i < APEX_PERF_NUM_COUNTERS; ++i) {
+    perf->fd[i] = -1;
+  }
+#ifdef __linux__
+  static const unsigned long long configs[APEX_PERF_NUM_COUNTERS] = {
+    [APEX_PERF_CYCLES] = PERF_COUNT_HW_CPU_CYCLES,
+    [APEX_PERF_INSTRUCTIONS] = PERF_COUNT_HW_INSTRUCTIONS,
+    [APEX_PERF_CACHE_MISSES] = PERF_COUNT_HW_CACHE_MISSES,
+    [APEX_PERF_BRANCH_MISSES] = PERF_COUNT_HW_BRANCH_MISSES,
+  };
+  for (int i = 0; i < APEX_PERF_NUM_COUNTERS; ++i) {
+    perf->fd[i] = open_counter(PERF_TYPE_HARDWARE, configs[i]);
+    if (perf->fd[i] < 0 && !perf->error) {
+      perf->error = errno;
+    }
+  }
+#else
+  perf->error = ENOSYS;
+#endif
+}
+
+void
+APEX_perf_start(APEX_Perf* perf)
+{
+#ifdef __linux__
+  for (int i = 0; i < APEX_PERF_NUM_COUNTERS; ++i) {
+    if (perf->fd[i] >= 0) {
+      ioctl(perf->fd[i], PERF_EVENT_IOC_RESET, 0);
+      ioctl(perf->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+#endif
+  perf->start = now_seconds();
+  perf->tick_start = timestamp();
+}
+
+void
+APEX_perf_stop(APEX_Perf* perf)
+{
+  perf->ticks = timestamp() - perf->tick_start;
+  perf->seconds = now_seconds() - perf->start;
+#ifdef __linux__
+  for (int i = 0; i < APEX_PERF_NUM_COUNTERS; ++i) {
+    if (perf->fd[i] >= 0) {
+      ioctl(perf->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+      if (read(perf->fd[i], &perf->counts[i], sizeof(perf->counts[i])) !=
+          sizeof(perf->counts[i])) {
+        perf->counts[i] = 0;
+      }
+    }
+  }
+#endif
+}
+
+/* Runs the stages of one cycle, timestamping each call */
+void
+APEX_perf_cycle(APEX_Perf* perf, APEX_CPU* cpu)
+{
+  unsigned long long ticks[NUM_STAGES];
+  unsigned long long before = timestamp();
+  unsigned long long total = 0;
+  for (int i = 0; i < NUM_STAGES; ++i) {
+    stage_order[i].function(cpu);
+    unsigned long long after = timestamp();
+    ticks[i] = after - before;
+    total += ticks[i];
+    before = after;
+  }
+
+  if (perf->samples >= APEX_PERF_MIN_SAMPLES &&
+      total > APEX_PERF_OUTLIER * (perf->sample_ticks / perf->samples)) {
+    perf->dropped++;
+    return;
+  }
+  for (int i = 0; i < NUM_STAGES; ++i) {
+    perf->stage_ticks[stage_order[i].stage] += ticks[i];
+  }
+  perf->sample_ticks += total;
+  perf->samples++;
+}
+
+void
+APEX_perf_report(const APEX_Perf* perf, const APEX_CPU* cpu, FILE* fp)
+{
+  double seconds = perf->seconds > 0 ? perf->seconds : 1e-9;
+  fprintf(fp, "APEX_Perf : %.6f s wall, %d cycles, %lld instructions\n",
+          perf->seconds, cpu->clock, cpu->retired);
+  fprintf(fp, "APEX_Perf : %.1f KCPS, %.1f KIPS simulated\n",
+          cpu->clock / seconds / 1000, cpu->retired / seconds / 1000);
+
+  if (perf->fd[APEX_PERF_CYCLES] < 0 &&
+      perf->fd[APEX_PERF_INSTRUCTIONS] < 0) {
+    fprintf(fp, "APEX_Perf : host counters unavailable (%s)\n",
+            strerror(perf->error));
+  } else {
+    static const char* names[APEX_PERF_NUM_COUNTERS] = {
+      "cycles", "instructions", "cache misses", "branch misses"
+    };
+    for (int i = 0; i < APEX_PERF_NUM_COUNTERS; ++i) {
+      if (perf->fd[i] >= 0) {
+        fprintf(fp, "APEX_Perf : host %-14s %14llu", names[i],
+                perf->counts[i]);
+        if (cpu->clock > 0) {
+          fprintf(fp, "  %10.1f per simulated cycle",
+                  (double)perf->counts[i] / cpu->clock);
+        }
+        fprintf(fp, "\n");
+      }
+    }
+    if (perf->counts[APEX_PERF_CYCLES] > 0) {
+      fprintf(fp, "APEX_Perf : host IPC %.2f\n",
+              (double)perf->counts[APEX_PERF_INSTRUCTIONS] /
+                perf->counts[APEX_PERF_CYCLES]);
+    }
+  }
+
+  if (perf->samples < APEX_PERF_MIN_SAMPLES || perf->ticks == 0 ||
+      perf->sample_ticks == 0) {
+    fprintf(fp, "APEX_Perf : stage time not reported, %lld of %d cycles "
+                "sampled, %d needed\n",
+            perf->samples, cpu->clock, APEX_PERF_MIN_SAMPLES);
+    return;
+  }
+  /* Sampled stage time scaled up to the whole run is at most all of
+   * it, the sampled shares split that part between the stages */
+  double ns_per_tick = perf->seconds * 1e9 / perf->ticks;
+  double total_ns = perf->seconds * 1e9;
+  double stages_ns =
+    perf->sample_ticks * ns_per_tick / perf->samples * cpu->clock;
+  double stages_part = stages_ns < total_ns ? stages_ns / total_ns : 1.0;
+  fprintf(fp,
+          "APEX_Perf : stage time, %lld of %d cycles sampled, %lld dropped\n",
+          perf->samples, cpu->clock, perf->dropped);
+  for (int i = NUM_STAGES - 1; i >= 0; --i) {
+    int stage = stage_order[i].stage;
+    double per_call = perf->stage_ticks[stage] * ns_per_tick / perf->samples;
+    double share = 100.0 * stages_part * perf->stage_ticks[stage] /
+                   perf->sample_ticks;
+    fprintf(fp, "APEX_Perf :   %-10s %9.1f ns/call %6.1f%%\n",
+            stage_order[i].name, per_call, share);
+  }
+  double outside = total_ns * (1.0 - stages_part);
+  fprintf(fp, "APEX_Perf :   %-10s %9.1f ns/cycle %5.1f%%\n", "run loop",
+          outside / cpu->clock, 100.0 * (1.0 - stages_part));
+}
+
+void
+APEX_perf_close(APEX_Perf* perf)
+{
+  for (int i = 0; i < APEX_PERF_NUM_COUNTERS; ++i) {
+    if (perf->fd[i] >= 0) {
+      close(perf->fd[i]);
+      perf->fd[i] = -1;
+    }
+  }
+}
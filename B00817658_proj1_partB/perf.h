@@ -0,0 +1,69 @@
+#ifndef _APEX_PERF_H_
+#define _APEX_PERF_H_
+/**
+ *  perf.h
+ *  Self-measurement of the simulator: wall time, simulated KIPS/KCPS,
+ *  host hardware counters and a sampled per-stage time breakdown
+ *
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+
+#include "cpu.h"
+
+/* One cycle in this many has its stage functions timestamped, a
+ * prime so kernel loops do not line up with the sampling */
+#define APEX_PERF_PERIOD 61
+
+/* Sampled cycles this many times slower than the average so far were
+ * interrupted by the host and are dropped */
+#define APEX_PERF_OUTLIER 20
+
+/* Samples the average needs before outliers are dropped, and the
+ * stage breakdown before it is reported */
+#define APEX_PERF_MIN_SAMPLES 16
+
+/* Host counters read through perf_event_open */
+enum
+{
+  APEX_PERF_CYCLES,
+  APEX_PERF_INSTRUCTIONS,
+  APEX_PERF_CACHE_MISSES,
+  APEX_PERF_BRANCH_MISSES,
+  APEX_PERF_NUM_COUNTERS
+};
+
+typedef struct APEX_Perf
+{
+  int fd[APEX_PERF_NUM_COUNTERS];	// -1 when a counter is not available
+  unsigned long long counts[APEX_PERF_NUM_COUNTERS];
+  int error;			// errno of the first counter that failed to open
+  double start;			// Wall clock at APEX_perf_start
+  double seconds;		// Wall time between start and stop
+  unsigned long long tick_start;	// Timestamp counter at start
+  unsigned long long ticks;	// Timestamp ticks between start and stop
+  unsigned long long stage_ticks[NUM_STAGES];	// Summed over sampled cycles
+  unsigned long long sample_ticks;	// Sum of stage_ticks
+  long long samples;		// Cycles sampled
+  long long dropped;		// Sampled cycles dropped as outliers
+} APEX_Perf;
+
+void
+APEX_perf_init(APEX_Perf* perf);
+
+void
+APEX_perf_start(APEX_Perf* perf);
+
+void
+APEX_perf_stop(APEX_Perf* perf);
+
+void
+APEX_perf_cycle(APEX_Perf* perf, APEX_CPU* cpu);
+
+void
+APEX_perf_report(const APEX_Perf* perf, const APEX_CPU* cpu, FILE* fp);
+
+void
+APEX_perf_close(APEX_Perf* perf);
+
+#endif
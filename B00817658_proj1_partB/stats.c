@@ -0,0 +1,370 @@
+/*
+ *  stats.c
+ *  Per-stage occupancy and stall counters. Every stage reports once a
+ *  cycle what its latch held: an instruction it worked on, one stalled
+ *  in Decode/RF, or a bubble whose cause rides along in the latch.
+ *  Writeback sees every cycle exactly once, so its row splits the run
+ *  into retired instructions and lost cycles, which is the CPI stack.
+ *
+ *  With a profile, each Decode/RF stall cycle is also charged to the
+ *  stalled instruction, the register it waits for and the last issued
+ *  writer of that register, and each flushed instruction to the taken
+ *  branch. Entries hang off the instruction they are charged to.
+ *
+ *  State University of New York, Binghamton
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "stats.h"
+
+static const char* stage_names[NUM_STAGES] = {
+  "Fetch", "Decode/RF", "Execute 1", "Execute 2",
+  "Memory 1", "Memory 2", "Writeback",
+};
+
+void
+APEX_stats_init(APEX_Stats* stats)
+{
+  memset(stats, 0, sizeof(*stats));
+  stats->stalling = -1;
+  for (int r = 0; r <= APEX_ZERO_FLAG_REG; ++r) {
+    stats->writer[r] = -1;
+  }
+}
+
+/* Turns on per-PC attribution for a program of 'code_size' instructions */
+int
+APEX_stats_profile(APEX_Stats* stats, int code_size)
+{
+  stats->first = malloc(sizeof(*stats->first) * (code_size ? code_size : 1));
+  if (!stats->first) {
+    return -1;
+  }
+  for (int i = 0; i < code_size; ++i) {
+    stats->first[i] = -1;
+  }
+  stats->code_size = code_size;
+  return 0;
+}
+
+void
+APEX_stats_release(APEX_Stats* stats)
+{
+  free(stats->entries);
+  free(stats->first);
+  stats->entries = NULL;
+  stats->first = NULL;
+  stats->num_entries = stats->capacity = stats->code_size = 0;
+}
+
+/* Instruction in code memory a latch was fetched from, NULL if none */
+static const APEX_Instruction*
+latch_ins(const APEX_CPU* cpu, const CPU_Stage* latch)
+{
+  int index = (latch->pc - 4000) / 4;
+  if (latch->pc < 4000 || index >= cpu->program.code_size) {
+    return NULL;
+  }
+  return &cpu->code_memory[index];
+}
+
+/* Entry for the key, appended to the chain of 'index' on first use */
+static APEX_ProfileEntry*
+profile_entry(APEX_Stats* stats, int kind, int index, int reg, int producer)
+{
+  for (int e = stats->first[index]; e >= 0; e = stats->entries[e].next) {
+    APEX_ProfileEntry* entry = &stats->entries[e];
+    if (entry->kind == kind && entry->reg == reg &&
+        entry->producer == producer) {
+      return entry;
+    }
+  }
+  if (stats->num_entries == stats->capacity) {
+    int capacity = stats->capacity ? 2 * stats->capacity : 64;
+    APEX_ProfileEntry* entries =
+      realloc(stats->entries, sizeof(*entries) * capacity);
+    if (!entries) {
+      return NULL;
+    }
+    stats->entries = entries;
+    stats->capacity = capacity;
+  }
+  APEX_ProfileEntry* entry = &stats->entries[stats->num_entries];
+  memset(entry, 0, sizeof(*entry));
+  entry->kind = kind;
+  entry->index = index;
+  entry->reg = reg;
+  entry->producer = producer;
+  entry->next = stats->first[index];
+  stats->first[index] = stats->num_entries++;
+  return entry;
+}
+
+/* Charges one Decode/RF stall cycle of 'ins' to what it waits for */
+static void
+profile_stall(APEX_Stats* stats, const APEX_CPU* cpu,
+              const APEX_Instruction* ins)
+{
+  int index = ins - cpu->code_memory;
+  int kind = APEX_PROFILE_RAW;
+  int reg = -1;
+  int srcs[4];
+  int count = APEX_ins_sources(ins, srcs);
+  for (int i = 0; i < count; ++i) {
+    if (srcs[i] == APEX_ZERO_FLAG_REG) {
+      kind = APEX_PROFILE_BRANCH;
+      reg = srcs[i];
+      break;
+    }
+    if (!cpu->regs_valid[srcs[i]]) {
+      reg = srcs[i];
+      break;
+    }
+  }
+  int producer = reg >= 0 ? stats->writer[reg] : -1;
+  APEX_ProfileEntry* entry = profile_entry(stats, kind, index, reg, producer);
+  if (!entry) {
+    return;
+  }
+  int e = entry - stats->entries;
+  if (stats->stalling != e) {
+    entry->events++;
+  }
+  entry->cycles++;
+  stats->stalling = e;
+}
+
+/* Records the registers an instruction leaving Decode/RF will write */
+static void
+profile_issue(APEX_Stats* stats, const APEX_CPU* cpu,
+              const APEX_Instruction* ins)
+{
+  int index = ins - cpu->code_memory;
+  int rd = APEX_ins_dest(ins);
+  if (rd >= 0) {
+    stats->writer[rd] = index;
+  }
+  if (APEX_op_info[ins->op].sets_zero) {
+    stats->writer[APEX_ZERO_FLAG_REG] = index;
+  }
+}
+
+/* Activity of a stall in Decode/RF, BZ/BNZ only ever wait for the flag */
+static int
+stall_act(const CPU_Stage* stage)
+{
+  return strcmp(stage->opcode, "BZ") == 0 || strcmp(stage->opcode, "BNZ") == 0
+           ? APEX_ACT_STALL_BRANCH
+           : APEX_ACT_STALL_RAW;
+}
+
+/* Called by each stage function once it is done for the cycle */
+void
+APEX_stats_stage(APEX_Stats* stats, const APEX_CPU* cpu, int stage)
+{
+  const CPU_Stage* latch = &cpu->stage[stage];
+  int act;
+  if (APEX_stage_is_bubble(latch)) {
+    switch (latch->bubble) {
+      case APEX_BUBBLE_RAW:
+        act = APEX_ACT_STALL_RAW;
+        break;
+      case APEX_BUBBLE_BRANCH:
+        act = APEX_ACT_STALL_BRANCH;
+        break;
+      case APEX_BUBBLE_FLUSH:
+        act = APEX_ACT_FLUSHED;
+        break;
+      default:
+        act = APEX_ACT_BUBBLE;
+        break;
+    }
+  } else if (stage == DRF && latch->stalled) {
+    act = stall_act(latch);
+    const APEX_Instruction* ins = latch_ins(cpu, latch);
+    if (stats->first && ins) {
+      profile_stall(stats, cpu, ins);
+    }
+  } else if (stage == F && cpu->stage[DRF].stalled) {
+    /* Fetched again next cycle, Decode/RF did not take it */
+    act = stall_act(&cpu->stage[DRF]);
+  } else {
+    act = APEX_ACT_BUSY;
+    if (stage == DRF && stats->first) {
+      const APEX_Instruction* ins = latch_ins(cpu, latch);
+      if (ins) {
+        profile_issue(stats, cpu, ins);
+      }
+    }
+    if (stage == WB && (strcmp(latch->opcode, "BZ") == 0 ||
+                        strcmp(latch->opcode, "BNZ") == 0)) {
+      stats->branches++;
+    }
+  }
+  if (stage == DRF && act != APEX_ACT_STALL_RAW &&
+      act != APEX_ACT_STALL_BRANCH) {
+    stats->stalling = -1;
+  }
+  stats->act[stage][act]++;
+}
+
+/* Called by a taken branch before it squashes the younger stages */
+void
+APEX_stats_flush(APEX_Stats* stats, const APEX_CPU* cpu)
+{
+  int flushed = 0;
+  for (int i = DRF; i <= EX2; ++i) {
+    if (!APEX_stage_is_bubble(&cpu->stage[i])) {
+      flushed++;
+    }
+  }
+  stats->taken++;
+  stats->flushed += flushed;
+
+  const APEX_Instruction* branch = latch_ins(cpu, &cpu->stage[MEM1]);
+  if (stats->first && branch) {
+    APEX_ProfileEntry* entry =
+      profile_entry(stats, APEX_PROFILE_FLUSH, branch - cpu->code_memory,
+                    APEX_ZERO_FLAG_REG, -1);
+    if (entry) {
+      entry->events++;
+      entry->cycles += flushed;
+    }
+  }
+}
+
+void
+APEX_stats_report(const APEX_Stats* stats, FILE* fp)
+{
+  static const struct
+  {
+    const char* name;
+    int act;
+  } stack[] = {
+    { "base", APEX_ACT_BUSY },
+    { "RAW stalls", APEX_ACT_STALL_RAW },
+    { "branch stalls", APEX_ACT_STALL_BRANCH },
+    { "flushes", APEX_ACT_FLUSHED },
+    { "fill/drain", APEX_ACT_BUBBLE },
+  };
+  static const char* act_names[APEX_NUM_ACTS] = {
+    "BUSY", "RAW", "BRANCH", "BUBBLE", "FLUSHED",
+  };
+
+  long long cycles = 0;
+  for (int a = 0; a < APEX_NUM_ACTS; ++a) {
+    cycles += stats->act[WB][a];
+  }
+  long long retired = stats->act[WB][APEX_ACT_BUSY];
+
+  fprintf(fp, "(apex) >> CPI stack\n");
+  fprintf(fp, "%lld cycles, %lld instructions, CPI %.3f\n", cycles, retired,
+          retired ? (double)cycles / retired : 0.0);
+  fprintf(fp, "%-14s %10s %8s %7s\n", "COMPONENT", "CYCLES", "CPI", "SHARE");
+  for (size_t i = 0; i < sizeof(stack) / sizeof(stack[0]); ++i) {
+    long long n = stats->act[WB][stack[i].act];
+    fprintf(fp, "%-14s %10lld %8.3f %6.1f%%\n", stack[i].name, n,
+            retired ? (double)n / retired : 0.0,
+            cycles ? 100.0 * n / cycles : 0.0);
+  }
+  fprintf(fp, "%lld branches, %lld taken, %lld instructions flushed\n",
+          stats->branches, stats->taken, stats->flushed);
+
+  fprintf(fp, "(apex) >> Stage occupancy\n");
+  fprintf(fp, "%-10s", "STAGE");
+  for (int a = 0; a < APEX_NUM_ACTS; ++a) {
+    fprintf(fp, " %10s", act_names[a]);
+  }
+  fprintf(fp, " %7s\n", "BUSY%");
+  for (int s = 0; s < NUM_STAGES; ++s) {
+    long long total = 0;
+    fprintf(fp, "%-10s", stage_names[s]);
+    for (int a = 0; a < APEX_NUM_ACTS; ++a) {
+      fprintf(fp, " %10lld", stats->act[s][a]);
+      total += stats->act[s][a];
+    }
+    fprintf(fp, " %6.1f%%\n",
+            total ? 100.0 * stats->act[s][APEX_ACT_BUSY] / total : 0.0);
+  }
+}
+
+/* Sorts profile entries by charged cycles, most first */
+static int
+compare_entries(const void* a, const void* b)
+{
+  const APEX_ProfileEntry* x = *(const APEX_ProfileEntry* const*)a;
+  const APEX_ProfileEntry* y = *(const APEX_ProfileEntry* const*)b;
+  if (x->cycles != y->cycles) {
+    return x->cycles < y->cycles ? 1 : -1;
+  }
+  return x->index - y->index;
+}
+
+static void
+describe(const APEX_CPU* cpu, int index, char* buffer, size_t size)
+{
+  if (index < 0) {
+    snprintf(buffer, size, "?");
+    return;
+  }
+  int len = snprintf(buffer, size, "%d ", 4000 + 4 * index);
+  if (len >= 0 && (size_t)len < size) {
+    APEX_disassemble(&cpu->code_memory[index], buffer + len, size - len);
+  }
+}
+
+/*
+ * Writes the profile sorted like a perf report: share of all charged
+ * cycles, cycles, how often, the instruction and the cause.
+ */
+void
+APEX_stats_write_profile(const APEX_Stats* stats, const APEX_CPU* cpu,
+                         FILE* fp)
+{
+  long long total = 0;
+  const APEX_ProfileEntry** sorted =
+    malloc(sizeof(*sorted) * (stats->num_entries ? stats->num_entries : 1));
+  if (!sorted) {
+    return;
+  }
+  for (int e = 0; e < stats->num_entries; ++e) {
+    sorted[e] = &stats->entries[e];
+    total += stats->entries[e].cycles;
+  }
+  qsort(sorted, stats->num_entries, sizeof(*sorted), compare_entries);
+
+  fprintf(fp, "# APEX stall profile, %d cycles\n", cpu->clock);
+  fprintf(fp, "# %lld RAW stall cycles, %lld branch stall cycles, "
+              "%lld instructions flushed\n",
+          stats->act[DRF][APEX_ACT_STALL_RAW],
+          stats->act[DRF][APEX_ACT_STALL_BRANCH], stats->flushed);
+  fprintf(fp, "#\n# %8s %10s %8s  %-28s %s\n", "Overhead", "Cycles",
+          "Events", "Instruction", "Cause");
+  for (int e = 0; e < stats->num_entries; ++e) {
+    const APEX_ProfileEntry* entry = sorted[e];
+    char ins[64], producer[64], cause[96];
+    describe(cpu, entry->index, ins, sizeof(ins));
+    describe(cpu, entry->producer, producer, sizeof(producer));
+    switch (entry->kind) {
+      case APEX_PROFILE_RAW:
+        if (entry->reg < 0) {
+          snprintf(cause, sizeof(cause), "RAW, no invalid source");
+        } else {
+          snprintf(cause, sizeof(cause), "RAW R%d <- %s", entry->reg,
+                   producer);
+        }
+        break;
+      case APEX_PROFILE_BRANCH:
+        snprintf(cause, sizeof(cause), "zero flag <- %s", producer);
+        break;
+      default:
+        snprintf(cause, sizeof(cause), "flush, taken");
+        break;
+    }
+    fprintf(fp, "  %7.2f%% %10lld %8lld  %-28s %s\n",
+            total ? 100.0 * entry->cycles / total : 0.0, entry->cycles,
+            entry->events, ins, cause);
+  }
+  free(sorted);
+}
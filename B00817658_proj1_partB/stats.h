@@ -0,0 +1,85 @@
+#ifndef _APEX_STATS_H_
+#define _APEX_STATS_H_
+/**
+ *  stats.h
+ *  Per-stage occupancy and stall counters and the CPI stack built
+ *  from them
+ *
+ *  State University of New York, Binghamton
+ */
+#include <stdio.h>
+
+#include "cpu.h"
+#include "isa.h"
+
+/* What a stage did in one cycle */
+enum
+{
+  APEX_ACT_BUSY,		// Worked on an instruction
+  APEX_ACT_STALL_RAW,		// Held up by, or carrying, a RAW stall
+  APEX_ACT_STALL_BRANCH,	// Held up by, or carrying, a branch stall
+  APEX_ACT_BUBBLE,		// Empty, pipeline fill or drain
+  APEX_ACT_FLUSHED,		// Wrong path squashed by a taken branch
+  APEX_NUM_ACTS
+};
+
+/* What a profile entry charges to an instruction */
+enum
+{
+  APEX_PROFILE_RAW,		// Decode/RF cycles waiting for a register
+  APEX_PROFILE_BRANCH,		// Decode/RF cycles a branch waited for the flag
+  APEX_PROFILE_FLUSH		// Instructions squashed by a taken branch
+};
+
+/* Stall cycles or flushed instructions charged to one cause */
+typedef struct APEX_ProfileEntry
+{
+  int kind;			// APEX_PROFILE_*
+  int index;			// Code index of the stalled or taken branch
+  int reg;			// Register waited for, APEX_ZERO_FLAG_REG for the flag
+  int producer;			// Code index of its last writer, -1 if none
+  long long cycles;		// Stall cycles, or instructions flushed
+  long long events;		// Stalls started, or times taken
+  int next;			// Next entry of the same instruction, or -1
+} APEX_ProfileEntry;
+
+typedef struct APEX_Stats
+{
+  long long act[NUM_STAGES][APEX_NUM_ACTS];	// Cycles per stage and activity
+  long long branches;		// BZ/BNZ through writeback
+  long long taken;		// Taken branches, each squashing the wrong path
+  long long flushed;		// Instructions squashed past fetch
+
+  /* Per-PC attribution, kept once APEX_stats_profile allocated it */
+  APEX_ProfileEntry* entries;
+  int num_entries;
+  int capacity;
+  int* first;			// First entry per code index, or -1
+  int code_size;
+  int writer[APEX_ZERO_FLAG_REG + 1];	// Code index of the last issued writer
+  int stalling;			// Entry Decode/RF stalled on last cycle, or -1
+} APEX_Stats;
+
+void
+APEX_stats_init(APEX_Stats* stats);
+
+int
+APEX_stats_profile(APEX_Stats* stats, int code_size);
+
+void
+APEX_stats_release(APEX_Stats* stats);
+
+void
+APEX_stats_stage(APEX_Stats* stats, const APEX_CPU* cpu, int stage);
+
+void
+APEX_stats_flush(APEX_Stats* stats, const APEX_CPU* cpu);
+
+void
+APEX_stats_report(const APEX_Stats* stats, FILE* fp);
+
+void
+APEX_stats_write_profile(const APEX_Stats* stats, const APEX_CPU* cpu,
+                         FILE* fp);
+
+#endif
@@ -0,0 +1,708 @@
+/*
+ *  timing.c
+ *  Contains the pipeline latency table and the in-order issue model
+ *  shared by the scheduler and the static estimator, and the replay
+ *  model that times recorded instruction streams
+ *
+ *  State University of New York, Binghamton
+ */
+#include <limits.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "timing.h"
+
+/*
+ * Default latencies of the pipeline in cpu.c. The stage functions run
+ * from writeback back to fetch every cycle, so a register written in
+ * Execute 2 is valid when Decode/RF runs later in the same cycle.
+ *
+ *  - ALU results (and the zero flag) are written in Execute 2, one
+ *    stage after Execute 1 invalidates them: a dependent right behind
+ *    the producer waits 1 cycle, so ready = 2.
+ *  - LOAD/LDR write the register in Memory 2: 3 cycles, ready = 4.
+ *  - A taken BZ/BNZ redirects fetch from Memory 1 and squashes the
+ *    three younger instructions.
+ *  - JUMP redirects fetch from Execute 2, two younger ones are lost.
+ *  - The run loop stops once HALT reaches writeback.
+ *  - ADDL, AND, OR and XOR never clear the valid bit of their
+ *    destination in Execute 1, so Decode/RF does not wait for them.
+ */
+void
+APEX_timing_defaults(APEX_TimingConfig* config)
+{
+  config->alu_ready = 2;
+  config->load_ready = 4;
+  config->branch_penalty = 3;
+  config->jump_penalty = 2;
+  config->drain = 5;
+  config->no_interlock = (1u << APEX_OP_ADDL) | (1u << APEX_OP_AND) |
+                         (1u << APEX_OP_OR) | (1u << APEX_OP_XOR);
+  config->flag_interlock = 0;
+  /* cpu.c has no cache, every access takes one Memory 1 cycle */
+  config->cache_lines = 0;
+  config->line_words = 4;
+  config->miss_penalty = 10;
+}
+
+/* Parameters APEX_timing_set knows by name */
+static const struct
+{
+  const char* name;
+  size_t offset;
+  int min;
+} parameters[] = {
+  { "alu_ready", offsetof(APEX_TimingConfig, alu_ready), 1 },
+  { "load_ready", offsetof(APEX_TimingConfig, load_ready), 1 },
+  { "branch_penalty", offsetof(APEX_TimingConfig, branch_penalty), 0 },
+  { "jump_penalty", offsetof(APEX_TimingConfig, jump_penalty), 0 },
+  { "drain", offsetof(APEX_TimingConfig, drain), 0 },
+  { "flag_interlock", offsetof(APEX_TimingConfig, flag_interlock), 0 },
+  { "cache_lines", offsetof(APEX_TimingConfig, cache_lines), 0 },
+  { "line_words", offsetof(APEX_TimingConfig, line_words), 1 },
+  { "miss_penalty", offsetof(APEX_TimingConfig, miss_penalty), 0 },
+};
+
+/*
+ * Sets the parameter 'name' of 'config' to 'value'. Returns 0, or -1
+ * for an unknown name or a value out of range.
+ */
+int
+APEX_timing_set(APEX_TimingConfig* config, const char* name, int value)
+{
+  for (size_t i = 0; i < sizeof(parameters) / sizeof(parameters[0]); ++i) {
+    if (strcmp(parameters[i].name, name) == 0) {
+      if (value < parameters[i].min) {
+        return -1;
+      }
+      if (strcmp(name, "line_words") == 0 && (value & (value - 1))) {
+        return -1;
+      }
+      *(int*)((char*)config + parameters[i].offset) = value;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/* Cycles after 'op' leaves decode until its result can be read */
+int
+APEX_timing_ready(const APEX_TimingConfig* config, int op)
+{
+  if (config->no_interlock & (1u << op)) {
+    return 1;
+  }
+  switch (APEX_op_info[op].op_class) {
+    case APEX_CLASS_ALU:
+      return config->alu_ready;
+    case APEX_CLASS_LOAD:
+      return config->load_ready;
+    default:
+      return 1;
+  }
+}
+
+static int
+reads_reg(const APEX_Instruction* ins, int reg)
+{
+  int srcs[4];
+  int num_srcs = APEX_ins_sources(ins, srcs);
+  for (int i = 0; i < num_srcs; ++i) {
+    if (srcs[i] == reg) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Positions 'second' has to come after 'first' in program order for
+ * cpu.c to compute what the program says, 1 when they may be adjacent.
+ * What the pipeline does not interlock is only safe by distance:
+ *
+ *  - a reader right behind an ADDL, AND, OR or XOR (no_interlock)
+ *    decodes before its Execute 2 and reads the old value,
+ *  - a write right behind a LOAD/LDR of the same register lands in
+ *    Execute 2 before the load's in Memory 2, which overwrites it,
+ *  - a second LOAD/LDR of that register less than 3 behind clears
+ *    the valid bit before the first one's Memory 2 sets it again,
+ *    and a reader of the second goes on with the first one's value,
+ *  - BZ/BNZ clear the zero flag in writeback, after the Execute 2 of
+ *    a flag setter less than 3 behind them,
+ *  - LOAD, LDR and SUBL clear their destination's valid bit in
+ *    Execute 1 even on the wrong path of a taken branch right in
+ *    front, and the squash never sets it again,
+ *  - a reader of a LOAD/LDR right in front of a taken BZ/BNZ still
+ *    stalls in Decode/RF when the squash turns it into a bubble, and
+ *    the bubble keeps the stall for good.
+ *
+ * Stalls only add distance in cycles, so positions are enough.
+ */
+int
+APEX_hazard_distance(const APEX_TimingConfig* config,
+                     const APEX_Instruction* first,
+                     const APEX_Instruction* second)
+{
+  const APEX_OpInfo* info = &APEX_op_info[first->op];
+  int dest = APEX_ins_dest(first);
+  int distance = 1;
+
+  if (dest >= 0 && (config->no_interlock & (1u << first->op)) &&
+      reads_reg(second, dest)) {
+    distance = EX2 - DRF;
+  }
+  if (info->op_class == APEX_CLASS_LOAD &&
+      APEX_op_info[second->op].op_class == APEX_CLASS_BRANCH) {
+    distance = MEM2 - EX2;
+  }
+  if (dest >= 0 && info->op_class == APEX_CLASS_LOAD &&
+      APEX_ins_dest(second) == dest) {
+    distance = APEX_op_info[second->op].op_class == APEX_CLASS_LOAD
+                 ? MEM2 - EX1
+                 : MEM2 - EX2;
+  }
+  if (info->op_class == APEX_CLASS_BRANCH &&
+      APEX_op_info[second->op].sets_zero) {
+    distance = WB - EX2;
+  }
+  if (info->op_class == APEX_CLASS_BRANCH &&
+      (second->op == APEX_OP_LOAD || second->op == APEX_OP_LDR ||
+       second->op == APEX_OP_SUBL)) {
+    distance = EX2 - DRF;
+  }
+  return distance;
+}
+
+void
+APEX_issue_init(APEX_IssueState* state)
+{
+  state->cycle = -1;
+  memset(state->ready, 0, sizeof(state->ready));
+  memset(state->producer, -1, sizeof(state->producer));
+}
+
+/*
+ * Issues 'ins' (instruction number 'index') in order after everything
+ * issued so far. Returns the stall cycles it spends in decode waiting
+ * for operands, and the register it waited for last in '*stall_reg'
+ * (-1 if it did not stall). Control flow penalties are left to the
+ * caller, which knows whether a branch was taken.
+ */
+int
+APEX_issue(const APEX_TimingConfig* config, APEX_IssueState* state,
+           const APEX_Instruction* ins, int index, int* stall_reg)
+{
+  int srcs[4];
+  int num_srcs = APEX_ins_sources(ins, srcs);
+  long long earliest = state->cycle + 1;
+  int waited = -1;
+
+  for (int i = 0; i < num_srcs; ++i) {
+    int reg = srcs[i];
+    if (reg < 0 || reg > APEX_ZERO_FLAG_REG) {
+      continue;
+    }
+    if (state->ready[reg] > earliest) {
+      earliest = state->ready[reg];
+      waited = reg;
+    }
+  }
+
+  int stall = (int)(earliest - (state->cycle + 1));
+  state->cycle = earliest;
+
+  int ready = APEX_timing_ready(config, ins->op);
+  int dest = APEX_ins_dest(ins);
+  if (dest >= 0 && dest < APEX_ZERO_FLAG_REG) {
+    state->ready[dest] = earliest + ready;
+    state->producer[dest] = index;
+  }
+  if (APEX_op_info[ins->op].sets_zero) {
+    state->ready[APEX_ZERO_FLAG_REG] = earliest + ready;
+    state->producer[APEX_ZERO_FLAG_REG] = index;
+  }
+
+  if (stall_reg) {
+    *stall_reg = waited;
+  }
+  return stall;
+}
+
+/* Orders cycle and stage the way APEX_cpu_run calls the stages */
+static long long
+event_key(long long cycle, int stage)
+{
+  return cycle * NUM_STAGES + (WB - stage);
+}
+
+static void
+event_init(APEX_EventRing* ring)
+{
+  for (int i = 0; i < APEX_EVENT_RING; ++i) {
+    ring->key[i] = -1;
+    ring->value[i] = 0;
+  }
+  ring->next = 0;
+}
+
+static void
+event_write(APEX_EventRing* ring, long long cycle, int stage, int value)
+{
+  ring->key[ring->next] = event_key(cycle, stage);
+  ring->value[ring->next] = value;
+  ring->next = (ring->next + 1) % APEX_EVENT_RING;
+}
+
+/* Value the stage 'stage' sees in 'cycle', 0 before any write */
+static int
+event_read(const APEX_EventRing* ring, long long cycle, int stage)
+{
+  long long key = event_key(cycle, stage);
+  long long best = -1;
+  int value = 0;
+  for (int i = 0; i < APEX_EVENT_RING; ++i) {
+    if (ring->key[i] < key && ring->key[i] > best) {
+      best = ring->key[i];
+      value = ring->value[i];
+    }
+  }
+  return value;
+}
+
+/*
+ * cpu.c holds a BZ/BNZ in Decode/RF for one cycle when the zero flag is
+ * clear, Execute 1 holds ADD, SUB, MUL or a bubble, and no branch
+ * stalled since the last one written back. 'ex1' is the opcode in
+ * Execute 1, APEX_OP_NOP for a bubble.
+ */
+static int
+branch_stalls(const APEX_EventRing* flag, const APEX_EventRing* stalled,
+              long long cycle, int ex1)
+{
+  return !event_read(flag, cycle, DRF) && !event_read(stalled, cycle, DRF) &&
+         (ex1 == APEX_OP_ADD || ex1 == APEX_OP_SUB || ex1 == APEX_OP_MUL ||
+          ex1 == APEX_OP_NOP);
+}
+
+/*
+ * Starts timing a stream of 'program' on the 7 stage pipeline, one
+ * instruction at a time through APEX_replay_step. Returns 0, or -1 if
+ * the cache can not be allocated.
+ */
+int
+APEX_replay_init(APEX_ReplayState* state, const APEX_TimingConfig* config,
+                 const APEX_Program* program)
+{
+  memset(state, 0, sizeof(*state));
+  state->config = config;
+  state->program = program;
+  if (config->cache_lines > 0) {
+    state->tags = malloc(sizeof(int) * config->cache_lines);
+    if (!state->tags) {
+      return -1;
+    }
+    memset(state->tags, -1, sizeof(int) * config->cache_lines);
+  }
+  memset(state->prev, -1, sizeof(state->prev));
+  state->prev_op = APEX_OP_UNKNOWN;
+  event_init(&state->flag);
+  event_init(&state->stalled);
+  return 0;
+}
+
+/*
+ * Times the next retired instruction 'op' without evaluating it. t[s]
+ * is the last cycle it spends in stage s:
+ *
+ *  - it reaches stage s the cycle after it left s - 1 and after the
+ *    previous instruction left s,
+ *  - it leaves s no earlier than the previous instruction leaves s + 1,
+ *    since the stages run back to front and a latch holds one
+ *    instruction, which is how a stall in Decode/RF holds Fetch,
+ *  - Decode/RF holds it until its sources are ready, 'alu_ready' or
+ *    'load_ready' cycles after the producer left Decode/RF plus
+ *    whatever held the producer up on the way,
+ *  - BZ/BNZ follow branch_stalls, which needs the zero flag: recorded
+ *    results of ADD, SUB and MUL set it in Execute 2, a taken branch
+ *    clears it in Memory 1 and every branch in writeback. With
+ *    'flag_interlock' they wait for the flag like for a register.
+ *    A taken branch also decodes the two instructions after it, which
+ *    can start a stall of their own before they are squashed,
+ *  - Memory 1 holds loads and stores 'miss_penalty' extra cycles on a
+ *    miss of the optional data cache,
+ *  - after a taken BZ/BNZ the next instruction is fetched
+ *    'branch_penalty' cycles later than it could have been, counted
+ *    from the cycle the branch leaves Memory 1; after a JUMP that
+ *    redirects, 'jump_penalty' counted from Execute 2. In cpu.c JUMP
+ *    does not squash, so its lost slots are wrong path instructions
+ *    already in the stream.
+ *
+ * Returns the cycle 'op' leaves writeback.
+ */
+long long
+APEX_replay_step(APEX_ReplayState* state, const APEX_ReplayOp* op)
+{
+  const APEX_TimingConfig* config = state->config;
+  const APEX_Program* program = state->program;
+  APEX_ReplayResult* result = &state->result;
+  long long* prev = state->prev;
+  long long* ready = state->ready;
+  const APEX_Instruction* ins = &program->code[op->index];
+  const APEX_OpInfo* info = &APEX_op_info[ins->op];
+  int rule = info->op_class == APEX_CLASS_BRANCH && !config->flag_interlock;
+  int first_op = result->instructions == 0;
+  long long t[NUM_STAGES + 1];
+  t[NUM_STAGES] = -1;
+
+  for (int s = F; s < NUM_STAGES; ++s) {
+    long long first = s == F ? state->fetch : t[s - 1] + 1;
+    if (first < prev[s] + 1) {
+      first = prev[s] + 1;
+    }
+    long long last = first;
+
+    if (s == F && !first_op && state->fetch > prev[F] + 1) {
+      result->flush_cycles += state->fetch - (prev[F] + 1);
+    }
+    if (s == DRF && !rule) {
+      int srcs[4];
+      int num_srcs = APEX_ins_sources(ins, srcs);
+      for (int i = 0; i < num_srcs; ++i) {
+        if (srcs[i] >= 0 && srcs[i] <= APEX_ZERO_FLAG_REG &&
+            ready[srcs[i]] > last) {
+          last = ready[srcs[i]];
+        }
+      }
+    }
+    if (s == DRF && rule) {
+      /* Execute 1 holds the previous instruction only right after it
+       * left Decode/RF, a bubble otherwise */
+      int ex1 = first_op ? APEX_OP_UNKNOWN : APEX_OP_NOP;
+      if (!first_op && prev[DRF] == last - 1) {
+        ex1 = state->prev_op;
+      }
+      while (branch_stalls(&state->flag, &state->stalled, last, ex1)) {
+        event_write(&state->stalled, last, DRF, 1);
+        last++;
+        ex1 = APEX_OP_NOP;
+      }
+    }
+    if (s == MEM1 && state->tags && (info->op_class == APEX_CLASS_LOAD ||
+                                     info->op_class == APEX_CLASS_STORE)) {
+      unsigned int line = (unsigned int)op->address / config->line_words;
+      int set = line % config->cache_lines;
+      if (state->tags[set] == (int)line) {
+        result->hits++;
+      } else {
+        state->tags[set] = line;
+        result->misses++;
+        result->memory_stalls += config->miss_penalty;
+        last += config->miss_penalty;
+      }
+    }
+    if (last < prev[s + 1]) {
+      last = prev[s + 1];
+    }
+    if (s == DRF) {
+      result->decode_stalls += last - first;
+    }
+    t[s] = last;
+  }
+
+  /* Results are read the cycle their writer wrote them: Execute 2
+   * for ALU results and the zero flag, Memory 2 for loads */
+  int latency = APEX_timing_ready(config, ins->op);
+  long long written = info->op_class == APEX_CLASS_LOAD
+                        ? t[MEM2] - (MEM2 - DRF) + latency
+                        : t[EX2] - (EX2 - DRF) + latency;
+  if (config->no_interlock & (1u << ins->op)) {
+    written = t[DRF] + latency;
+  }
+  int dest = APEX_ins_dest(ins);
+  if (dest >= 0 && dest < APEX_ZERO_FLAG_REG) {
+    ready[dest] = written;
+  }
+  if (info->sets_zero) {
+    ready[APEX_ZERO_FLAG_REG] = written;
+    event_write(&state->flag, t[EX2], EX2, op->value == 0);
+  }
+  if (info->op_class == APEX_CLASS_BRANCH) {
+    if (op->redirect) {
+      event_write(&state->flag, t[MEM1], MEM1, 0);
+    }
+    event_write(&state->flag, t[WB], WB, 0);
+    event_write(&state->stalled, t[WB], WB, 0);
+  }
+
+  /* The wrong path of a taken branch: the instruction right behind it
+   * decodes a cycle later and, unless it stalls, the next one too */
+  if (rule && op->redirect && op->index + 2 < program->code_size) {
+    const APEX_Instruction* w1 = &program->code[op->index + 1];
+    const APEX_Instruction* w2 = &program->code[op->index + 2];
+    int srcs[4];
+    int num_srcs = APEX_ins_sources(w1, srcs);
+    int waits = 0;
+    for (int i = 0; i < num_srcs; ++i) {
+      if (srcs[i] >= 0 && srcs[i] < APEX_ZERO_FLAG_REG &&
+          ready[srcs[i]] > t[DRF] + 1) {
+        waits = 1;
+      }
+    }
+    if (!waits && APEX_op_info[w2->op].op_class == APEX_CLASS_BRANCH &&
+        branch_stalls(&state->flag, &state->stalled, t[DRF] + 2, w1->op)) {
+      event_write(&state->stalled, t[DRF] + 2, DRF, 1);
+    }
+  }
+
+  state->fetch = t[F] + 1;
+  if (op->redirect) {
+    long long target = state->fetch;
+    if (info->op_class == APEX_CLASS_BRANCH) {
+      target = t[MEM1] - (MEM1 - F) + 1 + config->branch_penalty;
+    } else if (info->op_class == APEX_CLASS_JUMP) {
+      target = t[EX2] - (EX2 - F) + 1 + config->jump_penalty;
+    }
+    if (target > state->fetch) {
+      state->fetch = target;
+    }
+  }
+  memcpy(prev, t, sizeof(state->prev));
+  state->prev_op = ins->op;
+  result->instructions++;
+  result->cycles = t[WB] + 1;
+  return t[WB];
+}
+
+/* Ends the stream, copies what the replay found to 'result' */
+void
+APEX_replay_finish(APEX_ReplayState* state, APEX_ReplayResult* result)
+{
+  *result = state->result;
+  free(state->tags);
+  state->tags = NULL;
+}
+
+/*
+ * Writes to 'canon' what decides how 'state' times the ops that follow,
+ * as offsets from the first cycle the next op can decode in. Register
+ * ready times at or before it make no difference and are clamped to
+ * it; event rings are listed in write order, which decides eviction.
+ * Two states with the same values time the same ops alike, one shifted
+ * by the difference of their cycles.
+ */
+static void
+replay_canon(const APEX_ReplayState* state, long long* canon)
+{
+  long long base = state->prev[DRF] + 1;
+  long long base_key = base * NUM_STAGES;
+  int n = 0;
+
+  for (int s = F; s < NUM_STAGES; ++s) {
+    canon[n++] = state->prev[s] - base;
+  }
+  canon[n++] = state->prev_op;
+  canon[n++] = state->fetch - base;
+  for (int r = 0; r <= APEX_ZERO_FLAG_REG; ++r) {
+    canon[n++] = state->ready[r] > base ? state->ready[r] - base : 0;
+  }
+  const APEX_EventRing* rings[2] = { &state->flag, &state->stalled };
+  for (int k = 0; k < 2; ++k) {
+    for (int i = 0; i < APEX_EVENT_RING; ++i) {
+      int slot = (rings[k]->next + i) % APEX_EVENT_RING;
+      long long key = rings[k]->key[slot];
+      canon[n++] = key < 0 ? LLONG_MIN : key - base_key;
+      canon[n++] = rings[k]->value[slot];
+    }
+  }
+}
+
+/* Moves every time in 'state' 'cycles' later */
+static void
+replay_shift(APEX_ReplayState* state, long long cycles)
+{
+  for (int s = F; s < NUM_STAGES; ++s) {
+    state->prev[s] += cycles;
+  }
+  state->fetch += cycles;
+  for (int r = 0; r <= APEX_ZERO_FLAG_REG; ++r) {
+    state->ready[r] += cycles;
+  }
+  APEX_EventRing* rings[2] = { &state->flag, &state->stalled };
+  for (int k = 0; k < 2; ++k) {
+    for (int i = 0; i < APEX_EVENT_RING; ++i) {
+      if (rings[k]->key[i] >= 0) {
+        rings[k]->key[i] += cycles * NUM_STAGES;
+      }
+    }
+  }
+}
+
+/* Adds 'times' times 'gain' to 'result' */
+static void
+result_add(APEX_ReplayResult* result, const APEX_ReplayResult* gain,
+           long long times)
+{
+  result->cycles += times * gain->cycles;
+  result->instructions += times * gain->instructions;
+  result->decode_stalls += times * gain->decode_stalls;
+  result->flush_cycles += times * gain->flush_cycles;
+  result->memory_stalls += times * gain->memory_stalls;
+  result->hits += times * gain->hits;
+  result->misses += times * gain->misses;
+}
+
+/* Whether 'a' and 'b' are timed alike: only the zero flag of a result
+ * matters, addresses do not without a cache */
+static int
+same_timing(const APEX_Program* program, const APEX_ReplayOp* a,
+            const APEX_ReplayOp* b)
+{
+  if (a->index != b->index || a->redirect != b->redirect) {
+    return 0;
+  }
+  return !APEX_op_info[program->code[a->index].op].sets_zero ||
+         (a->value == 0) == (b->value == 0);
+}
+
+int
+APEX_steady_init(APEX_SteadyState* steady, const APEX_TimingConfig* config,
+                 const APEX_Program* program)
+{
+  steady->last_index = -1;
+  steady->last_redirect = 0;
+  steady->head = -1;
+  steady->length = 0;
+  steady->steady = 0;
+  steady->extrapolated = 0;
+  return APEX_replay_init(&steady->replay, config, program);
+}
+
+/*
+ * Ends the steady state: rebuilds the replay state as of the start of
+ * the current iteration and times the ops seen of it in detail.
+ */
+static void
+leave_steady(APEX_SteadyState* steady)
+{
+  APEX_ReplayState* replay = &steady->replay;
+  int* tags = replay->tags;
+  *replay = steady->start;
+  replay->tags = tags;
+  replay_shift(replay, steady->iterations * steady->delta);
+  result_add(&replay->result, &steady->gain, steady->iterations);
+  steady->extrapolated += steady->iterations * steady->body_length;
+  steady->steady = 0;
+  steady->head = -1;
+
+  for (int k = 0; k < steady->pos; ++k) {
+    APEX_replay_step(replay, &steady->ops[k]);
+  }
+}
+
+/*
+ * Times 'op' like APEX_replay_step, returning the cycle it leaves
+ * writeback. At every loop head the replay state is compared with the
+ * one the previous iteration started from. When they match up to a
+ * shift in time, the pipeline is in a periodic state: as long as the
+ * following iterations retire the same ops, each takes the same cycles
+ * and adds the same stalls, so they are only compared op by op and the
+ * state is extrapolated when the loop exits or the stream ends. The
+ * cycles come out exactly as from APEX_replay_step. Detection is off
+ * with the data cache, whose tags change from one iteration to the next.
+ */
+long long
+APEX_steady_step(APEX_SteadyState* steady, const APEX_ReplayOp* op)
+{
+  APEX_ReplayState* replay = &steady->replay;
+  int boundary = steady->last_index >= 0 && steady->last_redirect &&
+                 op->index <= steady->last_index;
+  steady->last_index = op->index;
+  steady->last_redirect = op->redirect;
+
+  if (steady->steady) {
+    if (same_timing(replay->program, op, &steady->body[steady->pos]) &&
+        (steady->pos > 0 || boundary)) {
+      long long wb = steady->body_wb[steady->pos] +
+                     (steady->iterations + 1) * steady->delta;
+      steady->ops[steady->pos++] = *op;
+      if (steady->pos == steady->body_length) {
+        steady->pos = 0;
+        steady->iterations++;
+      }
+      return wb;
+    }
+    leave_steady(steady);
+  }
+
+  if (boundary && !replay->tags) {
+    long long canon[APEX_STEADY_CANON];
+    replay_canon(replay, canon);
+    if (op->index == steady->head && steady->length <= APEX_STEADY_BODY &&
+        same_timing(replay->program, op, &steady->ops[0]) &&
+        memcmp(canon, steady->canon, sizeof(canon)) == 0) {
+      steady->body_length = steady->length;
+      memcpy(steady->body, steady->ops,
+             sizeof(APEX_ReplayOp) * steady->length);
+      memcpy(steady->body_wb, steady->wb, sizeof(long long) * steady->length);
+      steady->delta = replay->prev[DRF] - steady->start.prev[DRF];
+      steady->gain = replay->result;
+      result_add(&steady->gain, &steady->start.result, -1);
+      steady->start = *replay;
+      steady->iterations = 0;
+      steady->pos = 1;
+      steady->ops[0] = *op;
+      steady->steady = 1;
+      if (steady->body_length == 1) {
+        steady->pos = 0;
+        steady->iterations = 1;
+      }
+      return steady->body_wb[0] + steady->delta;
+    }
+    steady->head = op->index;
+    steady->start = *replay;
+    memcpy(steady->canon, canon, sizeof(canon));
+    steady->length = 0;
+  }
+
+  long long wb = APEX_replay_step(replay, op);
+  if (steady->length < APEX_STEADY_BODY) {
+    steady->ops[steady->length] = *op;
+    steady->wb[steady->length] = wb;
+  }
+  steady->length++;
+  return wb;
+}
+
+/* Ends the stream, copies what the replay found to 'result' */
+void
+APEX_steady_finish(APEX_SteadyState* steady, APEX_ReplayResult* result)
+{
+  if (steady->steady) {
+    leave_steady(steady);
+  }
+  APEX_replay_finish(&steady->replay, result);
+  result->extrapolated = steady->extrapolated;
+}
+
+/*
+ * Times the recorded stream 'ops' of 'program', see APEX_steady_step.
+ * Returns 0, or -1 if the cache can not be allocated.
+ */
+int
+APEX_replay(const APEX_TimingConfig* config, const APEX_Program* program,
+            const APEX_ReplayOp* ops, long long count,
+            APEX_ReplayResult* result)
+{
+  APEX_SteadyState* steady = malloc(sizeof(*steady));
+  if (!steady || APEX_steady_init(steady, config, program) < 0) {
+    free(steady);
+    return -1;
+  }
+  for (long long n = 0; n < count; ++n) {
+    APEX_steady_step(steady, &ops[n]);
+  }
+  APEX_steady_finish(steady, result);
+  free(steady);
+  return 0;
+}
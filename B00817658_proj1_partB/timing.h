@@ -0,0 +1,182 @@
+#ifndef _APEX_TIMING_H_
+#define _APEX_TIMING_H_
+/**
+ *  timing.h
+ *  Latency table of the 7 stage pipeline, a first order in-order
+ *  issue model built on it, and a stage level replay model that times
+ *  a recorded or streamed instruction stream without executing it
+ *
+ *  State University of New York, Binghamton
+ */
+#include "cpu.h"
+#include "isa.h"
+
+/*
+ * Pipeline latencies, counted from the cycle an instruction leaves
+ * Decode/RF. A dependent instruction may leave Decode/RF 'ready'
+ * cycles later, see APEX_timing_defaults for how they follow from cpu.c
+ */
+typedef struct APEX_TimingConfig
+{
+  int alu_ready;	// Result written in Execute 2
+  int load_ready;	// Result written in Memory 2
+  int branch_penalty;	// Bubbles after a taken BZ/BNZ
+  int jump_penalty;	// Bubbles after a JUMP
+  int drain;		// Cycles from HALT leaving decode to the end of the run
+  unsigned int no_interlock;	// Opcodes (1 << APEX_OP_*) readers never wait for
+  int flag_interlock;		// BZ/BNZ wait for the flag like for a register,
+				// 0 is the one cycle rule of cpu.c (replay only)
+
+  /* Direct mapped data cache of the replay model, none when 0 lines */
+  int cache_lines;
+  int line_words;		// Words per line, a power of two
+  int miss_penalty;		// Extra Memory 1 cycles of a miss
+} APEX_TimingConfig;
+
+/* Largest APEX_hazard_distance, from BZ/BNZ to a flag setter */
+#define APEX_HAZARD_REACH (WB - EX2)
+
+/* Walk state of the issue model, one producer record per register */
+typedef struct APEX_IssueState
+{
+  long long cycle;		// Cycle the last instruction left decode
+  long long ready[APEX_ZERO_FLAG_REG + 1];	// Earliest issue of readers
+  int producer[APEX_ZERO_FLAG_REG + 1];	// Index of the last writer, or -1
+} APEX_IssueState;
+
+/* One retired instruction of a recorded stream, see APEX_replay */
+typedef struct APEX_ReplayOp
+{
+  int index;		// Code index
+  int address;		// Memory address of loads and stores
+  int value;		// Result, decides the zero flag of ADD, SUB, MUL
+  int redirect;		// Set when the next instruction is not index + 1
+} APEX_ReplayOp;
+
+/* What APEX_replay found */
+typedef struct APEX_ReplayResult
+{
+  long long cycles;		// Until the last instruction left writeback
+  long long instructions;
+  long long decode_stalls;	// Cycles held in Decode/RF past the first
+  long long flush_cycles;	// Fetch cycles lost to redirects
+  long long memory_stalls;	// Memory 1 cycles waiting for misses
+  long long hits;
+  long long misses;
+  long long extrapolated;	// Instructions timed from a steady loop
+} APEX_ReplayResult;
+
+/*
+ * Recent writes of one bit of pipeline state, the zero flag or the
+ * branch stall counter of cpu.c. Writes come in instruction order, not
+ * in time order, so a read looks for the latest write before it.
+ */
+#define APEX_EVENT_RING 32
+
+typedef struct APEX_EventRing
+{
+  long long key[APEX_EVENT_RING];	// Cycle and stage of the write
+  int value[APEX_EVENT_RING];
+  int next;
+} APEX_EventRing;
+
+/* Walk state of the replay model between two instructions */
+typedef struct APEX_ReplayState
+{
+  const APEX_TimingConfig* config;
+  const APEX_Program* program;
+  long long prev[NUM_STAGES + 1];	// Stage cycles of the previous instruction
+  int prev_op;
+  long long ready[APEX_ZERO_FLAG_REG + 1];
+  long long fetch;		// Earliest fetch of the next instruction
+  APEX_EventRing flag;		// Zero flag
+  APEX_EventRing stalled;	// Branch stall counter
+  int* tags;			// Data cache lines, NULL without a cache
+  APEX_ReplayResult result;
+} APEX_ReplayState;
+
+/* Ops of a loop iteration the steady state detection keeps at most */
+#define APEX_STEADY_BODY 256
+
+/* Values of a replay state that decide how it times what follows */
+#define APEX_STEADY_CANON \
+  (NUM_STAGES + 2 + APEX_ZERO_FLAG_REG + 1 + 4 * APEX_EVENT_RING)
+
+/*
+ * Replay model that spots loops in steady state, see APEX_steady_step.
+ * An iteration runs from one loop head, the target of a backward
+ * redirect, to the next time the stream reaches it.
+ */
+typedef struct APEX_SteadyState
+{
+  APEX_ReplayState replay;
+  int last_index;		// Code index of the last op, -1 before the first
+  int last_redirect;
+
+  /* Iteration timed in detail */
+  int head;			// Code index it started at, -1 if none
+  APEX_ReplayState start;	// Replay state it started from
+  long long canon[APEX_STEADY_CANON];	// The same, relative to its time
+  APEX_ReplayOp ops[APEX_STEADY_BODY];	// Its ops, or in steady state
+  long long wb[APEX_STEADY_BODY];	// the ones of this iteration so far
+  int length;			// Ops seen, may exceed APEX_STEADY_BODY
+
+  /* Steady state: every iteration repeats 'body' 'delta' cycles later */
+  int steady;
+  APEX_ReplayOp body[APEX_STEADY_BODY];
+  long long body_wb[APEX_STEADY_BODY];	// Writeback cycles before 'start'
+  int body_length;
+  long long delta;
+  APEX_ReplayResult gain;	// What one iteration adds to the result
+  long long iterations;		// Iterations since 'start'
+  int pos;			// Ops of the current one
+  long long extrapolated;
+} APEX_SteadyState;
+
+void
+APEX_timing_defaults(APEX_TimingConfig* config);
+
+int
+APEX_timing_set(APEX_TimingConfig* config, const char* name, int value);
+
+int
+APEX_timing_ready(const APEX_TimingConfig* config, int op);
+
+int
+APEX_hazard_distance(const APEX_TimingConfig* config,
+                     const APEX_Instruction* first,
+                     const APEX_Instruction* second);
+
+void
+APEX_issue_init(APEX_IssueState* state);
+
+int
+APEX_issue(const APEX_TimingConfig* config, APEX_IssueState* state,
+           const APEX_Instruction* ins, int index, int* stall_reg);
+
+int
+APEX_replay_init(APEX_ReplayState* state, const APEX_TimingConfig* config,
+                 const APEX_Program* program);
+
+long long
+APEX_replay_step(APEX_ReplayState* state, const APEX_ReplayOp* op);
+
+void
+APEX_replay_finish(APEX_ReplayState* state, APEX_ReplayResult* result);
+
+int
+APEX_steady_init(APEX_SteadyState* steady, const APEX_TimingConfig* config,
+                 const APEX_Program* program);
+
+long long
+APEX_steady_step(APEX_SteadyState* steady, const APEX_ReplayOp* op);
+
+void
+APEX_steady_finish(APEX_SteadyState* steady, APEX_ReplayResult* result);
+
+int
+APEX_replay(const APEX_TimingConfig* config, const APEX_Program* program,
+            const APEX_ReplayOp* ops, long long count,
+            APEX_ReplayResult* result);
+
+#endif
@@ -0,0 +1,635 @@
+/*
+ *  trace.c
+ *  Pipeline trace writer. The simulator only copies a few latch fields
+ *  into the ring per stage and cycle. Every APEX_TRACE_CHUNK records
+ *  the filled part is handed to the formatter, which turns it into
+ *  text with hand rolled integer formatting and writes it with one
+ *  fwrite. Without a thread that happens right away; with one the
+ *  simulator keeps going and only waits when the ring is full.
+ *
+ *  The Kanata format follows each instruction by its fetch number:
+ *  a stage record starts the instruction or moves it to a new stage,
+ *  writeback retires it on the next cycle and a squash record ends it
+ *  as flushed. Konata and other viewers of the format read the log.
+ *
+ *  The binary format keeps only retired instructions, each as a few
+ *  varints of deltas against the previous one, see trace.h. The code
+ *  goes into the header, so a trace is read back without the program.
+ *
+ *  State University of New York, Binghamton
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "isa.h"
+#include "trace.h"
+
+#define RING_MASK (APEX_TRACE_RING - 1)
+
+/* Code address of instruction 0, see get_code_index */
+#define CODE_BASE 4000
+
+#define WINDOW_MASK (APEX_TRACE_WINDOW - 1)
+
+/* Longest text of one record, see format_display and format_kanata */
+#define RECORD_TEXT 192
+
+/* Stage names padded the way print_stage_content printed them */
+static const char* stage_prefix[NUM_STAGES] = {
+  "Fetch          : pc(", "Decode/RF      : pc(", "Execute 1      : pc(",
+  "Execute 2      : pc(", "Memory 1       : pc(", "Memory 2       : pc(",
+  "Writeback      : pc(",
+};
+
+static const char cycle_rule[] = "--------------------------------\n";
+
+/* Stage names in a Kanata log */
+static const char* kanata_stage[NUM_STAGES] = {
+  "F", "DRF", "EX1", "EX2", "MEM1", "MEM2", "WB",
+};
+
+static char*
+put_string(char* p, const char* s)
+{
+  while (*s) {
+    *p++ = *s++;
+  }
+  return p;
+}
+
+static char*
+put_int(char* p, int value)
+{
+  char digits[12];
+  int n = 0;
+  unsigned int u = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+  if (value < 0) {
+    *p++ = '-';
+  }
+  do {
+    digits[n++] = '0' + u % 10;
+    u /= 10;
+  } while (u);
+  while (n) {
+    *p++ = digits[--n];
+  }
+  return p;
+}
+
+/* Mnemonic and operands of the instruction in 'r' */
+static char*
+format_instruction(char* p, const APEX_TraceRecord* r)
+{
+  const APEX_OpInfo* info = &APEX_op_info[r->op];
+  p = put_string(p, info->name);
+  for (int i = 0; i < APEX_MAX_OPERANDS && info->fields[i]; ++i) {
+    *p++ = ',';
+    switch (info->fields[i]) {
+      case APEX_FIELD_RD:
+        *p++ = 'R';
+        p = put_int(p, r->rd);
+        break;
+      case APEX_FIELD_RS1:
+        *p++ = 'R';
+        p = put_int(p, r->rs1);
+        break;
+      case APEX_FIELD_RS2:
+        *p++ = 'R';
+        p = put_int(p, r->rs2);
+        break;
+      case APEX_FIELD_RS3:
+        *p++ = 'R';
+        p = put_int(p, r->rs3);
+        break;
+      case APEX_FIELD_IMM:
+        *p++ = '#';
+        p = put_int(p, r->imm);
+        break;
+    }
+  }
+  return p;
+}
+
+/* One record as the display mode prints it */
+static char*
+format_display(char* p, const APEX_TraceRecord* r)
+{
+  if (r->kind == APEX_TRACE_SQUASH) {
+    return p;
+  }
+  if (r->kind == APEX_TRACE_CYCLE) {
+    p = put_string(p, cycle_rule);
+    p = put_string(p, "Clock Cycle #: ");
+    p = put_int(p, r->pc);
+    *p++ = '\n';
+    return put_string(p, cycle_rule);
+  }
+
+  p = put_string(p, stage_prefix[r->kind]);
+  p = put_int(p, r->pc);
+  *p++ = ')';
+  *p++ = ' ';
+  if (r->op != APEX_OP_UNKNOWN) {
+    p = format_instruction(p, r);
+    /* JUMP, HALT and NOP were printed without a trailing blank */
+    if (r->op != APEX_OP_JUMP && r->op != APEX_OP_HALT &&
+        r->op != APEX_OP_NOP) {
+      *p++ = ' ';
+    }
+  }
+  *p++ = '\n';
+  return p;
+}
+
+/* Ends instruction 'seq' with an R line of 'type', 0 retired 1 flushed */
+static char*
+kanata_retire(APEX_Trace* trace, char* p, int seq, int type)
+{
+  int slot = seq & WINDOW_MASK;
+  if (trace->live_seq[slot] != seq) {
+    return p;
+  }
+  p = put_string(p, "R\t");
+  p = put_int(p, trace->live_id[slot]);
+  *p++ = '\t';
+  p = put_int(p, type ? 0 : trace->retire_id++);
+  *p++ = '\t';
+  *p++ = '0' + type;
+  *p++ = '\n';
+  trace->live_seq[slot] = 0;
+  return p;
+}
+
+/* One record as Kanata log lines */
+static char*
+format_kanata(APEX_Trace* trace, char* p, const APEX_TraceRecord* r)
+{
+  if (r->kind == APEX_TRACE_CYCLE) {
+    if (trace->last_cycle < 0) {
+      p = put_string(p, "C=\t");
+      p = put_int(p, r->pc);
+    } else {
+      p = put_string(p, "C\t");
+      p = put_int(p, r->pc - trace->last_cycle);
+    }
+    *p++ = '\n';
+    trace->last_cycle = r->pc;
+    if (trace->retiring) {
+      p = kanata_retire(trace, p, trace->retiring, 0);
+      trace->retiring = 0;
+    }
+    return p;
+  }
+  if (!r->seq) {
+    return p;
+  }
+  if (r->kind == APEX_TRACE_SQUASH) {
+    return kanata_retire(trace, p, r->seq, 1);
+  }
+
+  int slot = r->seq & WINDOW_MASK;
+  if (trace->live_seq[slot] != r->seq) {
+    trace->live_seq[slot] = r->seq;
+    trace->live_id[slot] = trace->next_id++;
+    p = put_string(p, "I\t");
+    p = put_int(p, trace->live_id[slot]);
+    *p++ = '\t';
+    p = put_int(p, r->seq);
+    p = put_string(p, "\t0\nL\t");
+    p = put_int(p, trace->live_id[slot]);
+    p = put_string(p, "\t0\t");
+    p = put_int(p, r->pc);
+    *p++ = ':';
+    *p++ = ' ';
+    p = format_instruction(p, r);
+    *p++ = '\n';
+  }
+  /* Stalled instructions show up every cycle but start the stage once */
+  if (trace->stage_seq[r->kind] != r->seq) {
+    trace->stage_seq[r->kind] = r->seq;
+    p = put_string(p, "S\t");
+    p = put_int(p, trace->live_id[slot]);
+    p = put_string(p, "\t0\t");
+    p = put_string(p, kanata_stage[r->kind]);
+    *p++ = '\n';
+  }
+  if (r->kind == WB) {
+    trace->retiring = r->seq;
+  }
+  return p;
+}
+
+static char*
+put_varint(char* p, unsigned int value)
+{
+  while (value >= 0x80) {
+    *p++ = (char)(value | 0x80);
+    value >>= 7;
+  }
+  *p++ = (char)value;
+  return p;
+}
+
+/* Small magnitudes of either sign map to small varints */
+static unsigned int
+zigzag(unsigned int value)
+{
+  return (value << 1) ^ (0u - (value >> 31));
+}
+
+static int
+unzigzag(unsigned int value)
+{
+  return (int)((value >> 1) ^ (0u - (value & 1)));
+}
+
+/* One record of the binary trace, nothing unless it retires */
+static char*
+format_binary(APEX_Trace* trace, char* p, const APEX_TraceRecord* r)
+{
+  if (r->kind == APEX_TRACE_CYCLE) {
+    trace->cycle = r->pc;
+    return p;
+  }
+  if (r->kind != WB || !r->seq || r->seq == trace->retire_seq) {
+    return p;
+  }
+  trace->retire_seq = r->seq;
+
+  int index = (r->pc - CODE_BASE) / 4;
+  p = put_varint(p, trace->cycle - trace->retire_cycle);
+  p = put_varint(p, zigzag(index - trace->retire_index - 1));
+  trace->retire_cycle = trace->cycle;
+  trace->retire_index = index;
+
+  const APEX_OpInfo* info = &APEX_op_info[r->op];
+  if (info->writes_rd && r->rd >= 0 && r->rd < 32) {
+    p = put_varint(p, zigzag((unsigned int)r->value - trace->reg_value[r->rd]));
+    trace->reg_value[r->rd] = r->value;
+  }
+  if (info->op_class == APEX_CLASS_LOAD || info->op_class == APEX_CLASS_STORE) {
+    p = put_varint(p, zigzag((unsigned int)r->address - trace->retire_address));
+    trace->retire_address = r->address;
+  }
+  return p;
+}
+
+/* Formats and writes records [from, to) */
+static void
+write_records(APEX_Trace* trace, unsigned long from, unsigned long to)
+{
+  while (from < to) {
+    unsigned long end = to - from > APEX_TRACE_CHUNK ? from + APEX_TRACE_CHUNK
+                                                      : to;
+    char* p = trace->text;
+    if (trace->format == APEX_TRACE_KANATA) {
+      for (unsigned long i = from; i < end; ++i) {
+        p = format_kanata(trace, p, &trace->ring[i & RING_MASK]);
+      }
+    } else if (trace->format == APEX_TRACE_BINARY) {
+      for (unsigned long i = from; i < end; ++i) {
+        p = format_binary(trace, p, &trace->ring[i & RING_MASK]);
+      }
+    } else {
+      for (unsigned long i = from; i < end; ++i) {
+        p = format_display(p, &trace->ring[i & RING_MASK]);
+      }
+    }
+    fwrite(trace->text, 1, p - trace->text, trace->out);
+    from = end;
+  }
+}
+
+static void*
+trace_thread(void* arg)
+{
+  APEX_Trace* trace = arg;
+  pthread_mutex_lock(&trace->lock);
+  while (1) {
+    while (trace->tail == trace->published && !trace->done) {
+      pthread_cond_wait(&trace->cond, &trace->lock);
+    }
+    if (trace->tail == trace->published) {
+      break;
+    }
+    unsigned long from = trace->tail;
+    unsigned long to = trace->published;
+    pthread_mutex_unlock(&trace->lock);
+
+    write_records(trace, from, to);
+
+    pthread_mutex_lock(&trace->lock);
+    trace->tail = to;
+    pthread_cond_broadcast(&trace->cond);
+  }
+  pthread_mutex_unlock(&trace->lock);
+  return NULL;
+}
+
+/*
+ * Starts a trace written to 'out' in 'format'. With 'threaded' set the
+ * formatting runs on a background thread. Returns 0 on success.
+ */
+int
+APEX_trace_open(APEX_Trace* trace, FILE* out, int format, int threaded)
+{
+  memset(trace, 0, sizeof(*trace));
+  trace->ring = malloc(sizeof(*trace->ring) * APEX_TRACE_RING);
+  trace->text = malloc(RECORD_TEXT * APEX_TRACE_CHUNK);
+  if (!trace->ring || !trace->text) {
+    free(trace->ring);
+    free(trace->text);
+    return -1;
+  }
+  trace->out = out;
+  trace->format = format;
+  trace->last_cycle = -1;
+  trace->retire_index = -1;
+  if (format == APEX_TRACE_KANATA) {
+    fputs("Kanata\t0004\n", out);
+  }
+
+  if (threaded) {
+    pthread_mutex_init(&trace->lock, NULL);
+    pthread_cond_init(&trace->cond, NULL);
+    if (pthread_create(&trace->thread, NULL, trace_thread, trace) != 0) {
+      pthread_mutex_destroy(&trace->lock);
+      pthread_cond_destroy(&trace->cond);
+      threaded = 0;
+    }
+  }
+  trace->threaded = threaded;
+  return 0;
+}
+
+/*
+ * Starts a binary trace of the retired instructions of 'program',
+ * writing the header with its code right away
+ */
+int
+APEX_trace_open_binary(APEX_Trace* trace, FILE* out,
+                       const APEX_Program* program, int threaded)
+{
+  char magic[8] = APEX_TRACE_MAGIC;
+  char header[8 * 5];
+  fwrite(magic, 1, sizeof(magic), out);
+  char* p = put_varint(header, APEX_TRACE_VERSION);
+  p = put_varint(p, program->code_size);
+  fwrite(header, 1, p - header, out);
+  for (int i = 0; i < program->code_size; ++i) {
+    const APEX_Instruction* ins = &program->code[i];
+    p = put_varint(header, ins->op);
+    p = put_varint(p, zigzag(ins->rd));
+    p = put_varint(p, zigzag(ins->rs1));
+    p = put_varint(p, zigzag(ins->rs2));
+    p = put_varint(p, zigzag(ins->rs3));
+    p = put_varint(p, zigzag(ins->imm));
+    fwrite(header, 1, p - header, out);
+  }
+  return APEX_trace_open(trace, out, APEX_TRACE_BINARY, threaded);
+}
+
+/* Hands everything written so far to the formatter */
+static void
+publish(APEX_Trace* trace)
+{
+  if (!trace->threaded) {
+    write_records(trace, trace->tail, trace->head);
+    trace->published = trace->tail = trace->head;
+    return;
+  }
+  pthread_mutex_lock(&trace->lock);
+  trace->published = trace->head;
+  pthread_cond_broadcast(&trace->cond);
+  /* Wait for room for the next chunk */
+  while (trace->head - trace->tail > APEX_TRACE_RING - APEX_TRACE_CHUNK) {
+    pthread_cond_wait(&trace->cond, &trace->lock);
+  }
+  pthread_mutex_unlock(&trace->lock);
+}
+
+static inline APEX_TraceRecord*
+next_record(APEX_Trace* trace)
+{
+  return &trace->ring[trace->head & RING_MASK];
+}
+
+static inline void
+commit_record(APEX_Trace* trace)
+{
+  if (++trace->head - trace->published == APEX_TRACE_CHUNK) {
+    publish(trace);
+  }
+}
+
+/* Records what 'stage' (F..WB) held once the stage was done */
+void
+APEX_trace_stage(APEX_Trace* trace, const CPU_Stage* stage, int kind)
+{
+  APEX_TraceRecord* r = next_record(trace);
+  r->kind = kind;
+  r->op = APEX_op_lookup(stage->opcode, strlen(stage->opcode));
+  r->pc = stage->pc;
+  r->rd = stage->rd;
+  r->rs1 = stage->rs1;
+  r->rs2 = stage->rs2;
+  r->rs3 = stage->rs3;
+  r->imm = stage->imm;
+  r->seq = APEX_stage_is_bubble(stage) ? 0 : stage->seq;
+  /* Loads carry the word read in rs1_value, everything else the result
+   * in buffer */
+  r->value = APEX_op_info[r->op].op_class == APEX_CLASS_LOAD
+               ? stage->rs1_value
+               : stage->buffer;
+  r->address = stage->mem_address;
+  commit_record(trace);
+}
+
+/* Records that the instruction in 'stage' was squashed */
+void
+APEX_trace_squash(APEX_Trace* trace, const CPU_Stage* stage)
+{
+  APEX_TraceRecord* r = next_record(trace);
+  r->kind = APEX_TRACE_SQUASH;
+  r->seq = stage->seq;
+  commit_record(trace);
+}
+
+void
+APEX_trace_cycle(APEX_Trace* trace, int cycle)
+{
+  APEX_TraceRecord* r = next_record(trace);
+  r->kind = APEX_TRACE_CYCLE;
+  r->pc = cycle;
+  commit_record(trace);
+}
+
+/* Writes out every record so far, the output is flushed too */
+void
+APEX_trace_flush(APEX_Trace* trace)
+{
+  if (trace->threaded) {
+    pthread_mutex_lock(&trace->lock);
+    trace->published = trace->head;
+    pthread_cond_broadcast(&trace->cond);
+    while (trace->tail != trace->head) {
+      pthread_cond_wait(&trace->cond, &trace->lock);
+    }
+    pthread_mutex_unlock(&trace->lock);
+  } else {
+    publish(trace);
+  }
+  fflush(trace->out);
+}
+
+void
+APEX_trace_close(APEX_Trace* trace)
+{
+  APEX_trace_flush(trace);
+  if (trace->threaded) {
+    pthread_mutex_lock(&trace->lock);
+    trace->done = 1;
+    pthread_cond_broadcast(&trace->cond);
+    pthread_mutex_unlock(&trace->lock);
+    pthread_join(trace->thread, NULL);
+    pthread_mutex_destroy(&trace->lock);
+    pthread_cond_destroy(&trace->cond);
+  }
+  /* The last instruction written back retires one cycle later */
+  if (trace->format == APEX_TRACE_KANATA && trace->retiring) {
+    char* p = put_string(trace->text, "C\t1\n");
+    p = kanata_retire(trace, p, trace->retiring, 0);
+    trace->retiring = 0;
+    fwrite(trace->text, 1, p - trace->text, trace->out);
+    fflush(trace->out);
+  }
+  free(trace->ring);
+  free(trace->text);
+  trace->ring = NULL;
+  trace->text = NULL;
+}
+
+/* Next varint of 'in' into '*value'. Returns 1, 0 at the end of the
+ * file, -1 if it ends inside the varint or the varint is too long */
+static int
+get_varint(FILE* in, unsigned int* value)
+{
+  unsigned int v = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    int c = getc(in);
+    if (c == EOF) {
+      return shift ? -1 : 0;
+    }
+    v |= (unsigned int)(c & 0x7f) << shift;
+    if (!(c & 0x80)) {
+      *value = v;
+      return 1;
+    }
+  }
+  return -1;
+}
+
+static int
+get_signed(FILE* in, int* value)
+{
+  unsigned int v;
+  if (get_varint(in, &v) != 1) {
+    return -1;
+  }
+  *value = unzigzag(v);
+  return 0;
+}
+
+/*
+ * Reads the header of the binary trace 'in', leaving the recorded code
+ * in reader->program. Returns 0 on success, -1 if 'in' is no trace.
+ */
+int
+APEX_trace_reader_open(APEX_TraceReader* reader, FILE* in)
+{
+  char magic[8];
+  unsigned int version, code_size;
+  memset(reader, 0, sizeof(*reader));
+  reader->in = in;
+  reader->index = -1;
+  if (fread(magic, 1, sizeof(magic), in) != sizeof(magic) ||
+      memcmp(magic, APEX_TRACE_MAGIC, sizeof(APEX_TRACE_MAGIC)) != 0 ||
+      get_varint(in, &version) != 1 || version != APEX_TRACE_VERSION ||
+      get_varint(in, &code_size) != 1 || code_size > (1u << 24)) {
+    return -1;
+  }
+
+  APEX_Instruction* code = calloc(code_size ? code_size : 1, sizeof(*code));
+  if (!code) {
+    return -1;
+  }
+  for (unsigned int i = 0; i < code_size; ++i) {
+    unsigned int op;
+    if (get_varint(in, &op) != 1 || op >= APEX_NUM_OPS ||
+        get_signed(in, &code[i].rd) || get_signed(in, &code[i].rs1) ||
+        get_signed(in, &code[i].rs2) || get_signed(in, &code[i].rs3) ||
+        get_signed(in, &code[i].imm)) {
+      free(code);
+      return -1;
+    }
+    code[i].op = op;
+    strcpy(code[i].opcode, APEX_op_info[op].name);
+  }
+  reader->program.code = code;
+  reader->program.code_size = code_size;
+  return 0;
+}
+
+/*
+ * Reads the next retired instruction into 'event'. Returns 1, 0 at the
+ * end of the trace, -1 if the trace is cut short or corrupt.
+ */
+int
+APEX_trace_read(APEX_TraceReader* reader, APEX_TraceEvent* event)
+{
+  unsigned int cycles, skip;
+  int ret = get_varint(reader->in, &cycles);
+  if (ret != 1) {
+    return ret;
+  }
+  if (get_varint(reader->in, &skip) != 1) {
+    return -1;
+  }
+  int index = reader->index + 1 + unzigzag(skip);
+  if (index < 0 || index >= reader->program.code_size) {
+    return -1;
+  }
+  reader->cycle += cycles;
+  reader->index = index;
+
+  const APEX_Instruction* ins = &reader->program.code[index];
+  const APEX_OpInfo* info = &APEX_op_info[ins->op];
+  unsigned int delta;
+  event->value = 0;
+  event->address = 0;
+  if (info->writes_rd && ins->rd >= 0 && ins->rd < 32) {
+    if (get_varint(reader->in, &delta) != 1) {
+      return -1;
+    }
+    reader->regs[ins->rd] =
+      (int)((unsigned int)reader->regs[ins->rd] + unzigzag(delta));
+    event->value = reader->regs[ins->rd];
+  }
+  if (info->op_class == APEX_CLASS_LOAD || info->op_class == APEX_CLASS_STORE) {
+    if (get_varint(reader->in, &delta) != 1) {
+      return -1;
+    }
+    reader->address = (int)((unsigned int)reader->address + unzigzag(delta));
+    event->address = reader->address;
+  }
+  event->cycle = reader->cycle;
+  event->index = index;
+  event->ins = ins;
+  return 1;
+}
+
+void
+APEX_trace_reader_close(APEX_TraceReader* reader)
+{
+  APEX_program_release(&reader->program);
+}
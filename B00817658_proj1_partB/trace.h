@@ -0,0 +1,159 @@
+#ifndef _APEX_TRACE_H_
+#define _APEX_TRACE_H_
+/**
+ *  trace.h
+ *  Pipeline trace writer. Stages append fixed size latch records to a
+ *  preallocated ring, which is formatted and written out in bulk,
+ *  optionally by a background thread. The records become the text of
+ *  the "display" mode, a Kanata log for pipeline viewers, or a compact
+ *  binary trace of retired instructions that APEX_trace_read replays.
+ *
+ *  State University of New York, Binghamton
+ */
+#include <pthread.h>
+#include <stdio.h>
+
+#include "cpu.h"
+
+/* Records in the ring, a power of two */
+#define APEX_TRACE_RING (1 << 16)
+
+/* Records handed to the formatter at a time */
+#define APEX_TRACE_CHUNK (APEX_TRACE_RING / 4)
+
+/*
+ * Binary trace layout. Header: APEX_TRACE_MAGIC (8 bytes, NUL padded),
+ * varint version and code size, then per instruction varint op and
+ * zigzag rd, rs1, rs2, rs3, imm. Then one record per retired
+ * instruction, all varints:
+ *
+ *  - cycles since the previous retirement,
+ *  - zigzag code index minus (previous index + 1), 0 when in sequence,
+ *  - if the instruction writes rd, zigzag result minus the last value
+ *    recorded for rd,
+ *  - for loads and stores, zigzag address minus the previous address.
+ */
+#define APEX_TRACE_MAGIC "APEXTRC"
+#define APEX_TRACE_VERSION 1
+
+/* Instructions in flight a Kanata log keeps track of, a power of two */
+#define APEX_TRACE_WINDOW 64
+
+/* Record kinds besides the stage numbers F..WB */
+enum
+{
+  APEX_TRACE_CYCLE = NUM_STAGES,	// Start of a clock cycle
+  APEX_TRACE_SQUASH		// Instruction squashed by a taken branch
+};
+
+/* Output formats */
+enum
+{
+  APEX_TRACE_DISPLAY,		// Text of the "display" mode
+  APEX_TRACE_KANATA,		// Kanata 0004 log, one lane per instruction
+  APEX_TRACE_BINARY		// Retired instructions, see APEX_TRACE_MAGIC
+};
+
+/* What a stage latch held when the stage was done with it */
+typedef struct APEX_TraceRecord
+{
+  int kind;			// Stage F..WB, or APEX_TRACE_CYCLE
+  int op;			// APEX_OP_* of the latch opcode
+  int pc;			// Latch pc, the cycle for APEX_TRACE_CYCLE
+  int rd;
+  int rs1;
+  int rs2;
+  int rs3;
+  int imm;
+  int seq;			// Fetch order, 0 for a bubble
+  int value;			// Result of the instruction
+  int address;			// Memory address of loads and stores
+} APEX_TraceRecord;
+
+typedef struct APEX_Trace
+{
+  APEX_TraceRecord* ring;
+  unsigned long head;		// Next record the simulator writes
+  unsigned long published;	// Records handed to the formatter
+  unsigned long tail;		// Next record the formatter reads
+  int format;			// APEX_TRACE_*
+  FILE* out;
+  char* text;			// Formatting buffer of one chunk
+
+  /* Kanata log state, only the formatter touches it */
+  int last_cycle;		// Last cycle written, -1 before the first
+  int stage_seq[NUM_STAGES];	// Instruction each stage was last entered by
+  int live_seq[APEX_TRACE_WINDOW];	// Instructions started and not retired
+  int live_id[APEX_TRACE_WINDOW];	// Their log ids
+  int next_id;
+  int retire_id;
+  int retiring;			// Instruction to retire next cycle, or 0
+
+  /* Binary trace state, only the formatter touches it */
+  int cycle;			// Cycle of the records being formatted
+  int retire_seq;		// Last instruction recorded
+  int retire_cycle;
+  int retire_index;
+  int retire_address;
+  int reg_value[32];		// Last result recorded per register
+
+  /* Background formatting, when 'threaded' is set */
+  int threaded;
+  int done;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+} APEX_Trace;
+
+/* One retired instruction read back from a binary trace */
+typedef struct APEX_TraceEvent
+{
+  long long cycle;		// Cycle it was written back
+  int index;			// Code index
+  const APEX_Instruction* ins;
+  int value;			// Result, when the instruction writes rd
+  int address;			// Memory address of loads and stores
+} APEX_TraceEvent;
+
+typedef struct APEX_TraceReader
+{
+  FILE* in;
+  APEX_Program program;		// Code recorded in the header
+  long long cycle;
+  int index;
+  int address;
+  int regs[32];
+} APEX_TraceReader;
+
+int
+APEX_trace_open(APEX_Trace* trace, FILE* out, int format, int threaded);
+
+int
+APEX_trace_open_binary(APEX_Trace* trace, FILE* out,
+                       const APEX_Program* program, int threaded);
+
+void
+APEX_trace_stage(APEX_Trace* trace, const CPU_Stage* stage, int kind);
+
+void
+APEX_trace_squash(APEX_Trace* trace, const CPU_Stage* stage);
+
+void
+APEX_trace_cycle(APEX_Trace* trace, int cycle);
+
+void
+APEX_trace_flush(APEX_Trace* trace);
+
+void
+APEX_trace_close(APEX_Trace* trace);
+
+int
+APEX_trace_reader_open(APEX_TraceReader* reader, FILE* in);
+
+int
+APEX_trace_read(APEX_TraceReader* reader, APEX_TraceEvent* event);
+
+void
+APEX_trace_reader_close(APEX_TraceReader* reader);
+
+#endif